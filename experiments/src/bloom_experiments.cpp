@@ -0,0 +1,76 @@
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "bloom.hpp"
+#include "experiments.hpp"
+
+/**
+ * @brief Fill @param buckets buckets with keys at about 10 bits per key, and
+ * time @param operations random probes of them with @param check, returning
+ * the average nanoseconds per probe.
+ */
+double benchmark_probe(uint64_t buckets, uint64_t operations,
+                       BucketCheckFn check) {
+  constexpr uint32_t kNumHashes = 7;
+  std::vector<BloomBucket> filter(buckets);
+
+  std::mt19937_64 eng(buckets);
+  uint64_t keys = buckets * 256 / 10;
+  for (uint64_t i = 0; i < keys; i++) {
+    uint64_t hash = eng();
+    bucket_insert(filter[((hash >> 32) * buckets) >> 32],
+                  static_cast<uint32_t>(hash), kNumHashes);
+  }
+
+  std::vector<uint64_t> probes(operations);
+  for (uint64_t i = 0; i < operations; i++) {
+    probes[i] = eng();
+  }
+
+  uint64_t positives = 0;
+  auto t1 = std::chrono::high_resolution_clock::now();
+  for (uint64_t hash : probes) {
+    positives += check(filter[((hash >> 32) * buckets) >> 32],
+                       static_cast<uint32_t>(hash), kNumHashes);
+  }
+  auto t2 = std::chrono::high_resolution_clock::now();
+  auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(t2 - t1);
+
+  // Keep the probes from being optimized away, and sanity check the filter
+  std::cout << "  false positive rate "
+            << static_cast<double>(positives) / operations << '\n';
+  return static_cast<double>(ns.count()) / static_cast<double>(operations);
+}
+
+int main() {
+  uint64_t max_buckets = 1 << 20;
+  uint64_t operations = 10000000;
+
+  std::vector<std::pair<std::string, BucketCheckFn>> checks = {
+      {"scalar", &bucket_check_scalar}};
+#if defined(__x86_64__) || defined(__i386__)
+  checks.emplace_back("sse2", &bucket_check_sse2);
+  if (__builtin_cpu_supports("avx2")) {
+    checks.emplace_back("avx2", &bucket_check_avx2);
+  }
+#endif
+
+  std::vector<std::string> results;
+  for (uint64_t buckets = 1 << 8; buckets <= max_buckets; buckets *= 4) {
+    for (const auto& [name, check] : checks) {
+      std::cout << "Running experiment for " << buckets << " buckets with "
+                << name << '\n';
+      double ns_per_probe = benchmark_probe(buckets, operations, check);
+      results.push_back(std::to_string(buckets * sizeof(BloomBucket)) + "," +
+                        name + "," + std::to_string(ns_per_probe));
+    }
+  }
+
+  write_to_csv("bloom_probe.csv", "filterSize (bytes),probe,latency (ns/probe)",
+               results);
+}
@@ -0,0 +1,74 @@
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <optional>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "buf.hpp"
+#include "experiments.hpp"
+
+/**
+ * @brief Fill a buffer pool of @param pages pages, and time @param operations
+ * random lookups that all hit, returning the average nanoseconds per hit.
+ */
+double benchmark_hit(uint32_t pages, uint64_t operations) {
+  // Start small as the KvStore does, the trie only splits as it grows
+  BufPool buf(BufPoolTuning{
+      .initial_elements = 16,
+      .max_elements = pages,
+  });
+
+  // Share one frame between every page, only the bookkeeping is measured
+  std::vector<PageId> ids;
+  ids.reserve(pages);
+  PageId first{.filename = "Benchmarks.BufferPool.file0", .page = 0};
+  std::shared_ptr<PageFrame> frame = buf.NewFrame(first);
+  for (uint32_t page = 0; page < pages; page++) {
+    PageId id{.filename = "Benchmarks.BufferPool.file" +
+                          std::to_string(page % 16),
+              .page = page};
+    buf.PutPage(id, frame);
+    ids.push_back(id);
+  }
+
+  std::mt19937 eng(pages);
+  std::uniform_int_distribution<uint32_t> dist(0, pages - 1);
+  std::vector<uint32_t> lookups(operations);
+  for (uint64_t i = 0; i < operations; i++) {
+    lookups[i] = dist(eng);
+  }
+
+  uint64_t hits = 0;
+  auto t1 = std::chrono::high_resolution_clock::now();
+  for (uint32_t lookup : lookups) {
+    std::optional<PageHandle> page = buf.GetPage(ids[lookup]);
+    hits += page.has_value();
+  }
+  auto t2 = std::chrono::high_resolution_clock::now();
+  auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(t2 - t1);
+
+  if (hits != operations) {
+    std::cout << "Expected every lookup to hit, but " << operations - hits
+              << " missed\n";
+  }
+  return static_cast<double>(ns.count()) / static_cast<double>(operations);
+}
+
+int main() {
+  uint32_t max_pages = 1 << 16;
+  uint64_t operations = 1000000;
+
+  std::vector<std::string> results;
+  for (uint32_t pages = 1 << 8; pages <= max_pages; pages *= 2) {
+    std::cout << "Running experiment for " << pages << " pages\n";
+    double ns_per_hit = benchmark_hit(pages, operations);
+    results.push_back(std::to_string(pages) + "," +
+                      std::to_string(ns_per_hit));
+  }
+
+  write_to_csv("buffer_pool_hit.csv", "poolSize (pages),latency (ns/hit)",
+               results);
+}
@@ -0,0 +1,118 @@
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "constants.hpp"
+#include "experiments.hpp"
+#include "memtable.hpp"
+
+// The number of times each table is filled, read out and cleared, as it is
+// between flushes
+constexpr std::size_t kFills = 8;
+
+/**
+ * @brief The random keys to put into a table of @param elements elements.
+ */
+std::vector<K> put_keys(std::size_t elements) {
+  std::mt19937_64 eng(elements);
+  std::uniform_int_distribution<K> keys;
+  std::vector<K> result(elements);
+  for (auto& key : result) {
+    key = keys(eng);
+  }
+  return result;
+}
+
+/**
+ * @brief A red-black tree allocating every node on its own, as a baseline:
+ * fill a std::map with @param keys, copy its pairs out in order as a flush
+ * would, and clear it, `kFills` times, returning the average nanoseconds per
+ * put.
+ */
+double benchmark_map(const std::vector<K>& keys) {
+  std::map<K, V> table;
+  std::size_t flushed = 0;
+  auto t1 = std::chrono::high_resolution_clock::now();
+  for (std::size_t fill = 0; fill < kFills; fill++) {
+    for (const K key : keys) {
+      table.insert_or_assign(key, key);
+    }
+    std::vector<std::pair<K, V>> pairs(table.begin(), table.end());
+    flushed += pairs.size();
+    table.clear();
+  }
+  auto t2 = std::chrono::high_resolution_clock::now();
+  auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(t2 - t1);
+
+  // Keep the flushes from being optimized away
+  std::cout << "  flushed " << flushed << " pairs\n";
+  return static_cast<double>(ns.count()) /
+         static_cast<double>(kFills * keys.size());
+}
+
+/**
+ * @brief Fill a MemTable of @param format with @param keys, read its pairs
+ * out in order as a flush does, and clear it, `kFills` times, returning the
+ * average nanoseconds per put.
+ */
+double benchmark_memtable(const std::vector<K>& keys, MemTableFormat format) {
+  MemTable table(keys.size(), format);
+  std::size_t flushed = 0;
+  auto t1 = std::chrono::high_resolution_clock::now();
+  for (std::size_t fill = 0; fill < kFills; fill++) {
+    for (const K key : keys) {
+      table.Put(key, key);
+    }
+    flushed += table.ScanAll()->size();
+    table.Clear();
+  }
+  auto t2 = std::chrono::high_resolution_clock::now();
+  auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(t2 - t1);
+
+  // Keep the flushes from being optimized away
+  std::cout << "  flushed " << flushed << " pairs\n";
+  return static_cast<double>(ns.count()) /
+         static_cast<double>(kFills * keys.size());
+}
+
+int main() {
+  std::size_t max_elements = 4 * kMegabyteSize / sizeof(std::pair<K, V>);
+
+  std::vector<
+      std::pair<std::string, std::function<double(const std::vector<K>&)>>>
+      tables = {
+          {"map", &benchmark_map},
+          {"memtable",
+           [](const std::vector<K>& keys) {
+             return benchmark_memtable(keys, kRedBlackTree);
+           }},
+          {"skiplist",
+           [](const std::vector<K>& keys) {
+             return benchmark_memtable(keys, kSkipList);
+           }},
+          {"vector",
+           [](const std::vector<K>& keys) {
+             return benchmark_memtable(keys, kVector);
+           }},
+      };
+
+  std::vector<std::string> results;
+  for (std::size_t elements = 1024; elements <= max_elements; elements *= 4) {
+    std::vector<K> keys = put_keys(elements);
+    for (const auto& [name, benchmark] : tables) {
+      std::cout << "Running experiment for " << elements << " elements with "
+                << name << '\n';
+      double ns_per_put = benchmark(keys);
+      results.push_back(std::to_string(elements) + "," + name + "," +
+                        std::to_string(ns_per_put));
+    }
+  }
+
+  write_to_csv("memtable.csv", "elements,memtable,latency (ns/put)", results);
+}
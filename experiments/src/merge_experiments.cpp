@@ -0,0 +1,209 @@
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <queue>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "buf.hpp"
+#include "constants.hpp"
+#include "experiments.hpp"
+#include "filter.hpp"
+#include "lsm.hpp"
+#include "manifest.hpp"
+#include "minheap.hpp"
+#include "naming.hpp"
+#include "sstable.hpp"
+
+using Buffers = std::vector<std::vector<std::pair<K, V>>>;
+
+/**
+ * @brief The binary heap merge, as a baseline: keeps the key and buffer of
+ * every input in a std::priority_queue, popping and pushing once per pair.
+ */
+std::vector<std::pair<K, V>> heap_merge(const Buffers& sorted_buffers) {
+  auto later = [](const std::pair<K, std::size_t>& a,
+                  const std::pair<K, std::size_t>& b) {
+    return a.first == b.first ? a.second < b.second : a.first > b.first;
+  };
+  std::priority_queue<std::pair<K, std::size_t>,
+                      std::vector<std::pair<K, std::size_t>>, decltype(later)>
+      heap(later);
+
+  std::size_t total = 0;
+  for (std::size_t i = 0; i < sorted_buffers.size(); i++) {
+    total += sorted_buffers[i].size();
+    if (!sorted_buffers[i].empty()) {
+      heap.emplace(sorted_buffers[i].front().first, i);
+    }
+  }
+  std::vector<std::pair<K, V>> result{};
+  result.reserve(total);
+
+  std::vector<std::size_t> cursors(sorted_buffers.size(), 0);
+  while (!heap.empty()) {
+    std::size_t i = heap.top().second;
+    heap.pop();
+    const std::pair<K, V>& pair = sorted_buffers[i][cursors[i]];
+    if (result.empty() || result.back().first != pair.first) {
+      result.push_back(pair);
+    }
+    if (++cursors[i] < sorted_buffers[i].size()) {
+      heap.emplace(sorted_buffers[i][cursors[i]].first, i);
+    }
+  }
+  return result;
+}
+
+/**
+ * @brief Merge @param inputs sorted buffers of @param pairs pairs in total
+ * with @param merge, returning the average nanoseconds per input pair.
+ */
+double benchmark_merge(
+    std::size_t inputs, std::size_t pairs,
+    const std::function<std::vector<std::pair<K, V>>(const Buffers&)>& merge) {
+  std::mt19937_64 eng(inputs);
+  std::uniform_int_distribution<K> keys(0, pairs * 4);
+  Buffers buffers(inputs);
+  for (std::size_t i = 0; i < pairs; i++) {
+    buffers[i % inputs].emplace_back(keys(eng), i);
+  }
+  for (auto& buffer : buffers) {
+    std::sort(buffer.begin(), buffer.end());
+    buffer.erase(std::unique(buffer.begin(), buffer.end(),
+                             [](const std::pair<K, V>& a,
+                                const std::pair<K, V>& b) {
+                               return a.first == b.first;
+                             }),
+                 buffer.end());
+  }
+
+  auto t1 = std::chrono::high_resolution_clock::now();
+  std::vector<std::pair<K, V>> result = merge(buffers);
+  auto t2 = std::chrono::high_resolution_clock::now();
+  auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(t2 - t1);
+
+  // Keep the merge from being optimized away
+  std::cout << "  merged into " << result.size() << " pairs\n";
+  return static_cast<double>(ns.count()) / static_cast<double>(pairs);
+}
+
+/**
+ * @brief Fill @param tiers runs of a level with @param pairs pairs in total,
+ * overlapping on most keys, and time compacting them into a single run.
+ * Returns the throughput in MB of input per second.
+ */
+double benchmark_compaction(uint8_t tiers, std::size_t subcompactions,
+                            std::size_t pairs) {
+  std::string name = "merge_compaction_" + std::to_string(tiers) + "_" +
+                     std::to_string(subcompactions);
+  std::filesystem::remove_all("/tmp/" + name);
+  std::filesystem::create_directory("/tmp/" + name);
+  DbNaming naming{.dirpath = "/tmp/" + name, .name = name};
+
+  constexpr std::size_t kFileCapacity = kMegabyteSize / sizeof(std::pair<K, V>);
+  BufPool buf(BufPoolTuning{.initial_elements = 16, .max_elements = 1024});
+  SstableBTree serializer(buf);
+  Filter filter(naming, buf, 0);
+  Manifest manifest(naming, tiers, serializer, true);
+  FilterTuning filter_tuning{.bits_per_entry = kDefaultBitsPerEntry,
+                             .monkey = false,
+                             .resident = nullptr};
+  LSMLevel level(naming, tiers, 0, kTiering, kFileCapacity, manifest, buf,
+                 serializer, filter_tuning, subcompactions);
+  LSMLevel next(naming, tiers, 1, kTiering, kFileCapacity, manifest, buf,
+                serializer, filter_tuning, subcompactions);
+
+  std::mt19937_64 eng(tiers);
+  std::uniform_int_distribution<K> keys(0, pairs);
+  std::vector<std::shared_ptr<LSMRun>> runs;
+  for (uint8_t r = 0; r < tiers; r++) {
+    std::vector<std::pair<K, V>> run_pairs(pairs / tiers);
+    for (auto& pair : run_pairs) {
+      pair = {keys(eng), r};
+    }
+    std::sort(run_pairs.begin(), run_pairs.end());
+    run_pairs.erase(std::unique(run_pairs.begin(), run_pairs.end(),
+                                [](const std::pair<K, V>& a,
+                                   const std::pair<K, V>& b) {
+                                  return a.first == b.first;
+                                }),
+                    run_pairs.end());
+
+    auto run = std::make_shared<LSMRun>(naming, 0, r, tiers, kFileCapacity,
+                                        manifest, buf, serializer, filter);
+    for (std::size_t i = 0; i * kFileCapacity < run_pairs.size(); i++) {
+      std::vector<std::pair<K, V>> file(
+          run_pairs.begin() + i * kFileCapacity,
+          run_pairs.begin() +
+              std::min(run_pairs.size(), (i + 1) * kFileCapacity));
+      std::string filename = data_file(naming, 0, r, i);
+      serializer.Flush(filename, file, true);
+      std::string filter_name = filter_file(naming, 0, r, i);
+      filter.Create(filter_name, file);
+      run->RegisterNewFile(i, file.front().first, file.back().first);
+    }
+    runs.push_back(std::move(run));
+  }
+
+  // The last run fills the level, which overflows into the next level
+  for (uint8_t r = 0; r + 1 < tiers; r++) {
+    (void)level.RegisterNewRun(runs[r], next);
+  }
+  auto t1 = std::chrono::high_resolution_clock::now();
+  auto overflow = level.RegisterNewRun(runs.back(), next);
+  (void)next.MergeRuns(std::move(overflow), std::nullopt);
+  auto t2 = std::chrono::high_resolution_clock::now();
+  assert(next.Runs().size() == 1);
+
+  auto us = std::chrono::duration_cast<std::chrono::microseconds>(t2 - t1);
+  double megabytes = static_cast<double>(pairs * sizeof(std::pair<K, V>)) /
+                     static_cast<double>(kMegabyteSize);
+  return megabytes / (static_cast<double>(us.count()) / 1000000.0);
+}
+
+int main() {
+  std::size_t max_inputs = 64;
+  std::size_t pairs = 1 << 20;
+
+  std::vector<std::pair<
+      std::string, std::function<std::vector<std::pair<K, V>>(const Buffers&)>>>
+      merges = {{"heap", &heap_merge}, {"loser_tree", &minheap_merge}};
+
+  std::vector<std::string> results;
+  for (std::size_t inputs = 2; inputs <= max_inputs; inputs *= 2) {
+    for (const auto& [name, merge] : merges) {
+      std::cout << "Running experiment for " << inputs << " inputs with "
+                << name << '\n';
+      double ns_per_pair = benchmark_merge(inputs, pairs, merge);
+      results.push_back(std::to_string(inputs) + "," + name + "," +
+                        std::to_string(ns_per_pair));
+    }
+  }
+
+  write_to_csv("merge.csv", "inputs,merge,latency (ns/pair)", results);
+
+  std::vector<std::string> compaction_results;
+  for (uint8_t tiers = 2; tiers <= 16; tiers *= 2) {
+    for (std::size_t subcompactions = 1; subcompactions <= 4;
+         subcompactions *= 4) {
+      std::cout << "Running compaction experiment for " << +tiers
+                << " runs with " << subcompactions << " subcompactions\n";
+      double throughput =
+          benchmark_compaction(tiers, subcompactions, 8 * pairs);
+      compaction_results.push_back(std::to_string(tiers) + "," +
+                                   std::to_string(subcompactions) + "," +
+                                   std::to_string(throughput));
+    }
+  }
+
+  write_to_csv("compaction.csv", "runs,subcompactions,throughput (MB/s)",
+               compaction_results);
+}
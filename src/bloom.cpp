@@ -0,0 +1,111 @@
+#include "bloom.hpp"
+
+#include <array>
+#include <cassert>
+#include <cstdint>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+// Odd constants that spread a hash over the 32 bits of each word, as in the
+// split-block filters of Impala and Parquet
+constexpr std::array<uint32_t, kBucketWords> kSalts = {
+    0x47b6137bU, 0x44974d91U, 0x8824ad5bU, 0xa2b7289dU,
+    0x705495c7U, 0x2df1424bU, 0x9efc4947U, 0x5c6bfb31U,
+};
+
+// Picks the first of the words that get a bit, when not all of them do
+constexpr uint32_t kRotateSalt = 0x9e3779b1U;
+
+/**
+ * @brief A bit for each of the words that get a bit of the key. The words are
+ * consecutive, starting from one picked by the hash, so that every word is
+ * used evenly with fewer than 8 hashes.
+ */
+uint32_t lanes_of(uint32_t hash, uint32_t num_hashes) {
+  assert(num_hashes >= 1 && num_hashes <= kMaxBucketHashes);
+  uint32_t lanes = (1U << num_hashes) - 1;
+  uint32_t first = (hash * kRotateSalt) >> 29;
+  return ((lanes << first) | (lanes >> (kBucketWords - first))) & 0xffU;
+}
+
+uint32_t bit_of(uint32_t hash, std::size_t word) {
+  return 1U << ((hash * kSalts[word]) >> 27);
+}
+
+void bucket_insert(BloomBucket& bucket, uint32_t hash, uint32_t num_hashes) {
+  uint32_t lanes = lanes_of(hash, num_hashes);
+  for (std::size_t word = 0; word < kBucketWords; word++) {
+    if ((lanes >> word) & 1U) {
+      bucket.words[word] |= bit_of(hash, word);
+    }
+  }
+}
+
+bool bucket_check_scalar(const BloomBucket& bucket, uint32_t hash,
+                         uint32_t num_hashes) {
+  uint32_t lanes = lanes_of(hash, num_hashes);
+  for (std::size_t word = 0; word < kBucketWords; word++) {
+    uint32_t bit = bit_of(hash, word);
+    if (((lanes >> word) & 1U) && (bucket.words[word] & bit) != bit) {
+      return false;
+    }
+  }
+  return true;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+bool bucket_check_sse2(const BloomBucket& bucket, uint32_t hash,
+                       uint32_t num_hashes) {
+  // SSE2 has no 32-bit multiply or per-lane shift, so the mask is built
+  // one word at a time
+  uint32_t lanes = lanes_of(hash, num_hashes);
+  alignas(16) std::array<uint32_t, kBucketWords> mask{};
+  for (std::size_t word = 0; word < kBucketWords; word++) {
+    mask[word] = ((lanes >> word) & 1U) ? bit_of(hash, word) : 0;
+  }
+
+  const auto* words = reinterpret_cast<const __m128i*>(bucket.words.data());
+  const auto* masks = reinterpret_cast<const __m128i*>(mask.data());
+  __m128i missing =
+      _mm_or_si128(_mm_andnot_si128(_mm_loadu_si128(words), masks[0]),
+                   _mm_andnot_si128(_mm_loadu_si128(words + 1), masks[1]));
+  return _mm_movemask_epi8(_mm_cmpeq_epi32(missing, _mm_setzero_si128())) ==
+         0xffff;
+}
+
+__attribute__((target("avx2"))) bool bucket_check_avx2(
+    const BloomBucket& bucket, uint32_t hash, uint32_t num_hashes) {
+  const __m256i salts = _mm256_setr_epi32(
+      kSalts[0], kSalts[1], kSalts[2], kSalts[3], kSalts[4], kSalts[5],
+      kSalts[6], kSalts[7]);
+  const __m256i lane_bits = _mm256_setr_epi32(1, 2, 4, 8, 16, 32, 64, 128);
+
+  __m256i shifts =
+      _mm256_srli_epi32(_mm256_mullo_epi32(_mm256_set1_epi32(hash), salts), 27);
+  __m256i mask = _mm256_sllv_epi32(_mm256_set1_epi32(1), shifts);
+
+  // Clear the words that get no bit of the key
+  __m256i lanes = _mm256_and_si256(
+      _mm256_set1_epi32(lanes_of(hash, num_hashes)), lane_bits);
+  mask = _mm256_and_si256(mask, _mm256_cmpeq_epi32(lanes, lane_bits));
+
+  __m256i words = _mm256_loadu_si256(
+      reinterpret_cast<const __m256i*>(bucket.words.data()));
+  return _mm256_testc_si256(words, mask) != 0;
+}
+#endif
+
+BucketCheckFn bucket_check() {
+#if defined(__x86_64__) || defined(__i386__)
+  // Without the multiplies of AVX2, building the whole mask costs more than
+  // the scalar check, which stops at the first word missing a bit
+  static const BucketCheckFn fastest = __builtin_cpu_supports("avx2")
+                                           ? &bucket_check_avx2
+                                           : &bucket_check_scalar;
+  return fastest;
+#else
+  return &bucket_check_scalar;
+#endif
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * A bucket of a split-block bloom filter: 256 bits, as eight 32-bit words. A
+ * key sets a single bit in each of k of the words, all derived from one 32-bit
+ * hash of the key, so that testing a key is a single compare of the bucket
+ * against a mask of its bits, instead of k dependent bit tests.
+ */
+struct alignas(32) BloomBucket {
+  std::array<uint32_t, 8> words;
+};
+
+constexpr std::size_t kBucketWords = 8;
+constexpr uint32_t kMaxBucketHashes = kBucketWords;
+
+/**
+ * @brief Set the bits of the key with @param hash in the bucket.
+ *
+ * @param num_hashes How many of the words get a bit, from 1 to 8.
+ */
+void bucket_insert(BloomBucket& bucket, uint32_t hash, uint32_t num_hashes);
+
+/**
+ * @brief Whether all bits of the key with @param hash are set in the bucket,
+ * one word at a time.
+ */
+[[nodiscard]] bool bucket_check_scalar(const BloomBucket& bucket, uint32_t hash,
+                                       uint32_t num_hashes);
+
+#if defined(__x86_64__) || defined(__i386__)
+/**
+ * @brief bucket_check_scalar(), comparing the bucket with two 128-bit masks.
+ */
+[[nodiscard]] bool bucket_check_sse2(const BloomBucket& bucket, uint32_t hash,
+                                     uint32_t num_hashes);
+
+/**
+ * @brief bucket_check_scalar(), building the mask and comparing the bucket in
+ * 256-bit registers. Only call it if the CPU supports AVX2.
+ */
+[[nodiscard]] bool bucket_check_avx2(const BloomBucket& bucket, uint32_t hash,
+                                     uint32_t num_hashes);
+#endif
+
+using BucketCheckFn = bool (*)(const BloomBucket&, uint32_t, uint32_t);
+
+/**
+ * @brief The fastest bucket check the CPU supports: AVX2 where it is
+ * available, scalar otherwise. All of them give the same answers.
+ */
+[[nodiscard]] BucketCheckFn bucket_check();
@@ -1,6 +1,8 @@
 #include "buf.hpp"
 
+#include <algorithm>
 #include <array>
+#include <atomic>
 #include <cassert>
 #include <cmath>
 #include <cstdint>
@@ -8,13 +10,16 @@
 #include <iostream>
 #include <list>
 #include <memory>
+#include <mutex>
 #include <optional>
 #include <sstream>
 #include <string>
 #include <utility>
+#include <vector>
 
 #include "dbg.hpp"
 #include "evict.hpp"
+#include "file_cache.hpp"
 #include "xxhash.h"
 
 uint32_t Hash(const PageId& page_id) {
@@ -28,6 +33,12 @@ uint32_t Hash(const PageId& page_id) {
   return s.str();
 }
 
+struct BufferedPage {
+  PageId id;
+  std::shared_ptr<PageFrame> frame;
+  EvictorSlot slot;
+};
+
 struct TrieNode {
   // uint32_t hash;
   uint32_t prefix_length;
@@ -65,7 +76,11 @@ std::string trie_print(TrieNode& node, std::string&& prefix, uint32_t offset,
   return s.str();
 }
 
-class BufPool::BufPoolImpl {
+/**
+ * One shard of the buffer pool: an extendible hashing trie of pages, with its
+ * own evictor.
+ */
+class BufPoolShard {
  private:
   const uint32_t initial_elements;
   const uint32_t max_elements;
@@ -77,15 +92,46 @@ class BufPool::BufPoolImpl {
   uint32_t elements;
   std::unique_ptr<TrieNode> root;
 
+  mutable uint64_t hits;
+  mutable uint64_t misses;
+  uint64_t evictions;
+
+  // Frames of pages that left the pool while nobody had them pinned, ready to
+  // be handed out by NewFrame().
+  std::vector<std::shared_ptr<PageFrame>> free_frames;
+
+  // Guards the trie, the evictor and the free frames of the shard. Even
+  // lookups take it, as every hit updates the evictor.
+  mutable std::mutex mutex;
+
+  void recycle_frame(const std::shared_ptr<PageFrame>& frame) {
+    // A page can only be pinned through the pool, under the lock, so if the
+    // pool holds the last reference, it holds it for good.
+    if (frame.use_count() != 1 ||
+        this->free_frames.size() >= this->max_elements) {
+      return;
+    }
+
+    // Pair with the release of the last handle, so that its reads of the
+    // frame finish before the frame is written again.
+    std::atomic_thread_fence(std::memory_order_acquire);
+    this->free_frames.push_back(frame);
+  }
+
   /**
-   * @brief Returns true if replaced a node, false if added new node
+   * @brief Returns true if replaced a node, false if added new node. A page
+   * that replaces another keeps its evictor slot.
    */
-  static bool trie_put_in_bucket(TrieNode& node, BufferedPage page) {
+  bool trie_put_in_bucket(TrieNode& node, BufferedPage page) {
     assert(node.bucket.has_value());
     assert(!node.children.has_value());
     bool removed = false;
-    node.bucket.value().remove_if([&page, &removed](const BufferedPage& entry) {
+    node.bucket.value().remove_if([&](const BufferedPage& entry) {
       if (entry.id == page.id) {
+        if (entry.frame != page.frame) {
+          this->recycle_frame(entry.frame);
+        }
+        page.slot = entry.slot;
         removed = true;
         return true;
       } else {
@@ -96,14 +142,19 @@ class BufPool::BufPoolImpl {
     return removed;
   }
 
-  static bool trie_remove_from_bucket(TrieNode& node, const PageId& page_id) {
+  /**
+   * @brief Returns the evictor slot of the page if removed one
+   */
+  std::optional<EvictorSlot> trie_remove_from_bucket(TrieNode& node,
+                                                     const PageId& page_id) {
     assert(node.bucket.has_value());
     assert(!node.children.has_value());
 
-    bool removed = false;
+    std::optional<EvictorSlot> removed = std::nullopt;
     node.bucket.value().remove_if([&](const BufferedPage& entry) {
       if (entry.id == page_id) {
-        removed = true;
+        this->recycle_frame(entry.frame);
+        removed = entry.slot;
         return true;
       } else {
         return false;
@@ -131,17 +182,22 @@ class BufPool::BufPoolImpl {
 
   void trie_erase(const PageId& page_id) {
     TrieNode& bucket = this->trie_find_bucket(hash_func_(page_id), this->bits);
-    BufPoolImpl::trie_erase_from_bucket(bucket, page_id);
+    BufPoolShard::trie_erase_from_bucket(bucket, page_id);
     this->elements -= 1;
   }
 
-  static void trie_erase_from_bucket(TrieNode& node, const PageId& page_id) {
+  void trie_erase_from_bucket(TrieNode& node, const PageId& page_id) {
     assert(node.bucket.has_value());
     assert(!node.children.has_value());
 
     // I think this is O(n) :(
-    node.bucket.value().remove_if(
-        [page_id](BufferedPage& elem) { return elem.id == page_id; });
+    node.bucket.value().remove_if([&](BufferedPage& elem) {
+      if (elem.id == page_id) {
+        this->recycle_frame(elem.frame);
+        return true;
+      }
+      return false;
+    });
   }
 
   /**
@@ -169,9 +225,9 @@ class BufPool::BufPoolImpl {
     for (auto page : node.bucket.value()) {
       int last_bit = prefix_bit(hash_func_(page.id), node.prefix_length);
       if (last_bit == 0) {
-        BufPoolImpl::trie_put_in_bucket(*left, page);
+        BufPoolShard::trie_put_in_bucket(*left, page);
       } else {
-        BufPoolImpl::trie_put_in_bucket(*right, page);
+        BufPoolShard::trie_put_in_bucket(*right, page);
       }
     }
 
@@ -183,11 +239,11 @@ class BufPool::BufPoolImpl {
   void trie_scan_to_split(TrieNode& root) {
     TrieNode& curr = root;
     if (curr.children.has_value()) {
-      BufPoolImpl::trie_scan_to_split(*curr.children.value()[0]);
-      BufPoolImpl::trie_scan_to_split(*curr.children.value()[1]);
+      BufPoolShard::trie_scan_to_split(*curr.children.value()[0]);
+      BufPoolShard::trie_scan_to_split(*curr.children.value()[1]);
     } else {
       if (pow(2, this->bits - root.prefix_length) > this->bits) {
-        BufPoolImpl::trie_split(root);
+        BufPoolShard::trie_split(root);
       }
     }
   }
@@ -208,23 +264,18 @@ class BufPool::BufPoolImpl {
     this->trie_scan_to_split(*this->root);
   }
 
-  void consider_evicting(BufferedPage& entry) {
-    auto evicted = this->evictor->Insert(entry.id);
-    if (!evicted.has_value()) {
-      return;  // no need to evict
-    }
-
-    this->trie_erase(evicted.value());
-  }
 
  public:
-  BufPoolImpl(uint32_t initial_elements, uint32_t max_elements,
+  BufPoolShard(uint32_t initial_elements, uint32_t max_elements,
               std::unique_ptr<Evictor> evictor, PageHashFn hash)
       : initial_elements(initial_elements),
         max_elements(max_elements),
         evictor(std::move(evictor)),
         hash_func_(hash) {
     this->elements = 0;
+    this->hits = 0;
+    this->misses = 0;
+    this->evictions = 0;
     this->bits = fmax(ceil(log2l(initial_elements)), 1);
     this->capacity = fmax(pow(2, ceil(log2l(initial_elements))), 2);
     this->evictor->Resize(max_elements);
@@ -236,58 +287,102 @@ class BufPool::BufPoolImpl {
     });
   }
 
-  BufPoolImpl(uint32_t initial_elements, uint32_t max_elements)
-      : BufPoolImpl(initial_elements, max_elements,
-                    std::make_unique<ClockEvictor>(), &Hash) {}
-
-  ~BufPoolImpl() = default;
+  ~BufPoolShard() = default;
 
   [[nodiscard]] bool HasPage(const PageId& page) const {
-    const std::optional<BufferedPage> p = this->GetPage(page);
+    const std::optional<PageHandle> p = this->GetPage(page, kReuse);
     return p.has_value();
   }
 
-  [[nodiscard]] std::optional<BufferedPage> GetPage(
-      const PageId& page_id) const {
+  [[nodiscard]] std::optional<PageHandle> GetPage(const PageId& page_id,
+                                                  AccessHint hint) const {
+    std::lock_guard<std::mutex> lock(this->mutex);
     TrieNode& node = this->trie_find_bucket(hash_func_(page_id), this->bits);
 
     for (BufferedPage& page : node.bucket.value()) {
       if (page.id == page_id) {
-        this->evictor->MarkUsed(page.id);
-        return std::make_optional(page);
+        if (hint != kSequentialOnce) {
+          this->evictor->MarkUsed(page.slot);
+        }
+        this->hits++;
+        return std::make_optional<PageHandle>(page.frame);
       }
     }
 
+    this->misses++;
     return std::nullopt;
   }
 
-  void PutPage(const PageId& page_id, const std::any contents) {
+  [[nodiscard]] std::shared_ptr<PageFrame> NewFrame() {
+    {
+      std::lock_guard<std::mutex> lock(this->mutex);
+      if (!this->free_frames.empty()) {
+        std::shared_ptr<PageFrame> frame = std::move(this->free_frames.back());
+        this->free_frames.pop_back();
+        return frame;
+      }
+    }
+
+    return std::make_shared<PageFrame>();
+  }
+
+  PageHandle PutPage(const PageId& page_id, std::shared_ptr<PageFrame> frame) {
+    assert(frame != nullptr);
+    PageHandle handle(frame);
+
+    std::lock_guard<std::mutex> lock(this->mutex);
     uint32_t hash = hash_func_(page_id);
 
-    TrieNode& node = BufPoolImpl::trie_find_bucket(hash, this->bits);
+    TrieNode& node = BufPoolShard::trie_find_bucket(hash, this->bits);
     auto page = BufferedPage{
         .id = page_id,
-        .contents = contents,
+        .frame = std::move(frame),
+        .slot = 0,
     };
-    bool removed_one = BufPoolImpl::trie_put_in_bucket(node, page);
-    if (!removed_one) {
-      this->elements += 1;
-      this->consider_resizing();
-      this->consider_evicting(page);
+    bool removed_one = BufPoolShard::trie_put_in_bucket(node, page);
+    if (removed_one) {
+      return handle;
+    }
+
+    // The page is still at the front of its bucket, before any split
+    std::optional<DataRef> evicted =
+        this->evictor->Insert(page_id, node.bucket.value().front().slot);
+
+    this->elements += 1;
+    this->consider_resizing();
+
+    if (evicted.has_value()) {
+      this->trie_erase(evicted.value());
+      this->evictions++;
     }
+
+    return handle;
   }
 
   void RemovePage(const PageId& page_id) {
+    std::lock_guard<std::mutex> lock(this->mutex);
     uint32_t hash = hash_func_(page_id);
 
-    TrieNode& node = BufPoolImpl::trie_find_bucket(hash, this->bits);
-    bool removed = BufPoolImpl::trie_remove_from_bucket(node, page_id);
-    if (removed) {
-      this->evictor->MarkForRemoval(page_id);
+    TrieNode& node = BufPoolShard::trie_find_bucket(hash, this->bits);
+    std::optional<EvictorSlot> slot =
+        BufPoolShard::trie_remove_from_bucket(node, page_id);
+    if (slot.has_value()) {
+      this->elements -= 1;
+      this->evictor->MarkForRemoval(slot.value());
     }
   }
 
+  [[nodiscard]] BufPoolStats Stats() const {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    return BufPoolStats{
+        .hits = this->hits,
+        .misses = this->misses,
+        .evictions = this->evictions,
+    };
+  }
+
   [[nodiscard]] std::string DebugPrint(uint32_t bit_length) const {
+    std::lock_guard<std::mutex> lock(this->mutex);
     std::ostringstream s;
     s << "max: " << std::to_string(this->max_elements) << "\n";
     s << "elements: " << std::to_string(this->elements) << "\n";
@@ -300,36 +395,181 @@ class BufPool::BufPoolImpl {
   }
 };
 
+
+/**
+ * The pool is split into independent shards, each with its own trie, evictor
+ * and lock, so that threads looking up different pages rarely contend. A page
+ * always lives in the same shard, picked by a hash of its whole id.
+ */
+class BufPool::BufPoolImpl {
+ private:
+  std::vector<std::unique_ptr<BufPoolShard>> shards;
+  FileCache files;
+
+  static std::size_t open_files(const BufPoolTuning& tuning) {
+    return tuning.open_files == 0 ? kDefaultOpenFiles : tuning.open_files;
+  }
+
+  [[nodiscard]] BufPoolShard& shard_for(const PageId& page_id) const {
+    if (this->shards.size() == 1) {
+      return *this->shards.front();
+    }
+
+    uint32_t hash = XXH32(page_id.filename.data(), page_id.filename.size(),
+                          page_id.page);
+    return *this->shards.at(hash % this->shards.size());
+  }
+
+ public:
+  BufPoolImpl(BufPoolTuning tuning, std::unique_ptr<Evictor> evictor,
+              PageHashFn hash)
+      : files(open_files(tuning)) {
+    this->shards.push_back(std::make_unique<BufPoolShard>(
+        tuning.initial_elements, tuning.max_elements, std::move(evictor),
+        hash));
+  }
+
+  BufPoolImpl(BufPoolTuning tuning, const EvictorFactory& make_evictor,
+              PageHashFn hash)
+      : files(open_files(tuning)) {
+    std::size_t num_shards = std::max<std::size_t>(tuning.shards, 1);
+    num_shards = std::min<std::size_t>(
+        num_shards, std::max<std::size_t>(tuning.max_elements, 1));
+
+    // Round up, so that the shards hold at least the requested pages
+    std::size_t initial_elements =
+        (tuning.initial_elements + num_shards - 1) / num_shards;
+    std::size_t max_elements =
+        (tuning.max_elements + num_shards - 1) / num_shards;
+    for (std::size_t i = 0; i < num_shards; i++) {
+      this->shards.push_back(std::make_unique<BufPoolShard>(
+          initial_elements, max_elements, make_evictor(), hash));
+    }
+  }
+
+  ~BufPoolImpl() = default;
+
+  [[nodiscard]] bool HasPage(const PageId& page_id) const {
+    return this->shard_for(page_id).HasPage(page_id);
+  }
+
+  [[nodiscard]] std::optional<PageHandle> GetPage(const PageId& page_id,
+                                                  AccessHint hint) const {
+    return this->shard_for(page_id).GetPage(page_id, hint);
+  }
+
+  [[nodiscard]] std::shared_ptr<PageFrame> NewFrame(const PageId& page_id) {
+    return this->shard_for(page_id).NewFrame();
+  }
+
+  PageHandle PutPage(const PageId& page_id, std::shared_ptr<PageFrame> frame) {
+    return this->shard_for(page_id).PutPage(page_id, std::move(frame));
+  }
+
+  void RemovePage(const PageId& page_id) {
+    return this->shard_for(page_id).RemovePage(page_id);
+  }
+
+  [[nodiscard]] std::shared_ptr<PageFrame> ReadFrame(const PageId& page_id) {
+    std::shared_ptr<PageFrame> frame = this->NewFrame(page_id);
+    std::size_t got = this->files.Read(
+        page_id.filename, static_cast<uint64_t>(page_id.page) * kPageSize,
+        frame->bytes.data(), kPageSize);
+    std::fill(frame->bytes.begin() + got, frame->bytes.end(), std::byte{0});
+    return frame;
+  }
+
+  void CloseFile(const std::string& filename) {
+    return this->files.Close(filename);
+  }
+
+  [[nodiscard]] BufPoolStats Stats() const {
+    BufPoolStats stats{.hits = 0, .misses = 0, .evictions = 0};
+    for (const auto& shard : this->shards) {
+      BufPoolStats shard_stats = shard->Stats();
+      stats.hits += shard_stats.hits;
+      stats.misses += shard_stats.misses;
+      stats.evictions += shard_stats.evictions;
+    }
+    return stats;
+  }
+
+  [[nodiscard]] std::string DebugPrint(uint32_t bit_length) const {
+    if (this->shards.size() == 1) {
+      return this->shards.front()->DebugPrint(bit_length);
+    }
+
+    std::ostringstream s;
+    for (std::size_t i = 0; i < this->shards.size(); i++) {
+      s << "shard " << std::to_string(i) << ":\n";
+      s << this->shards.at(i)->DebugPrint(bit_length);
+    }
+    return s.str();
+  }
+};
+
 BufPool::BufPool(const BufPoolTuning tuning, std::unique_ptr<Evictor> evictor,
                  PageHashFn hash)
-    : impl(std::make_unique<BufPoolImpl>(tuning.initial_elements,
-                                         tuning.max_elements,
-                                         std::move(evictor), hash)) {}
+    : impl(std::make_unique<BufPoolImpl>(tuning, std::move(evictor), hash)) {}
+
+std::unique_ptr<Evictor> make_clock_evictor() {
+  return std::make_unique<ClockEvictor>();
+}
+
+BufPool::BufPool(const BufPoolTuning tuning, EvictorFactory make_evictor,
+                 PageHashFn hash)
+    : impl(std::make_unique<BufPoolImpl>(tuning, make_evictor, hash)) {}
 
 BufPool::BufPool(const BufPoolTuning tuning, PageHashFn hash)
-    : impl(std::make_unique<BufPoolImpl>(
-          tuning.initial_elements, tuning.max_elements,
-          std::make_unique<ClockEvictor>(), hash)) {}
+    : impl(std::make_unique<BufPoolImpl>(tuning, &make_clock_evictor, hash)) {}
 
 BufPool::BufPool(const BufPoolTuning tuning)
-    : impl(std::make_unique<BufPoolImpl>(
-          tuning.initial_elements, tuning.max_elements,
-          std::make_unique<ClockEvictor>(), &Hash)) {}
+    : impl(std::make_unique<BufPoolImpl>(tuning, &make_clock_evictor,
+                                         &Hash)) {}
 
 BufPool::~BufPool() = default;
 
 bool BufPool::HasPage(PageId& page) const { return this->impl->HasPage(page); }
 
-std::optional<BufferedPage> BufPool::GetPage(PageId& page) const {
-  return this->impl->GetPage(page);
+std::optional<PageHandle> BufPool::GetPage(PageId& page,
+                                           AccessHint hint) const {
+  return this->impl->GetPage(page, hint);
+}
+
+std::shared_ptr<PageFrame> BufPool::NewFrame(PageId& page) {
+  return this->impl->NewFrame(page);
+}
+
+PageHandle BufPool::PutPage(PageId& page, std::shared_ptr<PageFrame> frame,
+                            AccessHint hint) {
+  if (hint == kSequentialOnce) {
+    return PageHandle(std::move(frame));
+  }
+  return this->impl->PutPage(page, std::move(frame));
 }
 
-void BufPool::PutPage(PageId& page, const std::any contents) {
-  return this->impl->PutPage(page, contents);
+PageHandle BufPool::PutPage(PageId& page, const BytePage& contents) {
+  std::shared_ptr<PageFrame> frame = this->impl->NewFrame(page);
+  frame->bytes = contents;
+  return this->impl->PutPage(page, std::move(frame));
 }
 
 void BufPool::RemovePage(PageId& page) { return this->impl->RemovePage(page); }
 
+PageHandle BufPool::ReadPage(PageId& page, AccessHint hint) {
+  std::optional<PageHandle> cached = this->impl->GetPage(page, hint);
+  if (cached.has_value()) {
+    return cached.value();
+  }
+  return this->PutPage(page, this->impl->ReadFrame(page), hint);
+}
+
+void BufPool::CloseFile(const std::string& filename) {
+  return this->impl->CloseFile(filename);
+}
+
+BufPoolStats BufPool::Stats() const { return this->impl->Stats(); }
+
 std::string BufPool::DebugPrint(uint32_t bit_length) {
   return this->impl->DebugPrint(bit_length);
 }
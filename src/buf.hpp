@@ -1,6 +1,5 @@
 #pragma once
 
-#include <any>
 #include <array>
 #include <cstddef>
 #include <cstdint>
@@ -8,9 +7,11 @@
 #include <memory>
 #include <optional>
 #include <string>
+#include <utility>
 
 #include "constants.hpp"
 #include "evict.hpp"
+#include "file_cache.hpp"
 #include "xxhash.h"
 
 using pageno = uint64_t;
@@ -24,6 +25,19 @@ enum PageType {
 
 using BytePage = std::array<std::byte, kPageSize>;
 
+/**
+ * How a read expects to use a page again, so that bulk reads do not push the
+ * pages that point lookups keep coming back to out of the buffer pool.
+ */
+enum AccessHint {
+  // The page may be read again soon, and is worth caching.
+  kReuse = 0,
+  // The page is read once, as part of a sequential pass over a file like a
+  // scan or a compaction. A cached page is still used, but the access does not
+  // count towards keeping it, and a page that is not cached is not added.
+  kSequentialOnce = 1,
+};
+
 struct PageId {
   std::string filename;
   uint32_t page;
@@ -38,38 +52,145 @@ struct PageId {
   bool operator!=(const PageId& other) const { return !(*this == other); }
 };
 
-struct BufferedPage {
-  PageId id;
-  std::any contents;
-  bool operator==(BufferedPage& other) const { return this->id == other.id; }
+/**
+ * The memory a cached page lives in. Frames are aligned to the page size, so
+ * that a page can be read in place as an array of any integer type.
+ */
+struct alignas(kPageSize) PageFrame {
+  BytePage bytes;
+};
+
+/**
+ * A pinned page of the buffer pool, read in place without copying it. The
+ * frame is never reused while a handle to it is alive, even if the page is
+ * evicted or removed from the pool in the meantime. Copies are cheap, and pin
+ * the same frame.
+ */
+class PageHandle {
+ private:
+  std::shared_ptr<const PageFrame> frame;
+
+ public:
+  explicit PageHandle(std::shared_ptr<const PageFrame> frame)
+      : frame(std::move(frame)) {}
+
+  [[nodiscard]] const std::byte* data() const {
+    return this->frame->bytes.data();
+  }
+
+  [[nodiscard]] const BytePage& bytes() const { return this->frame->bytes; }
+
+  /**
+   * @brief The page as an array of T, e.g. As<uint64_t>()[2] for the third
+   * word of the page.
+   */
+  template <typename T>
+  [[nodiscard]] const T* As() const {
+    static_assert(alignof(T) <= kPageSize);
+    return reinterpret_cast<const T*>(this->frame->bytes.data());
+  }
 };
 
+constexpr std::size_t kDefaultOpenFiles = 64;
+
 struct BufPoolTuning {
   std::size_t initial_elements;
   std::size_t max_elements;
+
+  /**
+   * @brief The number of independent shards to split the pool into, each with
+   * its own lock. The elements are divided evenly between them. 0 is the same
+   * as 1. Defaults to 1, a single shard.
+   */
+  std::size_t shards{1};
+
+  /**
+   * @brief The most files to keep open for reading pages on a miss, closing
+   * the least recently used one past that. 0 is the same as
+   * kDefaultOpenFiles. Defaults to kDefaultOpenFiles.
+   */
+  std::size_t open_files{kDefaultOpenFiles};
+};
+
+/**
+ * Counters of the buffer pool, summed over its shards.
+ */
+struct BufPoolStats {
+  uint64_t hits;
+  uint64_t misses;
+  uint64_t evictions;
 };
 
 using PageHashFn = std::function<uint32_t(const PageId&)>;
 uint32_t Hash(const PageId& page_id);
 
+/**
+ * Creates the evictor of a single shard.
+ */
+using EvictorFactory = std::function<std::unique_ptr<Evictor>()>;
+
+/**
+ * A cache of file pages, shared by every reader of the database. All methods
+ * are safe to call from many threads at once.
+ */
 class BufPool {
  private:
   class BufPoolImpl;
   const std::unique_ptr<BufPoolImpl> impl;
 
  public:
+  /**
+   * @brief Construct a buffer pool with a custom evictor. An evictor tracks a
+   * single shard, so the pool is never sharded, whatever the tuning says.
+   */
   BufPool(BufPoolTuning tuning, std::unique_ptr<Evictor> evictor,
           PageHashFn hash);
+  BufPool(BufPoolTuning tuning, EvictorFactory make_evictor, PageHashFn hash);
   BufPool(BufPoolTuning tuning, PageHashFn Hash);
   BufPool(BufPoolTuning tuning);
   ~BufPool();
 
   [[nodiscard]] bool HasPage(PageId& page) const;
 
-  [[nodiscard]] std::optional<BufferedPage> GetPage(PageId& page) const;
-  void PutPage(PageId& page, std::any contents);
+  [[nodiscard]] std::optional<PageHandle> GetPage(
+      PageId& page, AccessHint hint = kReuse) const;
+
+  /**
+   * @brief A frame to read the page into before putting it. Frames of evicted
+   * pages that are no longer pinned are reused, so that a miss usually does
+   * not allocate.
+   */
+  [[nodiscard]] std::shared_ptr<PageFrame> NewFrame(PageId& page);
+
+  /**
+   * @brief Cache the frame as the contents of the page, replacing any previous
+   * contents. The frame must not be written to afterwards. With
+   * kSequentialOnce, the frame is not cached, only handed back.
+   */
+  PageHandle PutPage(PageId& page, std::shared_ptr<PageFrame> frame,
+                     AccessHint hint = kReuse);
+  PageHandle PutPage(PageId& page, const BytePage& contents);
   void RemovePage(PageId& page);
 
+  /**
+   * @brief Pin the page, reading it from its file into a frame of the pool if
+   * it is not cached. Files stay open between misses, so a miss costs a single
+   * read. The last page of a file may be cut short, and is padded with zeros.
+   */
+  PageHandle ReadPage(PageId& page, AccessHint hint = kReuse);
+
+  /**
+   * @brief Close the file if the pool has it open. Must be called before the
+   * file is deleted, as its name may be reused for a new file.
+   */
+  void CloseFile(const std::string& filename);
+
+  /**
+   * @brief The number of lookups that found their page, that did not, and the
+   * number of pages evicted to make space for others, since construction.
+   */
+  [[nodiscard]] BufPoolStats Stats() const;
+
   std::string DebugPrint(uint32_t);
   std::string DebugPrint();
 };
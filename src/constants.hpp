@@ -15,3 +15,20 @@ enum {
   BLOCK_NULL = -1,  // TODO: need to change?
   kTombstoneValue = 0x00db00dead00db00ull,
 };
+
+/**
+ * How the runs of each level are merged. Tiering lets a level gather `tiers`
+ * runs before merging them into one run of the next level, leveling keeps
+ * each level a single run, and lazy leveling, as in Dostoevsky, tiers every
+ * level but the last, which is leveled.
+ */
+enum CompactionPolicy { kTiering, kLeveling, kLazyLeveling };
+
+/**
+ * How a memtable keeps its pairs in order. The red-black tree takes one writer
+ * at a time, with readers locked out while it writes. The skiplist takes any
+ * number of concurrent writers, and readers never wait on them. The vector
+ * appends writes in the order they come, and sorts them once to flush them,
+ * which is the fastest to write but slow to read.
+ */
+enum MemTableFormat { kRedBlackTree, kSkipList, kVector };
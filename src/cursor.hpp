@@ -0,0 +1,39 @@
+#pragma once
+
+#include "constants.hpp"
+
+/**
+ * A cursor over (key, value) pairs in key order, such as the pairs of a data
+ * file or of a run. A new cursor is not positioned, and is positioned with
+ * `Seek()`.
+ */
+class Cursor {
+ public:
+  virtual ~Cursor() = default;
+
+  /**
+   * @brief Move to the first pair with a key of at least @param key, the
+   * cursor becoming invalid if there is none.
+   */
+  virtual void Seek(K key) = 0;
+
+  /**
+   * @brief Move to the next pair. The cursor must be valid.
+   */
+  virtual void Next() = 0;
+
+  /**
+   * @brief Whether the cursor is at a pair.
+   */
+  [[nodiscard]] virtual bool Valid() const = 0;
+
+  /**
+   * @brief The key of the pair the cursor is at. The cursor must be valid.
+   */
+  [[nodiscard]] virtual K Key() const = 0;
+
+  /**
+   * @brief The value of the pair the cursor is at. The cursor must be valid.
+   */
+  [[nodiscard]] virtual V Value() const = 0;
+};
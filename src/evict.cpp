@@ -1,9 +1,16 @@
 #include "evict.hpp"
 
+#include <algorithm>
 #include <cassert>
 #include <cstdint>
+#include <functional>
+#include <list>
 #include <memory>
 #include <optional>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <utility>
 #include <vector>
 
 #include "buf.hpp"
@@ -22,13 +29,13 @@ class ClockEvictor::ClockEvictorImpl : Evictor {
   ClockEvictorImpl() { this->head_ = 0; };
   ~ClockEvictorImpl() override = default;
 
-  std::optional<DataRef> Insert(DataRef page_id) override {
-    assert(this->head_ < this->clock_.capacity());
+  std::optional<DataRef> Insert(DataRef page_id, EvictorSlot& slot) override {
+    assert(this->head_ < this->clock_.size());
 
     while (this->clock_.at(this->head_).has_value() &&
            this->clock_.at(this->head_).value().dirty) {
       this->clock_.at(this->head_).value().dirty = false;
-      this->head_ = (this->head_ + 1) % this->clock_.capacity();
+      this->head_ = (this->head_ + 1) % this->clock_.size();
     }
 
     std::optional<ClockMetadata> old = this->clock_.at(this->head_);
@@ -38,7 +45,8 @@ class ClockEvictor::ClockEvictorImpl : Evictor {
             .page = page_id,
         });
 
-    this->head_ = (this->head_ + 1) % this->clock_.capacity();
+    slot = this->head_;
+    this->head_ = (this->head_ + 1) % this->clock_.size();
 
     if (old.has_value()) {
       return std::make_optional<DataRef>(old.value().page);
@@ -46,22 +54,15 @@ class ClockEvictor::ClockEvictorImpl : Evictor {
     return std::nullopt;
   }
 
-  void MarkUsed(DataRef page_id) override {
-    for (auto& elem : this->clock_) {
-      if (elem.has_value() && elem.value().page == page_id) {
-        elem.value().dirty = true;
-        return;
-      }
+  void MarkUsed(EvictorSlot slot) override {
+    std::optional<ClockMetadata>& elem = this->clock_.at(slot);
+    if (elem.has_value()) {
+      elem.value().dirty = true;
     }
   };
 
-  void MarkForRemoval(DataRef page_id) override {
-    for (auto& elem : this->clock_) {
-      if (elem.has_value() && elem.value().page == page_id) {
-        elem.value().dirty = false;
-        return;
-      }
-    }
+  void MarkForRemoval(EvictorSlot slot) override {
+    this->clock_.at(slot).reset();
   }
 
   void Resize(uint32_t n) override { this->clock_.resize(n); }
@@ -73,10 +74,425 @@ ClockEvictor::ClockEvictor() {
 ClockEvictor::~ClockEvictor() = default;
 
 void ClockEvictor::Resize(const uint32_t n) { return this->impl->Resize(n); }
-void ClockEvictor::MarkUsed(DataRef page) { return this->impl->MarkUsed(page); }
-void ClockEvictor::MarkForRemoval(DataRef page) {
-  return this->impl->MarkForRemoval(page);
+void ClockEvictor::MarkUsed(EvictorSlot slot) {
+  return this->impl->MarkUsed(slot);
+}
+void ClockEvictor::MarkForRemoval(EvictorSlot slot) {
+  return this->impl->MarkForRemoval(slot);
+};
+std::optional<DataRef> ClockEvictor::Insert(DataRef page, EvictorSlot& slot) {
+  return this->impl->Insert(page, slot);
+}
+
+constexpr EvictorSlot kNoSlot = UINT32_MAX;
+
+struct ListedSlot {
+  std::optional<PageId> page;
+  EvictorSlot prev;
+  EvictorSlot next;
+  // Which of the evictor's lists the slot is on, if it has a page
+  uint8_t list;
+};
+
+/**
+ * A doubly linked list threaded through the slots of an evictor, most recently
+ * pushed first. Moving a slot within or between lists is O(1).
+ */
+class SlotList {
+ private:
+  EvictorSlot head_ = kNoSlot;
+  EvictorSlot tail_ = kNoSlot;
+  std::size_t size_ = 0;
+
+ public:
+  void PushFront(std::vector<ListedSlot>& slots, EvictorSlot slot) {
+    ListedSlot& entry = slots.at(slot);
+    entry.prev = kNoSlot;
+    entry.next = this->head_;
+    if (this->head_ != kNoSlot) {
+      slots.at(this->head_).prev = slot;
+    } else {
+      this->tail_ = slot;
+    }
+    this->head_ = slot;
+    this->size_++;
+  }
+
+  void Unlink(std::vector<ListedSlot>& slots, EvictorSlot slot) {
+    ListedSlot& entry = slots.at(slot);
+    if (entry.prev != kNoSlot) {
+      slots.at(entry.prev).next = entry.next;
+    } else {
+      this->head_ = entry.next;
+    }
+    if (entry.next != kNoSlot) {
+      slots.at(entry.next).prev = entry.prev;
+    } else {
+      this->tail_ = entry.prev;
+    }
+    entry.prev = kNoSlot;
+    entry.next = kNoSlot;
+    this->size_--;
+  }
+
+  [[nodiscard]] EvictorSlot Back() const { return this->tail_; }
+  [[nodiscard]] std::size_t Size() const { return this->size_; }
+  [[nodiscard]] bool Empty() const { return this->size_ == 0; }
 };
-std::optional<DataRef> ClockEvictor::Insert(DataRef page) {
-  return this->impl->Insert(page);
+
+/**
+ * The slots of a list-based evictor, and the ones that are free.
+ */
+class SlotTable {
+ private:
+  std::vector<ListedSlot> slots_;
+  std::vector<EvictorSlot> free_;
+
+ public:
+  std::vector<ListedSlot>& Slots() { return this->slots_; }
+  ListedSlot& At(EvictorSlot slot) { return this->slots_.at(slot); }
+
+  [[nodiscard]] std::size_t Capacity() const { return this->slots_.size(); }
+
+  void Resize(uint32_t n) {
+    assert(n >= this->slots_.size());
+    // Hand out the lowest slots first
+    for (uint32_t slot = n; slot > this->slots_.size(); slot--) {
+      this->free_.push_back(slot - 1);
+    }
+    this->slots_.resize(n, ListedSlot{
+                               .page = std::nullopt,
+                               .prev = kNoSlot,
+                               .next = kNoSlot,
+                               .list = 0,
+                           });
+  }
+
+  [[nodiscard]] std::optional<EvictorSlot> TakeFree() {
+    if (this->free_.empty()) {
+      return std::nullopt;
+    }
+    EvictorSlot slot = this->free_.back();
+    this->free_.pop_back();
+    return slot;
+  }
+
+  /**
+   * @brief Empty the slot, returning the page it held.
+   */
+  PageId Release(EvictorSlot slot, bool free) {
+    ListedSlot& entry = this->slots_.at(slot);
+    assert(entry.page.has_value());
+    PageId page = std::move(entry.page.value());
+    entry.page.reset();
+    if (free) {
+      this->free_.push_back(slot);
+    }
+    return page;
+  }
+
+  [[nodiscard]] bool Holds(EvictorSlot slot) const {
+    return slot < this->slots_.size() && this->slots_.at(slot).page.has_value();
+  }
+};
+
+class LruEvictor::LruEvictorImpl : Evictor {
+ private:
+  SlotTable table_;
+  SlotList lru_;
+
+ public:
+  LruEvictorImpl() = default;
+  ~LruEvictorImpl() override = default;
+
+  std::optional<DataRef> Insert(DataRef page_id, EvictorSlot& slot) override {
+    assert(this->table_.Capacity() > 0);
+
+    std::optional<DataRef> evicted = std::nullopt;
+    std::optional<EvictorSlot> free = this->table_.TakeFree();
+    if (free.has_value()) {
+      slot = free.value();
+    } else {
+      slot = this->lru_.Back();
+      this->lru_.Unlink(this->table_.Slots(), slot);
+      evicted.emplace(this->table_.Release(slot, false));
+    }
+
+    this->table_.At(slot).page.emplace(page_id);
+    this->lru_.PushFront(this->table_.Slots(), slot);
+    return evicted;
+  }
+
+  void MarkUsed(EvictorSlot slot) override {
+    if (!this->table_.Holds(slot)) {
+      return;
+    }
+    this->lru_.Unlink(this->table_.Slots(), slot);
+    this->lru_.PushFront(this->table_.Slots(), slot);
+  }
+
+  void MarkForRemoval(EvictorSlot slot) override {
+    if (!this->table_.Holds(slot)) {
+      return;
+    }
+    this->lru_.Unlink(this->table_.Slots(), slot);
+    this->table_.Release(slot, true);
+  }
+
+  void Resize(uint32_t n) override { this->table_.Resize(n); }
+};
+
+LruEvictor::LruEvictor() : impl(std::make_unique<LruEvictorImpl>()) {}
+LruEvictor::~LruEvictor() = default;
+
+void LruEvictor::Resize(const uint32_t n) { return this->impl->Resize(n); }
+void LruEvictor::MarkUsed(EvictorSlot slot) {
+  return this->impl->MarkUsed(slot);
+}
+void LruEvictor::MarkForRemoval(EvictorSlot slot) {
+  return this->impl->MarkForRemoval(slot);
+}
+std::optional<DataRef> LruEvictor::Insert(DataRef page, EvictorSlot& slot) {
+  return this->impl->Insert(page, slot);
+}
+
+class LruKEvictor::LruKEvictorImpl : Evictor {
+ private:
+  enum Lists : uint8_t { kYoung = 0, kOld = 1 };
+
+  const uint32_t k_;
+  uint64_t now_;
+  SlotTable table_;
+
+  // Pages with fewer than K accesses, by their last access
+  SlotList young_;
+  // Pages with at least K accesses, by their K-th most recent access
+  std::set<std::pair<uint64_t, EvictorSlot>> old_;
+
+  // The last K access times of every slot, as a ring per slot
+  std::vector<uint64_t> history_;
+  std::vector<uint32_t> accesses_;
+
+  [[nodiscard]] uint64_t kth_access(EvictorSlot slot) const {
+    uint32_t accesses = this->accesses_.at(slot);
+    assert(accesses >= this->k_);
+    return this->history_.at((slot * this->k_) +
+                             ((accesses - this->k_) % this->k_));
+  }
+
+  void unlink(EvictorSlot slot) {
+    if (this->table_.At(slot).list == kYoung) {
+      this->young_.Unlink(this->table_.Slots(), slot);
+    } else {
+      this->old_.erase({this->kth_access(slot), slot});
+    }
+  }
+
+  void access(EvictorSlot slot) {
+    uint32_t& accesses = this->accesses_.at(slot);
+    this->history_.at((slot * this->k_) + (accesses % this->k_)) = this->now_++;
+    accesses++;
+
+    if (accesses < this->k_) {
+      this->table_.At(slot).list = kYoung;
+      this->young_.PushFront(this->table_.Slots(), slot);
+    } else {
+      this->table_.At(slot).list = kOld;
+      this->old_.emplace(this->kth_access(slot), slot);
+    }
+  }
+
+ public:
+  explicit LruKEvictorImpl(uint32_t k) : k_(k), now_(0) { assert(k > 0); }
+  ~LruKEvictorImpl() override = default;
+
+  std::optional<DataRef> Insert(DataRef page_id, EvictorSlot& slot) override {
+    assert(this->table_.Capacity() > 0);
+
+    std::optional<DataRef> evicted = std::nullopt;
+    std::optional<EvictorSlot> free = this->table_.TakeFree();
+    if (free.has_value()) {
+      slot = free.value();
+    } else {
+      slot = this->young_.Empty() ? this->old_.begin()->second
+                                  : this->young_.Back();
+      this->unlink(slot);
+      evicted.emplace(this->table_.Release(slot, false));
+    }
+
+    this->table_.At(slot).page.emplace(page_id);
+    this->accesses_.at(slot) = 0;
+    this->access(slot);
+    return evicted;
+  }
+
+  void MarkUsed(EvictorSlot slot) override {
+    if (!this->table_.Holds(slot)) {
+      return;
+    }
+    this->unlink(slot);
+    this->access(slot);
+  }
+
+  void MarkForRemoval(EvictorSlot slot) override {
+    if (!this->table_.Holds(slot)) {
+      return;
+    }
+    this->unlink(slot);
+    this->table_.Release(slot, true);
+  }
+
+  void Resize(uint32_t n) override {
+    this->table_.Resize(n);
+    this->history_.resize(static_cast<std::size_t>(n) * this->k_);
+    this->accesses_.resize(n);
+  }
+};
+
+LruKEvictor::LruKEvictor(uint32_t k)
+    : impl(std::make_unique<LruKEvictorImpl>(k)) {}
+LruKEvictor::~LruKEvictor() = default;
+
+void LruKEvictor::Resize(const uint32_t n) { return this->impl->Resize(n); }
+void LruKEvictor::MarkUsed(EvictorSlot slot) {
+  return this->impl->MarkUsed(slot);
+}
+void LruKEvictor::MarkForRemoval(EvictorSlot slot) {
+  return this->impl->MarkForRemoval(slot);
+}
+std::optional<DataRef> LruKEvictor::Insert(DataRef page, EvictorSlot& slot) {
+  return this->impl->Insert(page, slot);
+}
+
+struct PageIdHash {
+  std::size_t operator()(const PageId& page_id) const {
+    return std::hash<std::string>()(page_id.filename) ^
+           (std::hash<uint32_t>()(page_id.page) << 1);
+  }
+};
+
+class TwoQueueEvictor::TwoQueueEvictorImpl : Evictor {
+ private:
+  enum Lists : uint8_t { kIn = 0, kMain = 1 };
+
+  SlotTable table_;
+  // New pages, in the order they came in
+  SlotList in_;
+  // Pages that were asked for again after leaving `in_`, least recently used
+  // last
+  SlotList main_;
+
+  // The ids of the pages most recently evicted from `in_`, newest first. Their
+  // frames are gone, only their ids are remembered.
+  std::list<PageId> out_;
+  std::unordered_map<PageId, std::list<PageId>::iterator, PageIdHash>
+      out_index_;
+
+  // The paper suggests 25% of the pages for `in_`, and remembering 50% of the
+  // pages in `out_`.
+  [[nodiscard]] std::size_t max_in() const {
+    return std::max<std::size_t>(this->table_.Capacity() / 4, 1);
+  }
+
+  [[nodiscard]] std::size_t max_out() const {
+    return std::max<std::size_t>(this->table_.Capacity() / 2, 1);
+  }
+
+  void remember(const PageId& page_id) {
+    this->out_.push_front(page_id);
+    this->out_index_[page_id] = this->out_.begin();
+    if (this->out_.size() > this->max_out()) {
+      this->out_index_.erase(this->out_.back());
+      this->out_.pop_back();
+    }
+  }
+
+  bool forget(const PageId& page_id) {
+    auto it = this->out_index_.find(page_id);
+    if (it == this->out_index_.end()) {
+      return false;
+    }
+    this->out_.erase(it->second);
+    this->out_index_.erase(it);
+    return true;
+  }
+
+  SlotList& list_of(EvictorSlot slot) {
+    return this->table_.At(slot).list == kIn ? this->in_ : this->main_;
+  }
+
+ public:
+  TwoQueueEvictorImpl() = default;
+  ~TwoQueueEvictorImpl() override = default;
+
+  std::optional<DataRef> Insert(DataRef page_id, EvictorSlot& slot) override {
+    assert(this->table_.Capacity() > 0);
+
+    // Look for the page before evicting, which could make it forget it
+    bool seen_before = this->forget(page_id);
+
+    std::optional<DataRef> evicted = std::nullopt;
+    std::optional<EvictorSlot> free = this->table_.TakeFree();
+    if (free.has_value()) {
+      slot = free.value();
+    } else if (this->in_.Size() > this->max_in() || this->main_.Empty()) {
+      slot = this->in_.Back();
+      this->in_.Unlink(this->table_.Slots(), slot);
+      evicted.emplace(this->table_.Release(slot, false));
+      this->remember(evicted.value());
+    } else {
+      slot = this->main_.Back();
+      this->main_.Unlink(this->table_.Slots(), slot);
+      evicted.emplace(this->table_.Release(slot, false));
+    }
+
+    ListedSlot& entry = this->table_.At(slot);
+    entry.page.emplace(page_id);
+    if (seen_before) {
+      entry.list = kMain;
+      this->main_.PushFront(this->table_.Slots(), slot);
+    } else {
+      entry.list = kIn;
+      this->in_.PushFront(this->table_.Slots(), slot);
+    }
+    return evicted;
+  }
+
+  void MarkUsed(EvictorSlot slot) override {
+    // Accesses while in `in_` are taken to be part of the same burst, and do
+    // not count
+    if (!this->table_.Holds(slot) || this->table_.At(slot).list == kIn) {
+      return;
+    }
+    this->main_.Unlink(this->table_.Slots(), slot);
+    this->main_.PushFront(this->table_.Slots(), slot);
+  }
+
+  void MarkForRemoval(EvictorSlot slot) override {
+    if (!this->table_.Holds(slot)) {
+      return;
+    }
+    this->list_of(slot).Unlink(this->table_.Slots(), slot);
+    this->table_.Release(slot, true);
+  }
+
+  void Resize(uint32_t n) override { this->table_.Resize(n); }
+};
+
+TwoQueueEvictor::TwoQueueEvictor()
+    : impl(std::make_unique<TwoQueueEvictorImpl>()) {}
+TwoQueueEvictor::~TwoQueueEvictor() = default;
+
+void TwoQueueEvictor::Resize(const uint32_t n) {
+  return this->impl->Resize(n);
+}
+void TwoQueueEvictor::MarkUsed(EvictorSlot slot) {
+  return this->impl->MarkUsed(slot);
+}
+void TwoQueueEvictor::MarkForRemoval(EvictorSlot slot) {
+  return this->impl->MarkForRemoval(slot);
+}
+std::optional<DataRef> TwoQueueEvictor::Insert(DataRef page,
+                                               EvictorSlot& slot) {
+  return this->impl->Insert(page, slot);
 }
@@ -7,6 +7,12 @@
 struct PageId;
 using DataRef = const PageId;
 
+/**
+ * Where an evictor tracks a page. The owner of the page keeps it alongside the
+ * page, so that accesses are recorded without searching for the page.
+ */
+using EvictorSlot = uint32_t;
+
 class Evictor {
  public:
   virtual ~Evictor() = default;
@@ -22,11 +28,13 @@ class Evictor {
    * evicting a the page if there is one.
    *
    * @param page The page to put into the eviction algorithm.
+   * @param slot Set to the slot the page is tracked in, until it is evicted or
+   * removed.
    *
-   * @return std::optional<std::shared_ptr<BufferedPage>> The page evicted if
-   * present, std::nullopt if not.
+   * @return std::optional<DataRef> The page evicted if present, std::nullopt
+   * if not.
    */
-  virtual std::optional<DataRef> Insert(DataRef page) = 0;
+  virtual std::optional<DataRef> Insert(DataRef page, EvictorSlot& slot) = 0;
 
   /**
    * @brief Mark a page as dirty/used if it gets accessed.
@@ -35,20 +43,21 @@ class Evictor {
    * would place the node at the front of the queue when marked. For Clock
    * eviction, it would just mark that node dirty.
    *
-   * Does nothing if the page does not exist.
+   * Does nothing if the slot is empty.
    *
-   * @param page The page that was accessed.
+   * @param slot The slot of the page that was accessed.
    */
-  virtual void MarkUsed(DataRef page) = 0;
+  virtual void MarkUsed(EvictorSlot slot) = 0;
 
   /**
-   * @brief Mark a page for removal, e.g. mark as clean.
+   * @brief Forget a page that was removed from the cache, freeing its slot for
+   * the next insert. The page will not be evicted.
    *
-   * Does nothing if the page does not exist.
+   * Does nothing if the slot is empty.
    *
-   * @param page The page that was accessed.
+   * @param slot The slot of the page that was removed.
    */
-  virtual void MarkForRemoval(DataRef page) = 0;
+  virtual void MarkForRemoval(EvictorSlot slot) = 0;
 
   /**
    * @brief Resize the eviction data to now have @param n elements
@@ -65,8 +74,68 @@ class ClockEvictor : public Evictor {
   ClockEvictor();
   ~ClockEvictor() override;
 
-  std::optional<DataRef> Insert(DataRef page) override;
-  void MarkUsed(DataRef page) override;
-  void MarkForRemoval(DataRef page) override;
+  std::optional<DataRef> Insert(DataRef page, EvictorSlot& slot) override;
+  void MarkUsed(EvictorSlot slot) override;
+  void MarkForRemoval(EvictorSlot slot) override;
+  void Resize(uint32_t n) override;
+};
+
+/**
+ * Evicts the least recently used page.
+ */
+class LruEvictor : public Evictor {
+ private:
+  class LruEvictorImpl;
+  std::unique_ptr<LruEvictorImpl> impl;
+
+ public:
+  LruEvictor();
+  ~LruEvictor() override;
+
+  std::optional<DataRef> Insert(DataRef page, EvictorSlot& slot) override;
+  void MarkUsed(EvictorSlot slot) override;
+  void MarkForRemoval(EvictorSlot slot) override;
+  void Resize(uint32_t n) override;
+};
+
+/**
+ * Evicts the page whose K-th most recent access is the oldest. Pages accessed
+ * fewer than K times are evicted first, least recently used first, so that a
+ * long scan touching every page once does not push out pages that are used
+ * over and over.
+ */
+class LruKEvictor : public Evictor {
+ private:
+  class LruKEvictorImpl;
+  std::unique_ptr<LruKEvictorImpl> impl;
+
+ public:
+  explicit LruKEvictor(uint32_t k = 2);
+  ~LruKEvictor() override;
+
+  std::optional<DataRef> Insert(DataRef page, EvictorSlot& slot) override;
+  void MarkUsed(EvictorSlot slot) override;
+  void MarkForRemoval(EvictorSlot slot) override;
+  void Resize(uint32_t n) override;
+};
+
+/**
+ * The 2Q algorithm. New pages enter a small FIFO queue, and only pages that are
+ * asked for again after falling out of it are admitted into the main LRU queue.
+ * Pages that are only ever used once, like the pages of a scan, pass through
+ * the FIFO queue without evicting anything from the main queue.
+ */
+class TwoQueueEvictor : public Evictor {
+ private:
+  class TwoQueueEvictorImpl;
+  std::unique_ptr<TwoQueueEvictorImpl> impl;
+
+ public:
+  TwoQueueEvictor();
+  ~TwoQueueEvictor() override;
+
+  std::optional<DataRef> Insert(DataRef page, EvictorSlot& slot) override;
+  void MarkUsed(EvictorSlot slot) override;
+  void MarkForRemoval(EvictorSlot slot) override;
   void Resize(uint32_t n) override;
 };
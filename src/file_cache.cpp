@@ -0,0 +1,126 @@
+#include "file_cache.hpp"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cassert>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+
+/**
+ * An open file. The descriptor is closed when the last reader lets go of it,
+ * so that a reader never sees its descriptor reused for another file.
+ */
+struct OpenFile {
+  int fd;
+
+  explicit OpenFile(int fd) : fd(fd) {}
+  OpenFile(const OpenFile&) = delete;
+  OpenFile& operator=(const OpenFile&) = delete;
+  ~OpenFile() { ::close(this->fd); }
+};
+
+class FileCache::FileCacheImpl {
+ private:
+  struct Entry {
+    std::shared_ptr<OpenFile> file;
+    std::list<std::string>::iterator lru_position;
+  };
+
+  const std::size_t max_open_files;
+
+  // Guards the files and their order. Held while opening a file, but not
+  // while reading one.
+  mutable std::mutex mutex;
+  std::unordered_map<std::string, Entry> files;
+  // Most recently used first
+  std::list<std::string> lru;
+
+  std::shared_ptr<OpenFile> acquire(const std::string& filename) {
+    std::lock_guard<std::mutex> lock(this->mutex);
+
+    auto it = this->files.find(filename);
+    if (it != this->files.end()) {
+      this->lru.splice(this->lru.begin(), this->lru, it->second.lru_position);
+      return it->second.file;
+    }
+
+    int fd = ::open(filename.c_str(), O_RDONLY);
+    assert(fd >= 0);
+    auto file = std::make_shared<OpenFile>(fd);
+
+    if (this->files.size() >= this->max_open_files) {
+      this->files.erase(this->lru.back());
+      this->lru.pop_back();
+    }
+    this->lru.push_front(filename);
+    this->files.emplace(filename, Entry{
+                                      .file = file,
+                                      .lru_position = this->lru.begin(),
+                                  });
+    return file;
+  }
+
+ public:
+  explicit FileCacheImpl(std::size_t max_open_files)
+      : max_open_files(std::max<std::size_t>(max_open_files, 1)) {}
+  ~FileCacheImpl() = default;
+
+  std::size_t Read(const std::string& filename, uint64_t offset,
+                   std::byte* dest, std::size_t size) {
+    std::shared_ptr<OpenFile> file = this->acquire(filename);
+
+    std::size_t total = 0;
+    while (total < size) {
+      ssize_t got = ::pread(file->fd, dest + total, size - total,
+                            static_cast<off_t>(offset + total));
+      if (got < 0 && errno == EINTR) {
+        continue;
+      }
+      assert(got >= 0);
+      if (got == 0) {
+        break;  // end of file
+      }
+      total += got;
+    }
+    return total;
+  }
+
+  void Close(const std::string& filename) {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    auto it = this->files.find(filename);
+    if (it == this->files.end()) {
+      return;
+    }
+    this->lru.erase(it->second.lru_position);
+    this->files.erase(it);
+  }
+
+  [[nodiscard]] std::size_t OpenFiles() const {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    return this->files.size();
+  }
+};
+
+FileCache::FileCache(std::size_t max_open_files)
+    : impl(std::make_unique<FileCacheImpl>(max_open_files)) {}
+FileCache::~FileCache() = default;
+
+std::size_t FileCache::Read(const std::string& filename, uint64_t offset,
+                            std::byte* dest, std::size_t size) {
+  return this->impl->Read(filename, offset, dest, size);
+}
+
+void FileCache::Close(const std::string& filename) {
+  return this->impl->Close(filename);
+}
+
+std::size_t FileCache::OpenFiles() const { return this->impl->OpenFiles(); }
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+/**
+ * Keeps a bounded number of files open for reading, closing the least recently
+ * used one to make space. Reads go straight to the file descriptor with
+ * pread(), so reading a page of a file that is already open costs exactly one
+ * system call. All methods are safe to call from many threads at once.
+ */
+class FileCache {
+ private:
+  class FileCacheImpl;
+  const std::unique_ptr<FileCacheImpl> impl;
+
+ public:
+  /**
+   * @param max_open_files The most files to keep open at once. A file being
+   * read from stays open until the read is done, even if it is closed in the
+   * meantime.
+   */
+  explicit FileCache(std::size_t max_open_files);
+  ~FileCache();
+
+  /**
+   * @brief Read up to @param size bytes at @param offset of @param filename
+   * into @param dest, opening the file if it is not open yet.
+   *
+   * @return std::size_t The number of bytes read, fewer than `size` only at
+   * the end of the file.
+   */
+  std::size_t Read(const std::string& filename, uint64_t offset,
+                   std::byte* dest, std::size_t size);
+
+  /**
+   * @brief Close the file if it is open. Must be called before a file is
+   * deleted, as the name may be reused by a new file that an open descriptor
+   * would not see.
+   */
+  void Close(const std::string& filename);
+
+  /**
+   * @brief The number of files currently open.
+   */
+  [[nodiscard]] std::size_t OpenFiles() const;
+};
@@ -31,6 +31,10 @@ bool has_magic_numbers(std::array<uint64_t, kPageSize / sizeof(uint64_t)>& page,
   return has_page_magic && has_type_magic;
 }
 
+bool has_magic_numbers(const uint64_t* page, FileType type) {
+  return page[0] == file_magic() && page[1] == type_magic(type);
+}
+
 void put_contents(uint64_t page[kPageSize / sizeof(uint64_t)],
                   std::size_t start, std::vector<uint64_t> contents) {
   for (std::size_t i = 0; i < contents.size(); i++) {
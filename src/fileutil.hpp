@@ -10,6 +10,7 @@ enum FileType {
   kManifest = 0,
   kData = 1,
   kFilter = 2,
+  kWal = 3,
 };
 
 uint64_t file_magic();
@@ -17,6 +18,7 @@ uint64_t file_magic();
 bool has_magic_numbers(std::array<uint64_t, kPageSize / sizeof(uint64_t)>& page,
                        FileType type);
 bool has_magic_numbers(std::vector<uint64_t>& page, FileType type);
+bool has_magic_numbers(const uint64_t* page, FileType type);
 
 void put_magic_numbers(std::array<uint64_t, kPageSize / sizeof(uint64_t)>& page,
                        FileType type);
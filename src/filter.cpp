@@ -1,6 +1,6 @@
 #include "filter.hpp"
 
-#include <any>
+#include <algorithm>
 #include <array>
 #include <cassert>
 #include <cmath>
@@ -9,35 +9,144 @@
 #include <cstdlib>
 #include <cstring>
 #include <fstream>
-#include <functional>
 #include <iostream>
+#include <memory>
+#include <mutex>
 #include <optional>
+#include <shared_mutex>
 #include <string>
+#include <unordered_map>
 
+#include "bloom.hpp"
 #include "buf.hpp"
 #include "constants.hpp"
 #include "fileutil.hpp"
 #include "naming.hpp"
 #include "xxhash.h"
 
-using KeyHashFn = std::function<uint32_t(K)>;
-
 constexpr static std::size_t kCacheLineBytes = 128;
 constexpr static std::size_t kFilterBytes = 128;
 static_assert(kCacheLineBytes >= kFilterBytes);
 constexpr static std::size_t kFilterBits = kFilterBytes * 8;
 
-constexpr static std::size_t kBitsPerEntry = 5;
-constexpr static std::size_t kEntriesPerFilter = (kFilterBits / kBitsPerEntry);
 constexpr static std::size_t kFiltersPerPage = kPageSize / kFilterBytes;
-constexpr static std::size_t kNumHashFuncs = 3;  // log(2) * kBitsPerEntry;
+constexpr static std::size_t kBucketsPerFilter =
+    kFilterBytes / sizeof(BloomBucket);
+
+// Each hash sets a bit in a different word of a bucket
+constexpr static std::size_t kMaxHashFuncs = kMaxBucketHashes;
+constexpr static double kMinBitsPerEntry = 1;
+constexpr static double kMaxBitsPerEntry = 24;
+
+// Files written before the sizing was saved into the file used 5 bits per
+// entry and 3 hash functions
+constexpr static std::size_t kLegacyEntriesPerFilter = kFilterBits / 5;
+constexpr static std::size_t kLegacyNumHashFuncs = 3;
 
 using BloomFilter = std::array<uint8_t, kFilterBytes>;
 
 enum FilterFileLocations {
   kNumEntries = 2,
+  kEntriesPerFilter = 3,
+  kNumHashFuncs = 4,
+  kLayout = 5,
+};
+
+/**
+ * How the keys are spread within a filter.
+ */
+enum FilterLayout {
+  // Every hash picks any bit of the 1024 bits of a filter, with its own XXH64
+  // of the key. Only read, for files written before split blocks.
+  kBitLayout = 0,
+  // A single XXH64 of the key picks a 256-bit bucket, and sets a bit in each
+  // of `num_hashes` of its words, see bloom.hpp.
+  kSplitBlockLayout = 1,
+};
+/**
+ * The sizing of a filter file, which never changes once it is created.
+ */
+struct FilterShape {
+  uint64_t num_entries;
+  uint64_t entries_per_filter;
+  uint64_t num_hashes;
+  uint64_t layout;
+
+  static FilterShape Sized(uint64_t num_entries, double bits_per_entry) {
+    bits_per_entry =
+        std::clamp(bits_per_entry, kMinBitsPerEntry, kMaxBitsPerEntry);
+    return FilterShape{
+        .num_entries = num_entries,
+        .entries_per_filter =
+            static_cast<uint64_t>(floor(kFilterBits / bits_per_entry)),
+        .num_hashes = std::clamp<uint64_t>(
+            llround(bits_per_entry * log(2)), 1, kMaxHashFuncs),
+        .layout = kSplitBlockLayout,
+    };
+  }
+
+  static FilterShape Read(const uint64_t* metadata_page) {
+    FilterShape shape{
+        .num_entries = metadata_page[kNumEntries],
+        .entries_per_filter = metadata_page[kEntriesPerFilter],
+        .num_hashes = metadata_page[kNumHashFuncs],
+        .layout = metadata_page[kLayout],
+    };
+    if (shape.entries_per_filter == 0) {
+      shape.entries_per_filter = kLegacyEntriesPerFilter;
+      shape.num_hashes = kLegacyNumHashFuncs;
+    }
+    return shape;
+  }
+
+  [[nodiscard]] uint64_t NumFilters() const {
+    if (this->num_entries == 0) {
+      return 0;
+    }
+    return ceil(static_cast<double>(this->num_entries) /
+                this->entries_per_filter);
+  }
+
+  [[nodiscard]] uint64_t NumPages() const {
+    return ceil(static_cast<double>(this->NumFilters()) / kFiltersPerPage);
+  }
 };
 
+double monkey_bits_per_entry(uint32_t level, uint32_t levels,
+                             uint8_t size_ratio, double bits_per_entry) {
+  assert(level < levels);
+  if (size_ratio < 2) {
+    return bits_per_entry;
+  }
+
+  // Monkey sets the false positive rate of each level in proportion to its
+  // size, the optimum for a fixed total memory. Each level then has
+  // ln(T) / ln(2)^2 more bits per entry than the level below it, T times its
+  // size. The deepest level gets what keeps the average at `bits_per_entry`.
+  const double step = log(size_ratio) / (log(2) * log(2));
+  double entries = 0;
+  double extra_bits = 0;
+  double level_entries = 1;
+  for (uint32_t l = 0; l < levels; l++) {
+    entries += level_entries;
+    extra_bits += level_entries * (levels - 1 - l) * step;
+    level_entries *= size_ratio;
+  }
+
+  double deepest = bits_per_entry - (extra_bits / entries);
+  return deepest + (levels - 1 - level) * step;
+}
+
+double FilterTuning::BitsPerEntry(uint32_t level, uint32_t levels,
+                                  uint8_t size_ratio) const {
+  if (!this->monkey) {
+    return this->bits_per_entry;
+  }
+  // The tree is at least deep enough to hold the level
+  levels = std::max(levels, level + 1);
+  return monkey_bits_per_entry(level, levels, size_ratio, this->bits_per_entry);
+}
+
 uint64_t calc_page_idx(uint64_t global_filter_idx) {
   uint64_t page_idx = global_filter_idx / kFiltersPerPage;
   return page_idx + 1;  // First page is always metadata page
@@ -47,109 +156,241 @@ uint64_t calc_page_offset(uint64_t global_filter_idx) {
   return global_filter_idx % kFiltersPerPage;
 };
 
-class Filter::FilterImpl {
+class ResidentFilters::ResidentFiltersImpl {
  private:
-  const DbNaming& dbname;
-  const uint64_t seed;
-  const std::array<KeyHashFn, kNumHashFuncs> bit_hashes;
-  BufPool& buf;
+  const std::size_t budget_bytes;
+  std::size_t bytes{0};
+  std::unordered_map<std::string, std::shared_ptr<const ResidentFilter>>
+      filters;
 
-  [[nodiscard]] bool bloom_has(const BloomFilter& filter, const K key) const {
-    bool val = true;
-    for (const auto& fn : this->bit_hashes) {
-      val = bloom_test(filter, fn(key) % kFilterBits);
+  // Guards the filters and the bytes they hold. Lookups hold it shared.
+  mutable std::shared_mutex mutex;
 
-      // If the bloom filter returns a 0 for any of the values, this is the
-      // DEFINITE_NO answer
-      if (!val) {
-        return false;
-      }
+  static std::size_t size_of(const ResidentFilter& filter) {
+    return filter.pages.size() * sizeof(PageFrame);
+  }
+
+ public:
+  explicit ResidentFiltersImpl(std::size_t budget_bytes)
+      : budget_bytes(budget_bytes) {}
+  ~ResidentFiltersImpl() = default;
+
+  [[nodiscard]] bool Fits(std::size_t bytes) const {
+    std::shared_lock<std::shared_mutex> lock(this->mutex);
+    return this->bytes + bytes <= this->budget_bytes;
+  }
+
+  bool Admit(const std::string& filename,
+             std::shared_ptr<const ResidentFilter> filter) {
+    assert(filter != nullptr);
+    std::size_t bytes = size_of(*filter);
+
+    std::unique_lock<std::shared_mutex> lock(this->mutex);
+    auto it = this->filters.find(filename);
+    std::size_t replaced = it == this->filters.end() ? 0 : size_of(*it->second);
+    if (this->bytes - replaced + bytes > this->budget_bytes) {
+      return false;
     }
 
-    // If all bits are set, this is the MAYBE_YES answer
+    this->bytes = this->bytes - replaced + bytes;
+    this->filters.insert_or_assign(filename, std::move(filter));
     return true;
   }
 
-  [[nodiscard]] bool static bloom_test(const BloomFilter& filter,
-                                       uint32_t bit_offset) {
-    constexpr int kBitsInByte = 8;
-    uint32_t byte = bit_offset / kBitsInByte;
-    uint32_t bit = bit_offset % kBitsInByte;
-    uint32_t bit_val = (filter.at(byte) >> bit) & 1;
-    assert(bit_val == 1 || bit_val == 0);
-    return bit_val == 1;
-  };
-
-  void static bloom_set(BloomFilter& filter, uint32_t bit_offset) {
-    constexpr int kBitsInByte = 8;
-    uint32_t byte = bit_offset / kBitsInByte;
-    uint32_t bit = bit_offset % kBitsInByte;
-
-    filter.at(byte) = filter.at(byte) | (1 << bit);
-  };
-
-  [[nodiscard]] std::array<KeyHashFn, kNumHashFuncs> static create_hash_funcs(
-      uint64_t starting_seed) {
-    std::array<KeyHashFn, kNumHashFuncs> fns;
-    for (std::size_t i = 0; i < kNumHashFuncs; i++) {
-      fns.at(i) = [starting_seed, i](K key) {
-        return static_cast<uint64_t>(
-            XXH64(&key, kKeySize, (i + 1) + starting_seed + 1));
-      };
+  [[nodiscard]] std::shared_ptr<const ResidentFilter> Get(
+      const std::string& filename) const {
+    std::shared_lock<std::shared_mutex> lock(this->mutex);
+    auto it = this->filters.find(filename);
+    if (it == this->filters.end()) {
+      return nullptr;
+    }
+    return it->second;
+  }
+
+  void Remove(const std::string& filename) {
+    std::unique_lock<std::shared_mutex> lock(this->mutex);
+    auto it = this->filters.find(filename);
+    if (it == this->filters.end()) {
+      return;
     }
-    return fns;
+    this->bytes -= size_of(*it->second);
+    this->filters.erase(it);
   }
 
-  [[nodiscard]] uint64_t static block_hash(K key, uint64_t starting_seed) {
-    return static_cast<uint64_t>(XXH64(&key, kKeySize, starting_seed));
+  [[nodiscard]] ResidentFilterStats Stats() const {
+    std::shared_lock<std::shared_mutex> lock(this->mutex);
+    return ResidentFilterStats{
+        .bytes = this->bytes,
+        .budget_bytes = this->budget_bytes,
+        .files = this->filters.size(),
+    };
   }
+};
+
+ResidentFilters::ResidentFilters(std::size_t budget_bytes)
+    : impl(std::make_unique<ResidentFiltersImpl>(budget_bytes)) {}
+ResidentFilters::~ResidentFilters() = default;
+bool ResidentFilters::Fits(std::size_t bytes) const {
+  return this->impl->Fits(bytes);
+}
+bool ResidentFilters::Admit(const std::string& filename,
+                            std::shared_ptr<const ResidentFilter> filter) {
+  return this->impl->Admit(filename, std::move(filter));
+}
+std::shared_ptr<const ResidentFilter> ResidentFilters::Get(
+    const std::string& filename) const {
+  return this->impl->Get(filename);
+}
+void ResidentFilters::Remove(const std::string& filename) {
+  return this->impl->Remove(filename);
+}
+ResidentFilterStats ResidentFilters::Stats() const {
+  return this->impl->Stats();
+}
 
-  BytePage static to_buf(std::array<BloomFilter, kFiltersPerPage>& filters) {
-    BytePage buffer{};
-    for (std::size_t filt = 0; filt < filters.size(); filt++) {
-      std::array<uint8_t, kFilterBytes> data_vec = filters.at(filt);
-      for (std::size_t data_offset = 0; data_offset < data_vec.size();
-           data_offset++) {
-        std::byte data = std::byte{data_vec.at(data_offset)};
-        buffer.at(filt * kFilterBytes + data_offset) = data;
+class Filter::FilterImpl {
+ private:
+  const DbNaming& dbname;
+  const uint64_t seed;
+  // The fastest way to check a bucket on this CPU
+  const BucketCheckFn check;
+  BufPool& buf;
+  ResidentFilters* const resident;
+
+  // The sizing of each filter file, so that a lookup only reads the page of
+  // its block. Filled in on creation, or on the first lookup of a file created
+  // before the database was opened.
+  std::unordered_map<std::string, FilterShape> shapes;
+  mutable std::shared_mutex shapes_mutex;
+
+  [[nodiscard]] FilterShape shape_of(const std::string& filename) {
+    {
+      std::shared_lock<std::shared_mutex> lock(this->shapes_mutex);
+      auto it = this->shapes.find(filename);
+      if (it != this->shapes.end()) {
+        return it->second;
       }
     }
 
-    return buffer;
+    // Read once, so the metadata page is not worth keeping in the pool
+    PageId page_id{.filename = filename, .page = 0};
+    PageHandle metadata = this->buf.ReadPage(page_id, kSequentialOnce);
+    const uint64_t* metadata_page = metadata.As<uint64_t>();
+    assert(has_magic_numbers(metadata_page, FileType::kFilter));
+    FilterShape shape = FilterShape::Read(metadata_page);
+
+    std::unique_lock<std::shared_mutex> lock(this->shapes_mutex);
+    this->shapes.insert_or_assign(filename, shape);
+    return shape;
   }
 
-  std::array<BloomFilter, kFiltersPerPage> static from_buf(BytePage& buffer) {
-    std::array<BloomFilter, kFiltersPerPage> filters;
-    for (std::size_t i = 0; i < kFiltersPerPage; i++) {
-      std::array<uint8_t, kFilterBytes> filter_buf;
-      for (std::size_t data_offset = 0; data_offset < kFilterBytes;
-           data_offset++) {
-        filter_buf.at(data_offset) =
-            static_cast<uint8_t>(buffer.at(i * kFilterBytes + data_offset));
+  [[nodiscard]] uint64_t key_hash(K key) const {
+    return static_cast<uint64_t>(XXH64(&key, kKeySize, this->seed));
+  }
+
+  /**
+   * @brief The bucket of the key with @param hash, out of @param n_buckets.
+   * Uses the high half of the hash, the low half picks the bits.
+   */
+  [[nodiscard]] uint64_t static bucket_of(uint64_t hash, uint64_t n_buckets) {
+    assert(n_buckets <= UINT32_MAX);
+    return ((hash >> 32) * n_buckets) >> 32;
+  }
+
+  [[nodiscard]] uint64_t static legacy_bit_hash(K key, uint64_t starting_seed,
+                                                std::size_t i) {
+    return static_cast<uint64_t>(
+        XXH64(&key, kKeySize, (i + 1) + starting_seed + 1));
+  }
+
+  [[nodiscard]] bool legacy_bloom_has(const BloomFilter& filter, const K key,
+                                      uint64_t num_hashes) const {
+    constexpr int kBitsInByte = 8;
+    for (std::size_t i = 0; i < num_hashes; i++) {
+      uint32_t bit_offset =
+          static_cast<uint32_t>(legacy_bit_hash(key, this->seed, i)) %
+          kFilterBits;
+      uint32_t byte = bit_offset / kBitsInByte;
+      uint32_t bit = bit_offset % kBitsInByte;
+
+      // If the bloom filter returns a 0 for any of the values, this is the
+      // DEFINITE_NO answer
+      if (((filter[byte] >> bit) & 1) == 0) {
+        return false;
       }
+    }
+
+    // If all bits are set, this is the MAYBE_YES answer
+    return true;
+  }
 
-      filters.at(i) = filter_buf;
+  /**
+   * @brief Test the block of the key, within the filter pages of a file of
+   * @param shape. @param page_at returns the page at an index of the file.
+   */
+  template <typename PageAt>
+  [[nodiscard]] bool has_in_pages(const FilterShape& shape, K key,
+                                  PageAt page_at) const {
+    if (shape.num_entries == 0) return false;
+
+    uint64_t n_filters = shape.NumFilters();
+    uint64_t hash = this->key_hash(key);
+
+    if (shape.layout == kBitLayout) {
+      uint64_t global_filter_idx = hash % n_filters;
+      const std::byte* page = page_at(calc_page_idx(global_filter_idx));
+      const auto* filters = reinterpret_cast<const BloomFilter*>(page);
+      return this->legacy_bloom_has(
+          filters[calc_page_offset(global_filter_idx)], key, shape.num_hashes);
     }
-    return filters;
+
+    // Calculate the filter of the bucket, and the bucket within the filter
+    uint64_t bucket = bucket_of(hash, n_filters * kBucketsPerFilter);
+    uint64_t global_filter_idx = bucket / kBucketsPerFilter;
+    const std::byte* page = page_at(calc_page_idx(global_filter_idx));
+    const auto* buckets = reinterpret_cast<const BloomBucket*>(page);
+    std::size_t bucket_in_page =
+        calc_page_offset(global_filter_idx) * kBucketsPerFilter +
+        bucket % kBucketsPerFilter;
+    return this->check(buckets[bucket_in_page], static_cast<uint32_t>(hash),
+                       shape.num_hashes);
   }
 
-  uint64_t static num_filters(uint64_t num_entries) {
-    if (num_entries == 0) {
-      return 0;
+  /**
+   * @brief Hold the filter pages of the file in memory, if there is room.
+   */
+  void make_resident(const std::string& filename, const FilterShape& shape,
+                     const std::vector<BytePage>& pages) {
+    if (this->resident == nullptr ||
+        !this->resident->Fits(pages.size() * sizeof(PageFrame))) {
+      return;
+    }
+
+    auto filter = std::make_shared<ResidentFilter>();
+    filter->num_entries = shape.num_entries;
+    filter->entries_per_filter = shape.entries_per_filter;
+    filter->num_hashes = shape.num_hashes;
+    filter->layout = shape.layout;
+    filter->pages.resize(pages.size());
+    for (std::size_t page = 0; page < pages.size(); page++) {
+      filter->pages.at(page).bytes = pages.at(page);
     }
-    return ceil(static_cast<float>(num_entries) / kEntriesPerFilter);
+    this->resident->Admit(filename, std::move(filter));
   }
 
-  void write_metadata_block(std::fstream& file, uint64_t num_entries) {
+  void write_metadata_block(std::fstream& file, const FilterShape& shape) {
     assert(file.good());
     std::array<uint64_t, kPageSize / sizeof(uint64_t)> metadata_block{};
     put_magic_numbers(metadata_block, FileType::kFilter);
-    metadata_block.at(kNumEntries) = num_entries;
+    metadata_block.at(kNumEntries) = shape.num_entries;
+    metadata_block.at(kEntriesPerFilter) = shape.entries_per_filter;
+    metadata_block.at(kNumHashFuncs) = shape.num_hashes;
+    metadata_block.at(kLayout) = shape.layout;
 
     file.write(reinterpret_cast<char*>(metadata_block.data()), kPageSize);
     assert(file.good());
 
-    uint64_t n_filters = num_filters(num_entries);
+    uint64_t n_filters = shape.NumFilters();
     for (uint64_t filter_idx = 0; filter_idx < n_filters; filter_idx++) {
       std::array<uint8_t, kFilterBytes> zeroes{};
       file.write(reinterpret_cast<char*>(zeroes.data()), kFilterBytes);
@@ -163,37 +404,36 @@ class Filter::FilterImpl {
     assert(file.good());
   }
 
-  void batch_write_keys(std::fstream& file,
-                        const std::vector<std::pair<K, V>>& pairs) {
-    std::vector<BloomFilter> filters{};
-
-    uint64_t n_filters = num_filters(pairs.size());
-    filters.resize(n_filters);
-
-    for (auto const& pair : pairs) {
-      K key = pair.first;
-      uint64_t filter_idx = block_hash(key, this->seed) % n_filters;
-
-      BloomFilter& filter = filters.at(filter_idx);
-      for (const auto& fn : this->bit_hashes) {
-        bloom_set(filter, fn(key) % kFilterBits);
-      }
+  /**
+   * @brief Write the filter pages of the keys, returning them.
+   */
+  [[nodiscard]] static K key_of(const std::pair<K, V>& pair) {
+    return pair.first;
+  }
+  [[nodiscard]] static K key_of(K key) { return key; }
+
+  template <typename Entry>
+  std::vector<BytePage> batch_write_keys(std::fstream& file,
+                                         const FilterShape& shape,
+                                         const std::vector<Entry>& entries) {
+    assert(shape.layout == kSplitBlockLayout);
+    uint64_t n_buckets = shape.NumFilters() * kBucketsPerFilter;
+    std::vector<BloomBucket> buckets(n_buckets);
+
+    for (auto const& entry : entries) {
+      uint64_t hash = this->key_hash(key_of(entry));
+      bucket_insert(buckets.at(bucket_of(hash, n_buckets)),
+                    static_cast<uint32_t>(hash), shape.num_hashes);
     }
 
-    std::vector<BytePage> pages{};
-    pages.resize(ceil(static_cast<float>(n_filters) / kFiltersPerPage));
-
-    std::size_t filter_idx = 0;
+    // The buckets are laid out in order, filling each page
+    std::vector<BytePage> pages(shape.NumPages());
+    constexpr std::size_t kBucketsPerPage = kPageSize / sizeof(BloomBucket);
     for (std::size_t page_idx = 0; page_idx < pages.size(); page_idx++) {
-      std::array<BloomFilter, kFiltersPerPage> page_filters{};
-      std::size_t batch = 0;
-      while (batch < kFiltersPerPage && filter_idx < n_filters) {
-        page_filters.at(batch) = filters.at(filter_idx);
-        filter_idx++;
-        batch++;
-      }
-
-      pages.at(page_idx) = this->to_buf(page_filters);
+      std::size_t first = page_idx * kBucketsPerPage;
+      std::size_t count = std::min(kBucketsPerPage, buckets.size() - first);
+      std::memcpy(pages.at(page_idx).data(), &buckets.at(first),
+                  count * sizeof(BloomBucket));
     }
 
     // Write the file data
@@ -203,111 +443,176 @@ class Filter::FilterImpl {
       file.write(reinterpret_cast<char*>(pages.at(page).data()), kPageSize);
     }
     assert(file.good());
+    return pages;
   }
 
  public:
-  FilterImpl(const DbNaming& dbname, BufPool& buf, const uint64_t starting_seed)
+  FilterImpl(const DbNaming& dbname, BufPool& buf, const uint64_t starting_seed,
+             ResidentFilters* resident)
       : dbname(dbname),
         seed(starting_seed),
-        bit_hashes(create_hash_funcs(starting_seed)),
-        buf(buf) {}
+        check(bucket_check()),
+        buf(buf),
+        resident(resident) {}
 
-  void Create(std::string& filename,
-              const std::vector<std::pair<K, V>>& pairs) {
+  template <typename Entry>
+  void Create(std::string& filename, const std::vector<Entry>& entries,
+              double bits_per_entry) {
     std::fstream file(filename, std::fstream::binary | std::fstream::out |
                                     std::fstream::in | std::fstream::trunc);
     assert(file.is_open());
     assert(file.good());
 
-    this->write_metadata_block(file, pairs.size());
-    this->batch_write_keys(file, pairs);
+    FilterShape shape = FilterShape::Sized(entries.size(), bits_per_entry);
+    this->write_metadata_block(file, shape);
+    std::vector<BytePage> pages = this->batch_write_keys(file, shape, entries);
+    this->make_resident(filename, shape, pages);
+
+    std::unique_lock<std::shared_mutex> lock(this->shapes_mutex);
+    this->shapes.insert_or_assign(filename, shape);
   }
 
-  [[nodiscard]] bool Has(std::string& filename, K key) {
-    std::fstream file(
-        filename, std::fstream::binary | std::fstream::in | std::fstream::out);
-    assert(file.is_open());
-    assert(file.good());
+  void Load(std::string& filename) {
+    if (this->resident == nullptr ||
+        this->resident->Get(filename) != nullptr) {
+      return;
+    }
 
-    std::array<uint64_t, kPageSize / sizeof(uint64_t)> metadata_page{};
-    file.seekg(0);
-    file.read(reinterpret_cast<char*>(metadata_page.data()), kPageSize);
+    FilterShape shape = this->shape_of(filename);
+    uint32_t pages = shape.NumPages();
+    if (!this->resident->Fits(pages * sizeof(PageFrame))) {
+      return;
+    }
 
-    assert(has_magic_numbers(metadata_page, FileType::kFilter));
+    // Read once, the pages are held by the resident filters from now on
+    std::vector<BytePage> contents(pages);
+    for (uint32_t page = 0; page < pages; page++) {
+      PageId page_id{.filename = filename, .page = page + 1};
+      contents.at(page) = this->buf.ReadPage(page_id, kSequentialOnce).bytes();
+    }
+    this->make_resident(filename, shape, contents);
+  }
+
+  /**
+   * @brief The resident copy of the filter file, or nullptr if it is read
+   * through the buffer pool.
+   */
+  [[nodiscard]] std::shared_ptr<const ResidentFilter> resident_filter(
+      const std::string& filename) const {
+    if (this->resident == nullptr) {
+      return nullptr;
+    }
+    return this->resident->Get(filename);
+  }
+
+  [[nodiscard]] static FilterShape resident_shape(
+      const ResidentFilter& filter) {
+    return FilterShape{
+        .num_entries = filter.num_entries,
+        .entries_per_filter = filter.entries_per_filter,
+        .num_hashes = filter.num_hashes,
+        .layout = filter.layout,
+    };
+  }
+
+  [[nodiscard]] bool Has(std::string& filename, K key) {
+    std::shared_ptr<const ResidentFilter> filter =
+        this->resident_filter(filename);
+    if (filter != nullptr) {
+      return this->has_in_pages(
+          resident_shape(*filter), key, [&](uint32_t page_idx) {
+            // The metadata page is not held
+            return filter->pages.at(page_idx - 1).bytes.data();
+          });
+    }
+
+    // Test the filter in place, in the pinned page
+    std::optional<PageHandle> page;
+    return this->has_in_pages(
+        this->shape_of(filename), key, [&](uint32_t page_idx) {
+          PageId page_id{.filename = filename, .page = page_idx};
+          page = this->buf.ReadPage(page_id);
+          return page->data();
+        });
+  }
 
-    // Calculate filter and bit offsets
-    uint64_t num_elements = metadata_page.at(2);
-    if (num_elements == 0) return false;
-
-    uint64_t n_filters = num_filters(num_elements);
-
-    uint64_t global_filter_idx = block_hash(key, this->seed) % n_filters;
-    uint32_t page_idx = calc_page_idx(global_filter_idx);
-    uint64_t filter_offset = calc_page_offset(global_filter_idx);
-
-    // Attempt to read the page out of the buffer
-    PageId page_id = PageId{.filename = filename, .page = page_idx};
-    std::optional<BufferedPage> buf_page = buf.GetPage(page_id);
-    if (buf_page.has_value()) {
-      auto buf = std::any_cast<BytePage>(buf_page.value().contents);
-      auto filters = this->from_buf(buf);
-      return bloom_has(filters.at(filter_offset), key);
-    } else {
-      // Or read it ourselves.
-      file.seekg(page_idx * kPageSize);
-      BytePage buf{};
-      assert(file.good());
-      file.read(reinterpret_cast<char*>(buf.data()), kPageSize);
-      assert(file.good());
-
-      // Put the page back in the buffer
-      this->buf.PutPage(page_id, std::make_any<BytePage>(buf));
-
-      std::array<BloomFilter, kFiltersPerPage> filters = this->from_buf(buf);
-
-      return bloom_has(filters.at(filter_offset), key);
+  [[nodiscard]] std::vector<bool> MultiHas(std::string& filename,
+                                           const std::vector<K>& keys) {
+    std::vector<bool> has(keys.size());
+
+    std::shared_ptr<const ResidentFilter> filter =
+        this->resident_filter(filename);
+    if (filter != nullptr) {
+      FilterShape shape = resident_shape(*filter);
+      for (std::size_t i = 0; i < keys.size(); i++) {
+        has[i] = this->has_in_pages(shape, keys[i], [&](uint32_t page_idx) {
+          return filter->pages.at(page_idx - 1).bytes.data();
+        });
+      }
+      return has;
     }
 
-    file.close();
+    // Every page is pinned once, and kept for the other keys of the batch
+    FilterShape shape = this->shape_of(filename);
+    std::unordered_map<uint32_t, PageHandle> pages;
+    for (std::size_t i = 0; i < keys.size(); i++) {
+      has[i] = this->has_in_pages(shape, keys[i], [&](uint32_t page_idx) {
+        auto page = pages.find(page_idx);
+        if (page == pages.end()) {
+          PageId page_id{.filename = filename, .page = page_idx};
+          page = pages.emplace(page_idx, this->buf.ReadPage(page_id)).first;
+        }
+        return page->second.data();
+      });
+    }
+    return has;
   }
 
   void Delete(std::string& filename) {
     // Invalidate possible pages put into the buffer pool.
-    std::fstream file(
-        filename, std::fstream::binary | std::fstream::in | std::fstream::out);
-    assert(file.is_open());
-    assert(file.good());
-    std::array<uint64_t, kPageSize / sizeof(uint64_t)> metadata_page{};
-    file.seekg(0);
-    file.read(reinterpret_cast<char*>(metadata_page.data()), kPageSize);
-
-    assert(has_magic_numbers(metadata_page, FileType::kFilter));
+    FilterShape shape = this->shape_of(filename);
+    {
+      std::unique_lock<std::shared_mutex> lock(this->shapes_mutex);
+      this->shapes.erase(filename);
+    }
 
-    // Calculate filter and bit offsets
-    uint64_t num_elements = metadata_page.at(2);
-    uint32_t pages = 1 + ceil(static_cast<float>(num_filters(num_elements)) /
-                              kFiltersPerPage);
+    uint32_t pages = 1 + shape.NumPages();
     for (uint32_t page = 0; page < pages; page++) {
       PageId page_id{.filename = filename, .page = page};
       this->buf.RemovePage(page_id);
     }
 
-    // Delete the file
+    if (this->resident != nullptr) {
+      this->resident->Remove(filename);
+    }
+
+    // Delete the file, closing it first as the name will be reused
+    this->buf.CloseFile(filename);
     bool removed = std::filesystem::remove(filename);
     assert(removed);
   }
 };
 
-Filter::Filter(const DbNaming& dbname, BufPool& buf, const uint64_t seed)
-    : impl(std::make_unique<FilterImpl>(dbname, buf, seed)) {}
+Filter::Filter(const DbNaming& dbname, BufPool& buf, const uint64_t seed,
+               ResidentFilters* resident)
+    : impl(std::make_unique<FilterImpl>(dbname, buf, seed, resident)) {}
 Filter::~Filter() = default;
-void Filter::Create(std::string& file,
-                    const std::vector<std::pair<K, V>>& keys) {
-  return this->impl->Create(file, keys);
+void Filter::Create(std::string& file, const std::vector<std::pair<K, V>>& keys,
+                    double bits_per_entry) {
+  return this->impl->Create(file, keys, bits_per_entry);
+}
+void Filter::Create(std::string& file, const std::vector<K>& keys,
+                    double bits_per_entry) {
+  return this->impl->Create(file, keys, bits_per_entry);
 }
 void Filter::Delete(std::string& filename) {
   return this->impl->Delete(filename);
 }
+void Filter::Load(std::string& filename) { return this->impl->Load(filename); }
 [[nodiscard]] bool Filter::Has(std::string& filename, K key) const {
   return this->impl->Has(filename, key);
+}
+[[nodiscard]] std::vector<bool> Filter::MultiHas(
+    std::string& filename, const std::vector<K>& keys) const {
+  return this->impl->MultiHas(filename, keys);
 }
\ No newline at end of file
@@ -1,7 +1,10 @@
 #pragma once
 
+#include <cstddef>
 #include <cstdint>
+#include <memory>
 #include <string>
+#include <vector>
 
 #include "buf.hpp"
 #include "constants.hpp"
@@ -13,6 +16,107 @@ struct FilterId {
   uint32_t intermediate;
 };
 
+/**
+ * A filter file held whole in memory.
+ */
+struct ResidentFilter {
+  uint64_t num_entries;
+  uint64_t entries_per_filter;
+  uint64_t num_hashes;
+  uint64_t layout;
+  // The pages of filter blocks, in file order, without the metadata page.
+  std::vector<PageFrame> pages;
+};
+
+struct ResidentFilterStats {
+  // The memory held by resident filters, at most the budget.
+  std::size_t bytes;
+  std::size_t budget_bytes;
+  uint64_t files;
+};
+
+/**
+ * Filter files held in memory outside of the buffer pool, so that checking
+ * them never does I/O, up to a budget of bytes. A filter that does not fit is
+ * read through the buffer pool as usual. Shared by all filter serializers of a
+ * database, and safe to use from many threads at once.
+ */
+class ResidentFilters {
+ private:
+  class ResidentFiltersImpl;
+  const std::unique_ptr<ResidentFiltersImpl> impl;
+
+ public:
+  explicit ResidentFilters(std::size_t budget_bytes);
+  ~ResidentFilters();
+
+  /**
+   * @brief Whether a filter of @param bytes fits in what is left of the budget.
+   */
+  [[nodiscard]] bool Fits(std::size_t bytes) const;
+
+  /**
+   * @brief Hold the filter in memory if it fits in the budget, returning
+   * whether it does.
+   */
+  bool Admit(const std::string& filename,
+             std::shared_ptr<const ResidentFilter> filter);
+
+  /**
+   * @brief The filter of the file, or nullptr if it is not resident.
+   */
+  [[nodiscard]] std::shared_ptr<const ResidentFilter> Get(
+      const std::string& filename) const;
+
+  /**
+   * @brief Release the filter of the file, if it is resident.
+   */
+  void Remove(const std::string& filename);
+
+  [[nodiscard]] ResidentFilterStats Stats() const;
+};
+
+/**
+ * The bits per entry of filters when they are not given.
+ */
+constexpr double kDefaultBitsPerEntry = 5;
+
+/**
+ * @brief The bits per entry that Monkey gives the filters of a level, so that
+ * the expected number of false positives of a point lookup over all levels is
+ * as low as it can be for the memory of `bits_per_entry` bits per entry on
+ * average. Shallow levels, with few entries, get more bits than the average,
+ * and the deepest level fewer.
+ *
+ * @param level The level of the filter, 0-indexed.
+ * @param levels The number of levels in the tree.
+ * @param size_ratio How many times larger each level is than the one above.
+ * @param bits_per_entry The average bits per entry over all levels.
+ */
+double monkey_bits_per_entry(uint32_t level, uint32_t levels,
+                             uint8_t size_ratio, double bits_per_entry);
+
+/**
+ * How to size the filters of each level.
+ */
+struct FilterTuning {
+  // The bits per entry of the filters, on average over the levels.
+  double bits_per_entry;
+  // Spread the bits over the levels as Monkey does, rather than giving every
+  // level the same bits per entry.
+  bool monkey;
+  // Where to hold filters in memory, nullptr to always read them through the
+  // buffer pool.
+  ResidentFilters* resident;
+
+  /**
+   * @brief The bits per entry of filters of a level, in a tree of @param
+   * levels levels, each @param size_ratio times larger than the one above.
+   */
+  [[nodiscard]] double BitsPerEntry(uint32_t level, uint32_t levels,
+                                    uint8_t size_ratio) const;
+};
+
 class Filter {
  private:
   class FilterImpl;
@@ -25,8 +129,11 @@ class Filter {
    * @param buf A buffer pool cache for accessing pages in the filesystem.
    * @param seed A starting random seed for the hash functions in the
    * Blocked BloomFilter.
+   * @param resident Where to hold filters in memory, nullptr to always read
+   * them through the buffer pool.
    */
-  Filter(const DbNaming& dbname, BufPool& buf, uint64_t seed);
+  Filter(const DbNaming& dbname, BufPool& buf, uint64_t seed,
+         ResidentFilters* resident = nullptr);
   ~Filter();
 
   /**
@@ -36,8 +143,19 @@ class Filter {
    * @param keys The (key, value) pairs going into the filter. In theory, only
    * keys need to be passed in, but during flushing of the Memtable we have
    * (key, values), meaning it's easy to just pass them in by reference.
+   * @param bits_per_entry The size of the filter, which determines its false
+   * positive rate. Saved into the file along with the number of hash
+   * functions.
    */
-  void Create(std::string& filename, const std::vector<std::pair<K, V>>& keys);
+  void Create(std::string& filename, const std::vector<std::pair<K, V>>& keys,
+              double bits_per_entry = kDefaultBitsPerEntry);
+
+  /**
+   * @brief Create a new filter file from just the keys going into it, in any
+   * order.
+   */
+  void Create(std::string& filename, const std::vector<K>& keys,
+              double bits_per_entry = kDefaultBitsPerEntry);
 
   /**
    * @brief Delete a filter file. Invalidates the cache entries that filter file
@@ -49,6 +167,13 @@ class Filter {
    */
   void Delete(std::string& filename);
 
+  /**
+   * @brief Load an existing filter file into the resident filters, if there
+   * are any and it fits. Intended for filters discovered when the database is
+   * opened, as filters are made resident when they are created.
+   */
+  void Load(std::string& filename);
+
   /**
    * @brief Returns `true` if the filter MIGHT have the key, `false` if the
    * filter DEFINITELY DOES NOT have the key.
@@ -57,4 +182,15 @@ class Filter {
    * @param key The key to query for.
    */
   [[nodiscard]] bool Has(std::string& filename, K key) const;
+
+  /**
+   * @brief Has() for many keys of the same filter file, reading each page of
+   * the filter at most once for the whole batch.
+   *
+   * @param keys The keys to query for.
+   * @return std::vector<bool> Whether the filter might have each key, lined up
+   * with @param keys.
+   */
+  [[nodiscard]] std::vector<bool> MultiHas(std::string& filename,
+                                           const std::vector<K>& keys) const;
 };
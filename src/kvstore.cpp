@@ -1,7 +1,9 @@
 #include "kvstore.hpp"
 
 #include <algorithm>
+#include <atomic>
 #include <cassert>
+#include <condition_variable>
 #include <cstdint>
 #include <cstdio>
 #include <cstdlib>
@@ -9,12 +11,17 @@
 #include <fstream>
 #include <functional>
 #include <memory>
+#include <mutex>
 #include <optional>
+#include <shared_mutex>
 #include <string>
+#include <thread>
 #include <utility>
 
 #include "buf.hpp"
 #include "constants.hpp"
+#include "cursor.hpp"
+#include "evict.hpp"
 #include "filter.hpp"
 #include "lsm.hpp"
 #include "manifest.hpp"
@@ -22,6 +29,7 @@
 #include "minheap.hpp"
 #include "naming.hpp"
 #include "sstable.hpp"
+#include "wal.hpp"
 
 const char* OnlyTheDatabaseCanUseFunnyValuesException::what() const noexcept {
   return "Only the database can use funny values! This one is the tombstone "
@@ -33,6 +41,20 @@ const char* DatabaseInUseException::what() const noexcept {
          "database! Cannot have dual-ownership!";
 };
 
+const char* WriteBatchTooLargeException::what() const noexcept {
+  return "The write batch has more keys than fit into the memtable! Split it, "
+         "or raise memory_buffer_elements.";
+};
+
+const char* DatabaseNotEmptyException::what() const noexcept {
+  return "Only an empty database can be bulk loaded! Load it before any "
+         "other write.";
+};
+
+const char* BulkLoadNotSortedException::what() const noexcept {
+  return "The pairs to bulk load are not in strictly increasing key order!";
+};
+
 const char* DatabaseClosedException::what() const noexcept {
   return "Database is closed, please Open() it first!";
 };
@@ -41,29 +63,142 @@ const char* FailedToOpenException::what() const noexcept {
   return "Failed to open database directory!";
 };
 
+/**
+ * An immutable snapshot of the runs in each level, oldest run first. Readers
+ * search a snapshot without holding any lock, while flushes publish a new one.
+ */
+struct Version {
+  std::vector<std::vector<std::shared_ptr<LSMRun>>> levels;
+};
+
+class KvIterator::KvIteratorImpl {
+ private:
+  // Keeps the runs being read from on disk
+  const std::shared_ptr<const Version> snapshot;
+  const K lower;
+  const K upper;
+  MergingCursor merged;
+
+  /**
+   * @brief Skip the deleted keys, whose tombstones only shadow older values.
+   */
+  void skip_tombstones() {
+    while (this->merged.Valid() && this->merged.Key() <= this->upper &&
+           this->merged.Value() == kTombstoneValue) {
+      this->merged.Next();
+    }
+  }
+
+ public:
+  KvIteratorImpl(std::shared_ptr<const Version> snapshot, K lower, K upper,
+                 std::vector<std::unique_ptr<Cursor>> cursors)
+      : snapshot(std::move(snapshot)),
+        lower(lower),
+        upper(upper),
+        merged(std::move(cursors)) {
+    this->Seek(lower);
+  }
+
+  void Seek(const K key) {
+    this->merged.Seek(std::max(key, this->lower));
+    this->skip_tombstones();
+  }
+
+  void Next() {
+    assert(this->Valid());
+    this->merged.Next();
+    this->skip_tombstones();
+  }
+
+  [[nodiscard]] bool Valid() const {
+    return this->merged.Valid() && this->merged.Key() <= this->upper;
+  }
+
+  [[nodiscard]] K Key() const {
+    assert(this->Valid());
+    return this->merged.Key();
+  }
+
+  [[nodiscard]] V Value() const {
+    assert(this->Valid());
+    return this->merged.Value();
+  }
+};
+
+/**
+ * @brief Creates the evictors of the page buffer shards for a policy.
+ */
+EvictorFactory evictor_factory(BufferPoolEviction eviction) {
+  switch (eviction) {
+    case BufferPoolEviction::kEvictClock:
+      return [] { return std::make_unique<ClockEvictor>(); };
+    case BufferPoolEviction::kEvictLru:
+      return [] { return std::make_unique<LruEvictor>(); };
+    case BufferPoolEviction::kEvictLruK:
+      return [] { return std::make_unique<LruKEvictor>(); };
+    case BufferPoolEviction::kEvict2Q:
+      return [] { return std::make_unique<TwoQueueEvictor>(); };
+  }
+  assert(false);
+  return nullptr;
+}
+
 class KvStore::KvStoreImpl {
  private:
   std::unique_ptr<Filter> filter_serializer;
   std::unique_ptr<Sstable> sstable_serializer;
   DbNaming naming;
-  MemTable memtable;
+  std::unique_ptr<MemTable> memtable;
 
   std::optional<Manifest> manifest;
   std::optional<BufPool> buf;
+  // Filters held in memory, nullptr if filters are read through `buf`.
+  std::unique_ptr<ResidentFilters> resident_filters;
+  FilterTuning filter_tuning{};
+  std::unique_ptr<WriteAheadLog> wal;
 
   bool open{false};
   std::vector<std::unique_ptr<LSMLevel>> levels;
   uint8_t tiers;
+  CompactionPolicy compaction_policy{kTiering};
+  std::size_t max_subcompactions{1};
+  MemTableFormat memtable_format{kRedBlackTree};
+
+  /**
+   * The full memtable being flushed, nullptr if there is no flush in progress.
+   * With background compaction, this is the memtable handed off to the
+   * compaction thread.
+   */
+  std::unique_ptr<MemTable> immutable;
+  // The first log segment that does not hold writes of `immutable`.
+  uint64_t immutable_segment{0};
+  bool background_compaction{false};
+  bool stop_compaction{false};
+  std::thread compaction_thread;
+
+  // The levels as readers see them. Replaced, never modified, after each flush.
+  std::shared_ptr<const Version> version;
+
+  // Guards the handoff of `immutable` and `stop_compaction` between the
+  // writer and the compaction thread.
+  std::mutex compaction_mutex;
+  std::condition_variable compaction_cv;
+
+  // Guards the contents of `memtable`, and the `memtable`, `immutable` and
+  // `version` pointers. Readers hold it shared while they search the memtables
+  // and take a snapshot of `version`, the writer holds it exclusively to write
+  // into the memtable and to swap any of the three. `levels` is only touched
+  // by the thread doing the flushing.
+  mutable std::shared_mutex memtable_mutex;
 
-  std::unique_ptr<LSMRun> create_level0_run() {
+  std::shared_ptr<LSMRun> create_level0_run(const MemTable& mem) {
     // Register new run
-    uint32_t run_idx = this->levels.front()->NextRun();
+    uint32_t run_idx = this->manifest->NewRun();
 
     // Create the new filter file
-    assert(this->manifest.has_value());
     assert(this->buf.has_value());
-    std::unique_ptr<LSMRun> run = std::make_unique<LSMRun>(
-        this->naming, 0, run_idx, this->tiers, this->memtable.GetCapacity(),
+    std::shared_ptr<LSMRun> run = std::make_shared<LSMRun>(
+        this->naming, 0, run_idx, this->tiers, mem.GetCapacity(),
         this->manifest.value(), this->buf.value(), *this->sstable_serializer,
         *this->filter_serializer);
 
@@ -72,64 +207,434 @@ class KvStore::KvStoreImpl {
     std::string data_name = data_file(this->naming, 0, run_idx, intermediate);
 
     std::unique_ptr<std::vector<std::pair<K, V>>> memtable_contents =
-        this->memtable.ScanAll();
+        mem.ScanAll();
     K min = memtable_contents->front().first;
     K max = memtable_contents->back().first;
     this->sstable_serializer->Flush(data_name, *memtable_contents, true);
 
     std::string filter_name =
         filter_file(this->naming, 0, run_idx, intermediate);
-    this->filter_serializer->Create(filter_name, *memtable_contents);
+    double bits_per_entry =
+        this->filter_tuning.BitsPerEntry(0, this->levels.size(), this->tiers);
+    this->filter_serializer->Create(filter_name, *memtable_contents,
+                                    bits_per_entry);
 
     run->RegisterNewFile(intermediate, min, max);
     return run;
   }
 
-  void recursively_compact() {
-    // While each level overflows, register the overflowed, compacted run into
-    // the next level. Keep looping until compaction no longer produces a run.
-    std::size_t l = 0;
-    std::optional<std::unique_ptr<LSMRun>> l_run =
-        std::make_optional(this->create_level0_run());
+  /**
+   * @brief The level after level @param l, std::nullopt if it is the last.
+   */
+  [[nodiscard]] std::optional<std::reference_wrapper<LSMLevel>> next_level(
+      std::size_t l) {
+    if (l + 1 < this->levels.size()) {
+      return *this->levels.at(l + 1);
+    }
+    return std::nullopt;
+  }
 
-    while (l_run.has_value()) {
-      std::optional<std::reference_wrapper<LSMLevel>> next_level;
-      if (l + 1 < this->levels.size()) {
-        next_level = *this->levels.at(l + 1);
-      }
+  void recursively_compact(const MemTable& mem) {
+    // While each level overflows, merge the runs that overflowed into the
+    // next level. Keep looping until no level overflows.
+    std::size_t l = 0;
+    std::vector<std::shared_ptr<LSMRun>> overflow =
+        this->levels.front()->RegisterNewRun(this->create_level0_run(mem),
+                                             this->next_level(l));
 
-      l_run = this->levels.at(l)->RegisterNewRun(std::move(l_run.value()),
-                                                 next_level);
+    while (!overflow.empty()) {
       l++;
 
       // If the levels are full, create a new, final level
       // This should stop the looping, the new level won't do compaction
-      // when RegisterNewRun is called.
-      if (l == this->levels.size() && l_run.has_value()) {
+      // when its runs are merged into it.
+      if (l == this->levels.size()) {
         this->levels.push_back(std::make_unique<LSMLevel>(
-            this->naming, this->tiers, l, true, this->memtable.GetCapacity(),
-            this->manifest.value(), this->buf.value(),
-            *this->sstable_serializer));
+            this->naming, this->tiers, l, this->compaction_policy,
+            mem.GetCapacity(), this->manifest.value(), this->buf.value(),
+            *this->sstable_serializer, this->filter_tuning,
+            this->max_subcompactions));
       }
+
+      overflow = this->levels.at(l)->MergeRuns(std::move(overflow),
+                                               this->next_level(l));
     }
   }
 
-  void flush_memtable() {
+  /**
+   * @brief Flush the contents of a full memtable into level 0, compacting
+   * levels as they overflow. Readers do not see the result until
+   * `publish_version()`.
+   */
+  void flush_memtable(const MemTable& mem) {
     assert(this->buf.has_value());
     assert(this->manifest.has_value());
 
     // Initialize the first level on the first flush
     if (this->levels.size() == 0) {
       this->levels.push_back(std::make_unique<LSMLevel>(
-          this->naming, this->tiers, 0, false, this->memtable.GetCapacity(),
-          this->manifest.value(), this->buf.value(),
-          *this->sstable_serializer));
+          this->naming, this->tiers, 0, this->compaction_policy,
+          mem.GetCapacity(), this->manifest.value(), this->buf.value(),
+          *this->sstable_serializer, this->filter_tuning,
+          this->max_subcompactions));
     }
 
-    this->recursively_compact();
-    this->memtable.Clear();
+    this->recursively_compact(mem);
   };
 
+  /**
+   * @brief Build a snapshot of the current levels, for readers.
+   */
+  [[nodiscard]] std::shared_ptr<const Version> snapshot_levels() const {
+    auto next = std::make_shared<Version>();
+    for (const auto& level : this->levels) {
+      next->levels.push_back(level->Runs());
+    }
+    return next;
+  }
+
+  /**
+   * @brief Make room in the memtable. The full memtable becomes the immutable
+   * memtable and is replaced by an empty one, waiting only if the previous
+   * immutable memtable has not finished flushing yet. Without background
+   * compaction, the writer then flushes it itself.
+   */
+  void rotate_memtable() {
+    auto next = std::make_unique<MemTable>(this->memtable->GetCapacity(),
+                                           this->memtable_format);
+    {
+      std::unique_lock<std::mutex> lock(this->compaction_mutex);
+      this->compaction_cv.wait(lock, [this] { return !this->immutable; });
+
+      // Closing the log segment syncs it, so it happens before readers are
+      // locked out. Only this thread writes, so nothing is logged in between.
+      uint64_t segment = this->new_wal_segment();
+
+      std::unique_lock<std::shared_mutex> memtable_lock(this->memtable_mutex);
+      this->immutable = std::move(this->memtable);
+      this->memtable = std::move(next);
+      this->immutable_segment = segment;
+    }
+    this->compaction_cv.notify_all();
+
+    if (!this->background_compaction) {
+      this->flush_immutable();
+    }
+  }
+
+  /**
+   * @brief Flush the immutable memtable, then publish the new levels and drop
+   * the immutable memtable in one step, so readers see its contents in exactly
+   * one of the two places.
+   */
+  void flush_immutable() {
+    uint64_t segment = 0;
+    {
+      std::lock_guard<std::mutex> lock(this->compaction_mutex);
+      segment = this->immutable_segment;
+    }
+
+    this->flush_memtable(*this->immutable);
+    std::shared_ptr<const Version> next = this->snapshot_levels();
+
+    // Outlives the locks: whoever drops the last reference to the previous
+    // version deletes the files of the runs compacted away, be it this thread
+    // or a reader that was still searching them.
+    std::shared_ptr<const Version> previous;
+    {
+      std::lock_guard<std::mutex> lock(this->compaction_mutex);
+      std::unique_lock<std::shared_mutex> memtable_lock(this->memtable_mutex);
+      previous = std::move(this->version);
+      this->version = std::move(next);
+      this->immutable.reset();
+    }
+    this->compaction_cv.notify_all();
+
+    this->retire_wal_segments(segment);
+  }
+
+  void compaction_loop() {
+    std::unique_lock<std::mutex> lock(this->compaction_mutex);
+    while (true) {
+      this->compaction_cv.wait(lock, [this] {
+        return this->immutable != nullptr || this->stop_compaction;
+      });
+
+      // Pending handoffs are drained before stopping.
+      if (this->immutable == nullptr) {
+        return;
+      }
+
+      lock.unlock();
+      this->flush_immutable();
+      lock.lock();
+    }
+  }
+
+  /**
+   * @brief Start logging into a new write-ahead log segment, if there is a log.
+   * Called as the memtable is rotated, so that the returned segment and all
+   * later ones only hold writes that are not part of the outgoing memtable.
+   */
+  uint64_t new_wal_segment() {
+    if (this->wal == nullptr) {
+      return 0;
+    }
+    return this->wal->NewSegment();
+  }
+
+  /**
+   * @brief Once a memtable has been flushed, delete the log segments that held
+   * its writes, see `new_wal_segment()`.
+   */
+  void retire_wal_segments(uint64_t segment) {
+    if (this->wal == nullptr) {
+      return;
+    }
+    this->wal->RemoveSegmentsBefore(segment);
+  }
+
+  /**
+   * @brief Refuse to write once the write-ahead log has failed, as the write
+   * could not be logged.
+   */
+  void check_wal() const {
+    if (this->wal != nullptr && this->wal->Failed()) {
+      throw WriteAheadLogFailedException();
+    }
+  }
+
+  void log_write(const K key, const V value) {
+    if (this->wal == nullptr) {
+      return;
+    }
+    this->wal->Append({{key, value}});
+  }
+
+  /**
+   * @brief Replay the write-ahead log left behind by the previous instance
+   * into the memtable. The memtable is flushed in place if it fills up, the
+   * segments are only retired by the next rotation.
+   */
+  void replay_wal() {
+    assert(this->wal != nullptr);
+
+    this->wal->Replay([this](const std::vector<std::pair<K, V>>& batch) {
+      for (const auto& [key, value] : batch) {
+        try {
+          this->memtable->Put(key, value);
+        } catch (MemTableFullException& e) {
+          this->flush_memtable(*this->memtable);
+          this->memtable->Clear();
+          this->memtable->Put(key, value);
+        }
+      }
+    });
+  }
+
+  /**
+   * @brief Whether the memtable has no room left for a write of @param key.
+   * Only this thread writes into the memtable, so it can't fill up until the
+   * write is in.
+   */
+  [[nodiscard]] bool memtable_full_for(const K key) const {
+    if (this->memtable->Size() < this->memtable->GetCapacity()) {
+      return false;
+    }
+    // A red-black tree overwrites a key it holds in place
+    return this->memtable_format != kRedBlackTree ||
+           this->memtable->Get(key) == nullptr;
+  }
+
+  /**
+   * @brief Log a (key, value) pair, then write it into the memtable, rotating
+   * the memtable first if it is full. The pair is only readable once it is
+   * logged, so a write that fails to log leaves nothing behind.
+   */
+  void write(const K key, const V value) {
+    this->check_wal();
+    if (this->memtable_full_for(key)) {
+      this->rotate_memtable();
+    }
+    this->log_write(key, value);
+    this->put_into_memtable(key, value);
+  }
+
+  /**
+   * @brief Put a pair into the memtable. A skiplist can be written while it is
+   * read, so the lock only keeps it from being swapped out.
+   */
+  void put_into_memtable(const K key, const V value) {
+    if (this->memtable_format == kSkipList) {
+      std::shared_lock<std::shared_mutex> lock(this->memtable_mutex);
+      this->memtable->Put(key, value);
+    } else {
+      std::unique_lock<std::shared_mutex> lock(this->memtable_mutex);
+      this->memtable->Put(key, value);
+    }
+  }
+
+  /**
+   * @brief Write a batch of (key, value) pairs into a single memtable, making
+   * room for all of it first. The batch is logged as a single record before
+   * any of it is written into the memtable.
+   */
+  void write_batch(const std::vector<std::pair<K, V>>& pairs) {
+    if (pairs.empty()) {
+      return;
+    }
+    this->check_wal();
+
+    // Only distinct keys need room, which is worth counting only for a batch
+    // that wouldn't fit otherwise. Such a batch is cut down to the last write
+    // of each key, as a skiplist memtable takes room for every write.
+    std::size_t capacity = this->memtable->GetCapacity();
+    const std::vector<std::pair<K, V>>* writes = &pairs;
+    std::vector<std::pair<K, V>> last_writes;
+    if (pairs.size() > capacity) {
+      last_writes.assign(pairs.rbegin(), pairs.rend());
+      std::stable_sort(
+          last_writes.begin(), last_writes.end(),
+          [](const std::pair<K, V>& a, const std::pair<K, V>& b) {
+            return a.first < b.first;
+          });
+      last_writes.erase(
+          std::unique(last_writes.begin(), last_writes.end(),
+                      [](const std::pair<K, V>& a, const std::pair<K, V>& b) {
+                        return a.first == b.first;
+                      }),
+          last_writes.end());
+      if (last_writes.size() > capacity) {
+        throw WriteBatchTooLargeException();
+      }
+      writes = &last_writes;
+    }
+
+    // Only this thread writes into the memtable, so its size can't change
+    // until the batch is in
+    if (this->memtable->Size() > 0 &&
+        this->memtable->Size() + writes->size() > capacity) {
+      this->rotate_memtable();
+    }
+
+    if (this->wal != nullptr) {
+      this->wal->Append(*writes);
+    }
+
+    std::unique_lock<std::shared_mutex> lock(this->memtable_mutex);
+    for (const auto& [key, value] : *writes) {
+      this->memtable->Put(key, value);
+    }
+  }
+
+  /**
+   * @brief Whether nothing was ever written to the database, or survives in
+   * it.
+   */
+  [[nodiscard]] bool is_empty() {
+    std::lock_guard<std::mutex> lock(this->compaction_mutex);
+    if (this->memtable->Size() > 0 || this->immutable != nullptr) {
+      return false;
+    }
+    return std::all_of(this->levels.begin(), this->levels.end(),
+                       [](const auto& level) { return level->Runs().empty(); });
+  }
+
+  /**
+   * @brief Check that the pairs of @param pairs can be bulk loaded, and count
+   * them.
+   */
+  static std::size_t count_bulk_pairs(Cursor& pairs) {
+    std::size_t count = 0;
+    std::optional<K> previous;
+    for (pairs.Seek(0); pairs.Valid(); pairs.Next()) {
+      if (previous.has_value() && pairs.Key() <= previous.value()) {
+        throw BulkLoadNotSortedException();
+      }
+      if (pairs.Value() == kTombstoneValue) {
+        throw OnlyTheDatabaseCanUseFunnyValuesException();
+      }
+      previous = pairs.Key();
+      count++;
+    }
+    return count;
+  }
+
+  /**
+   * @brief The shallowest level whose runs hold @param files files. A run of
+   * level L is merged from `tiers` runs of level L - 1, and a run of level 0
+   * is a single file.
+   */
+  [[nodiscard]] uint32_t bulk_load_level(std::size_t files) const {
+    uint32_t level = 0;
+    for (std::size_t run_files = 1; this->tiers > 1 && run_files < files;
+         run_files *= this->tiers) {
+      level++;
+    }
+    return level;
+  }
+
+  /**
+   * @brief Write the pairs of @param pairs into the files of the new run
+   * @param run of level @param level, without registering them.
+   */
+  std::vector<FileMetadata> write_bulk_files(Cursor& pairs, uint32_t level,
+                                             uint32_t run) {
+    std::size_t capacity = this->memtable->GetCapacity();
+    double bits_per_entry =
+        this->filter_tuning.BitsPerEntry(level, level + 1, this->tiers);
+
+    std::vector<FileMetadata> files;
+    pairs.Seek(0);
+    for (uint32_t intermediate = 0; pairs.Valid(); intermediate++) {
+      std::string data_name = data_file(this->naming, level, run, intermediate);
+      std::unique_ptr<SstableBuilder> builder =
+          this->sstable_serializer->NewBuilder(data_name);
+      std::vector<K> keys;
+      keys.reserve(capacity);
+      for (; pairs.Valid() && keys.size() < capacity; pairs.Next()) {
+        builder->Add(pairs.Key(), pairs.Value());
+        keys.push_back(pairs.Key());
+      }
+      builder->Finish();
+
+      std::string filter_name =
+          filter_file(this->naming, level, run, intermediate);
+      this->filter_serializer->Create(filter_name, keys, bits_per_entry);
+
+      files.push_back(FileMetadata{
+          .id =
+              SstableId{
+                  .level = level,
+                  .run = run,
+                  .intermediate = intermediate,
+              },
+          .minimum = keys.front(),
+          .maximum = keys.back(),
+      });
+    }
+    return files;
+  }
+
+  void start_compaction_thread() {
+    this->stop_compaction = false;
+    this->compaction_thread =
+        std::thread(&KvStoreImpl::compaction_loop, this);
+  }
+
+  void stop_compaction_thread() {
+    if (!this->compaction_thread.joinable()) {
+      return;
+    }
+
+    {
+      std::lock_guard<std::mutex> lock(this->compaction_mutex);
+      this->stop_compaction = true;
+    }
+    this->compaction_cv.notify_all();
+    this->compaction_thread.join();
+  }
+
   /**
    * @brief Creates a file in the directory meant for locking the DB. If the
    * file already exists, throws a DatabaseInUseException() to the user.
@@ -163,11 +668,12 @@ class KvStore::KvStoreImpl {
     assert(this->buf.has_value());
 
     for (int level = 0; level < this->manifest.value().NumLevels(); level++) {
-      bool is_final = level == this->manifest.value().NumLevels() - 1;
       auto lvl = std::make_unique<LSMLevel>(
-          this->naming, this->tiers, level, is_final,
-          this->memtable.GetCapacity(), this->manifest.value(),
-          this->buf.value(), *this->sstable_serializer);
+          this->naming, this->tiers, level, this->compaction_policy,
+          this->memtable->GetCapacity(), this->manifest.value(),
+          this->buf.value(), *this->sstable_serializer, this->filter_tuning,
+          this->max_subcompactions);
+      lvl->DiscoverRuns();
       this->levels.push_back(std::move(lvl));
     };
   }
@@ -176,7 +682,7 @@ class KvStore::KvStoreImpl {
   KvStoreImpl()
       : filter_serializer(nullptr),
         sstable_serializer(nullptr),
-        memtable(0),
+        memtable(std::make_unique<MemTable>(0)),
         levels(0),
         tiers(0){};
   ~KvStoreImpl() { this->Close(); };
@@ -185,10 +691,15 @@ class KvStore::KvStoreImpl {
     this->open = true;
 
     // Initialize the page buffer
-    this->buf.emplace(BufPoolTuning{
-        .initial_elements = options.buffer_pages_initial.value_or(16),
-        .max_elements = options.buffer_pages_maximum.value_or(128),
-    });
+    this->buf.emplace(
+        BufPoolTuning{
+            .initial_elements = options.buffer_pages_initial.value_or(16),
+            .max_elements = options.buffer_pages_maximum.value_or(128),
+            .shards = options.buffer_pool_shards.value_or(1),
+            .open_files = options.max_open_files.value_or(kDefaultOpenFiles),
+        },
+        evictor_factory(options.buffer_pool_eviction.value_or(kEvictClock)),
+        &Hash);
 
     if (!options.serialization.has_value() ||
         options.serialization.value() == DataFileFormat::kBTree) {
@@ -200,6 +711,9 @@ class KvStore::KvStoreImpl {
     }
 
     this->tiers = options.tiers.value_or(2);
+    this->compaction_policy = options.compaction_policy.value_or(kTiering);
+    this->max_subcompactions = options.max_subcompactions.value_or(1);
+    this->memtable_format = options.memtable_format.value_or(kRedBlackTree);
     std::filesystem::path dir = options.dir.value_or("./");
     this->naming = DbNaming{.dirpath = dir / name, .name = name};
 
@@ -207,14 +721,30 @@ class KvStore::KvStoreImpl {
     this->init_directory(dir);
     this->lock_directory();
 
-    // Initialize the memtable capacity
+    // Initialize the memtable
     std::size_t memtable_capacity = options.memory_buffer_elements.value_or(
         kMegabyteSize / (kKeySize + kValSize));
-    this->memtable.IncreaseCapacity(memtable_capacity);
+    if (this->memtable->Size() == 0) {
+      this->memtable =
+          std::make_unique<MemTable>(memtable_capacity, this->memtable_format);
+    } else {
+      // A store reopened with writes still in its memtable keeps them
+      this->memtable->IncreaseCapacity(memtable_capacity);
+    }
 
     // Initialize filter serializer
-    this->filter_serializer =
-        std::make_unique<Filter>(this->naming, this->buf.value(), 0xbeef);
+    std::size_t filter_budget = options.resident_filter_bytes.value_or(0);
+    this->resident_filters =
+        filter_budget == 0 ? nullptr
+                           : std::make_unique<ResidentFilters>(filter_budget);
+    this->filter_tuning = FilterTuning{
+        .bits_per_entry =
+            options.filter_bits_per_entry.value_or(kDefaultBitsPerEntry),
+        .monkey = options.monkey_filters.value_or(true),
+        .resident = this->resident_filters.get(),
+    };
+    this->filter_serializer = std::make_unique<Filter>(
+        this->naming, this->buf.value(), 0, this->resident_filters.get());
 
     // Initialize the manifest file
     this->manifest.emplace(this->naming, this->tiers, *this->sstable_serializer,
@@ -222,6 +752,28 @@ class KvStore::KvStoreImpl {
 
     // Initialize the levels
     this->init_levels();
+
+    // Recover the writes that were not flushed before the last shutdown
+    if (options.write_ahead_log.value_or(false)) {
+      WalSyncPolicy policy =
+          options.wal_sync.value_or(WalSyncPolicy::kSyncGroupCommit);
+      this->wal = std::make_unique<WriteAheadLog>(
+          this->naming,
+          WalTuning{
+              .sync = policy != WalSyncPolicy::kSyncNone,
+              .group_commit = policy == WalSyncPolicy::kSyncGroupCommit,
+              .group_commit_window = options.wal_group_commit_window.value_or(
+                  std::chrono::microseconds(0)),
+          });
+      this->replay_wal();
+    }
+    this->version = this->snapshot_levels();
+
+    this->background_compaction =
+        options.background_compaction.value_or(false);
+    if (this->background_compaction) {
+      this->start_compaction_thread();
+    }
   }
 
   [[nodiscard]] std::filesystem::path DataDirectory() const {
@@ -232,35 +784,91 @@ class KvStore::KvStoreImpl {
     return this->naming.dirpath;
   }
 
+  [[nodiscard]] BufferPoolStats BufferPoolStatistics() const {
+    if (!this->open) {
+      throw DatabaseClosedException();
+    }
+
+    BufPoolStats stats = this->buf->Stats();
+    return BufferPoolStats{
+        .hits = stats.hits,
+        .misses = stats.misses,
+        .evictions = stats.evictions,
+    };
+  }
+
+  [[nodiscard]] FilterMemoryStats FilterMemoryStatistics() const {
+    if (!this->open) {
+      throw DatabaseClosedException();
+    }
+
+    if (this->resident_filters == nullptr) {
+      return FilterMemoryStats{
+          .resident_bytes = 0, .budget_bytes = 0, .resident_files = 0};
+    }
+    ResidentFilterStats stats = this->resident_filters->Stats();
+    return FilterMemoryStats{
+        .resident_bytes = stats.bytes,
+        .budget_bytes = stats.budget_bytes,
+        .resident_files = stats.files,
+    };
+  }
+
   void Close() {
+    this->stop_compaction_thread();
+    this->wal.reset();
+    this->version.reset();
+    this->levels.clear();
     this->unlock_directory();
     this->open = false;
   }
 
-  [[nodiscard]] std::vector<std::pair<K, V>> Scan(const K lower,
-                                                  const K upper) const {
+  [[nodiscard]] std::unique_ptr<KvIterator> NewIterator(const K lower,
+                                                        const K upper) const {
     if (!this->open) {
       throw DatabaseClosedException();
     }
-    std::vector<std::vector<std::pair<K, V>>> sorted_buffers;
 
-    // Scan through the memtable
-    auto scan_result = this->memtable.Scan(lower, upper);
-    if (scan_result.size() > 0) {
-      sorted_buffers.push_back(scan_result);
+    // The memtables keep changing, so their pairs in range are copied out
+    std::vector<std::pair<K, V>> memtable_pairs;
+    std::vector<std::pair<K, V>> immutable_pairs;
+    std::shared_ptr<const Version> snapshot;
+    {
+      std::shared_lock<std::shared_mutex> lock(this->memtable_mutex);
+      memtable_pairs = this->memtable->Scan(lower, upper);
+      if (this->immutable != nullptr) {
+        immutable_pairs = this->immutable->Scan(lower, upper);
+      }
+      snapshot = this->version;
     }
 
-    // And each level
-    for (const auto& level : this->levels) {
-      auto scan_result = level->Scan(lower, upper);
-      if (scan_result.size() > 0) {
-        sorted_buffers.push_back(scan_result);
+    // Cursors are merged oldest first, so that newer values win: the deepest
+    // level first, and the oldest run first within each level, then the
+    // memtables, newest last
+    std::vector<std::unique_ptr<Cursor>> cursors;
+    for (auto level = snapshot->levels.rbegin();
+         level != snapshot->levels.rend(); ++level) {
+      for (const auto& run : *level) {
+        cursors.push_back(run->NewCursor());
       }
     }
+    cursors.push_back(
+        std::make_unique<VectorCursor>(std::move(immutable_pairs)));
+    cursors.push_back(
+        std::make_unique<VectorCursor>(std::move(memtable_pairs)));
 
-    std::reverse(sorted_buffers.begin(), sorted_buffers.end());
+    return std::make_unique<KvIterator>(
+        std::make_unique<KvIterator::KvIteratorImpl>(
+            std::move(snapshot), lower, upper, std::move(cursors)));
+  }
 
-    return minheap_merge(sorted_buffers);
+  [[nodiscard]] std::vector<std::pair<K, V>> Scan(const K lower,
+                                                  const K upper) const {
+    std::vector<std::pair<K, V>> pairs;
+    for (auto it = this->NewIterator(lower, upper); it->Valid(); it->Next()) {
+      pairs.emplace_back(it->Key(), it->Value());
+    }
+    return pairs;
   }
 
   [[nodiscard]] std::optional<V> Get(const K key) const {
@@ -268,31 +876,117 @@ class KvStore::KvStoreImpl {
       throw DatabaseClosedException();
     }
 
-    // First search the memtable
-    V* mem_val = this->memtable.Get(key);
+    std::optional<V> mem_val = std::nullopt;
+    std::shared_ptr<const Version> snapshot;
+    {
+      std::shared_lock<std::shared_mutex> lock(this->memtable_mutex);
 
-    if (mem_val != nullptr) {
+      // First search the memtable, then the memtable being flushed, if any
+      V* val = this->memtable->Get(key);
+      if (val == nullptr && this->immutable != nullptr) {
+        val = this->immutable->Get(key);
+      }
+
+      if (val != nullptr) {
+        mem_val = *val;
+      } else {
+        snapshot = this->version;
+      }
+    }
+
+    if (mem_val.has_value()) {
       // If the value is a tombstone, mark it as not present.
-      if (*mem_val == kTombstoneValue) {
+      if (mem_val.value() == kTombstoneValue) {
         return std::nullopt;
       }
-      return std::make_optional(*mem_val);
+      return mem_val;
     }
 
-    // Then search through each level, starting at the smallest
-    for (const auto& level : this->levels) {
-      std::optional<V> val = level->Get(key);
-      if (val.has_value()) {
-        if (val.value() == kTombstoneValue) {
-          return std::nullopt;
+    // Then search through each level, starting at the smallest, and the
+    // newest run within each level
+    for (const auto& level : snapshot->levels) {
+      for (auto run = level.rbegin(); run != level.rend(); ++run) {
+        std::optional<V> val = (*run)->Get(key);
+        if (val.has_value()) {
+          if (val.value() == kTombstoneValue) {
+            return std::nullopt;
+          }
+          return val;
         }
-        return val;
       }
     }
 
     return std::nullopt;
   }
 
+  [[nodiscard]] std::vector<std::optional<V>> MultiGet(
+      const std::vector<K>& keys) const {
+    if (!this->open) {
+      throw DatabaseClosedException();
+    }
+
+    // Search for each key once, in key order
+    std::vector<K> sorted(keys);
+    std::sort(sorted.begin(), sorted.end());
+    sorted.erase(std::unique(sorted.begin(), sorted.end()), sorted.end());
+    std::vector<std::optional<V>> sorted_values(sorted.size());
+
+    std::shared_ptr<const Version> snapshot;
+    {
+      std::shared_lock<std::shared_mutex> lock(this->memtable_mutex);
+
+      // First search the memtable, then the memtable being flushed, if any
+      for (std::size_t i = 0; i < sorted.size(); i++) {
+        V* val = this->memtable->Get(sorted[i]);
+        if (val == nullptr && this->immutable != nullptr) {
+          val = this->immutable->Get(sorted[i]);
+        }
+        if (val != nullptr) {
+          sorted_values[i] = *val;
+        }
+      }
+      snapshot = this->version;
+    }
+
+    // Then search through each level, starting at the smallest, and the
+    // newest run within each level, for the keys still missing
+    std::vector<K> missing;
+    std::vector<std::size_t> positions;
+    for (const auto& level : snapshot->levels) {
+      for (auto run = level.rbegin(); run != level.rend(); ++run) {
+        missing.clear();
+        positions.clear();
+        for (std::size_t i = 0; i < sorted.size(); i++) {
+          if (!sorted_values[i].has_value()) {
+            missing.push_back(sorted[i]);
+            positions.push_back(i);
+          }
+        }
+        if (missing.empty()) {
+          break;
+        }
+
+        std::vector<std::optional<V>> found = (*run)->MultiGet(missing);
+        for (std::size_t i = 0; i < found.size(); i++) {
+          sorted_values[positions[i]] = found[i];
+        }
+      }
+    }
+
+    // If a value is a tombstone, mark it as not present
+    std::vector<std::optional<V>> values(keys.size());
+    for (std::size_t i = 0; i < keys.size(); i++) {
+      std::size_t position =
+          std::lower_bound(sorted.begin(), sorted.end(), keys[i]) -
+          sorted.begin();
+      std::optional<V> val = sorted_values[position];
+      if (val.has_value() && val.value() != kTombstoneValue) {
+        values[i] = val;
+      }
+    }
+    return values;
+  }
+
   void Put(const K key, const K value) {
     if (!this->open) {
       throw DatabaseClosedException();
@@ -302,13 +996,7 @@ class KvStore::KvStoreImpl {
       throw OnlyTheDatabaseCanUseFunnyValuesException();
     }
 
-    try {
-      this->memtable.Put(key, value);
-    } catch (MemTableFullException& e) {
-      this->flush_memtable();
-      this->memtable.Clear();
-      this->memtable.Put(key, value);
-    }
+    this->write(key, value);
   }
 
   void Delete(const K key) {
@@ -316,15 +1004,63 @@ class KvStore::KvStoreImpl {
       throw DatabaseClosedException();
     }
 
-    try {
-      // No need to use Delete(), Put replaces the value if it was there.
-      this->memtable.Put(key, kTombstoneValue);
-    } catch (MemTableFullException& e) {
-      this->flush_memtable();
-      this->memtable.Clear();
-      this->memtable.Put(key, kTombstoneValue);
-    }
+    // No need to use Delete(), Put replaces the value if it was there.
+    this->write(key, kTombstoneValue);
   };
+
+  void Write(const WriteBatch& batch) {
+    if (!this->open) {
+      throw DatabaseClosedException();
+    }
+
+    this->write_batch(batch.Writes());
+  }
+
+  void BulkLoad(Cursor& pairs) {
+    if (!this->open) {
+      throw DatabaseClosedException();
+    }
+
+    if (!this->is_empty()) {
+      throw DatabaseNotEmptyException();
+    }
+
+    // Check all of the pairs before writing any of them
+    std::size_t count = KvStoreImpl::count_bulk_pairs(pairs);
+    if (count == 0) {
+      return;
+    }
+
+    // The run goes where compactions would have put it, so that it is only
+    // merged again once the levels above it fill up
+    std::size_t capacity = this->memtable->GetCapacity();
+    uint32_t level = this->bulk_load_level((count + capacity - 1) / capacity);
+    while (this->levels.size() <= level) {
+      this->levels.push_back(std::make_unique<LSMLevel>(
+          this->naming, this->tiers, this->levels.size(),
+          this->compaction_policy, capacity, this->manifest.value(),
+          this->buf.value(), *this->sstable_serializer, this->filter_tuning,
+          this->max_subcompactions));
+    }
+
+    uint32_t run_idx = this->manifest->NewRun();
+    std::shared_ptr<LSMRun> run = std::make_shared<LSMRun>(
+        this->naming, level, run_idx, this->tiers, capacity,
+        this->manifest.value(), this->buf.value(), *this->sstable_serializer,
+        *this->filter_serializer);
+    run->RegisterNewFiles(this->write_bulk_files(pairs, level, run_idx));
+    std::vector<std::shared_ptr<LSMRun>> overflow =
+        this->levels.at(level)->RegisterNewRun(std::move(run), std::nullopt);
+    assert(overflow.empty());
+
+    std::shared_ptr<const Version> next = this->snapshot_levels();
+    std::shared_ptr<const Version> previous;  // Dropped outside the lock
+    {
+      std::unique_lock<std::shared_mutex> lock(this->memtable_mutex);
+      previous = std::move(this->version);
+      this->version = std::move(next);
+    }
+  }
 };
 
 /* Connect the pImpl (pointer-to-implementation) to the actual class */
@@ -342,10 +1078,52 @@ void KvStore::Close() { return this->impl->Close(); }
 std::vector<std::pair<K, V>> KvStore::Scan(const K lower, const K upper) const {
   return this->impl->Scan(lower, upper);
 }
+std::unique_ptr<KvIterator> KvStore::NewIterator(const K lower,
+                                                 const K upper) const {
+  return this->impl->NewIterator(lower, upper);
+}
 std::optional<V> KvStore::Get(const K key) const {
   return this->impl->Get(key);
 }
+std::vector<std::optional<V>> KvStore::MultiGet(
+    const std::vector<K>& keys) const {
+  return this->impl->MultiGet(keys);
+}
 void KvStore::Put(const K key, const V value) {
   return this->impl->Put(key, value);
 }
 void KvStore::Delete(const K key) { return this->impl->Delete(key); }
+void KvStore::Write(const WriteBatch& batch) {
+  return this->impl->Write(batch);
+}
+void KvStore::BulkLoad(Cursor& pairs) { return this->impl->BulkLoad(pairs); }
+
+KvIterator::KvIterator(std::unique_ptr<KvIteratorImpl> impl)
+    : impl(std::move(impl)) {}
+KvIterator::~KvIterator() = default;
+void KvIterator::Seek(const K key) { return this->impl->Seek(key); }
+void KvIterator::Next() { return this->impl->Next(); }
+bool KvIterator::Valid() const { return this->impl->Valid(); }
+K KvIterator::Key() const { return this->impl->Key(); }
+V KvIterator::Value() const { return this->impl->Value(); }
+
+void WriteBatch::Put(const K key, const V value) {
+  if (value == kTombstoneValue) {
+    throw OnlyTheDatabaseCanUseFunnyValuesException();
+  }
+  this->writes.emplace_back(key, value);
+}
+void WriteBatch::Delete(const K key) {
+  this->writes.emplace_back(key, kTombstoneValue);
+}
+void WriteBatch::Clear() { this->writes.clear(); }
+std::size_t WriteBatch::Size() const { return this->writes.size(); }
+const std::vector<std::pair<K, V>>& WriteBatch::Writes() const {
+  return this->writes;
+}
+BufferPoolStats KvStore::BufferPoolStatistics() const {
+  return this->impl->BufferPoolStatistics();
+}
+FilterMemoryStats KvStore::FilterMemoryStatistics() const {
+  return this->impl->FilterMemoryStatistics();
+}
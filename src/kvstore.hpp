@@ -1,5 +1,6 @@
 #pragma once
 
+#include <chrono>
 #include <cstdint>
 #include <cstdlib>
 #include <exception>
@@ -11,6 +12,8 @@
 #include <vector>
 
 #include "constants.hpp"
+#include "cursor.hpp"
+#include "wal.hpp"
 
 class DatabaseClosedException : public std::exception {
  public:
@@ -32,8 +35,47 @@ class DatabaseInUseException : public std::exception {
   [[nodiscard]] const char* what() const noexcept override;
 };
 
+class WriteBatchTooLargeException : public std::exception {
+ public:
+  [[nodiscard]] const char* what() const noexcept override;
+};
+
+class DatabaseNotEmptyException : public std::exception {
+ public:
+  [[nodiscard]] const char* what() const noexcept override;
+};
+
+class BulkLoadNotSortedException : public std::exception {
+ public:
+  [[nodiscard]] const char* what() const noexcept override;
+};
+
 enum DataFileFormat { kBTree, kFlatSorted };
 
+enum WalSyncPolicy { kSyncEveryWrite, kSyncGroupCommit, kSyncNone };
+
+enum BufferPoolEviction { kEvictClock, kEvictLru, kEvictLruK, kEvict2Q };
+
+/**
+ * Counters of the page buffer since the database was opened. The hit ratio is
+ * hits / (hits + misses).
+ */
+struct BufferPoolStats {
+  uint64_t hits;
+  uint64_t misses;
+  uint64_t evictions;
+};
+
+/**
+ * The memory held by bloom filters kept outside of the page buffer, see
+ * `Options::resident_filter_bytes`.
+ */
+struct FilterMemoryStats {
+  std::size_t resident_bytes;
+  std::size_t budget_bytes;
+  uint64_t resident_files;
+};
+
 struct Options {
   /**
    * @brief The data directory to create the database in.
@@ -53,6 +95,17 @@ struct Options {
    */
   std::optional<std::size_t> memory_buffer_elements;
 
+  /**
+   * @brief How the memtable keeps its pairs in order. kRedBlackTree locks
+   * readers out for each write. kSkipList lets readers search it while it is
+   * written, but takes an element for every write, overwrites included.
+   * kVector appends writes unsorted and sorts them in parallel only to flush
+   * them, for bulk loads, as reads search every write in it.
+   *
+   * Defaults to kRedBlackTree.
+   */
+  std::optional<MemTableFormat> memtable_format;
+
   /**
    * @brief The initial amount of memory to allocate towards the page buffer.
    * Pages are usually around 4KB, though the metadata to allocate that is very
@@ -102,8 +155,241 @@ struct Options {
    * Defaults to true.
    */
   std::optional<bool> compaction;
+
+  /**
+   * @brief How the runs of each level are merged, only used with
+   * `compaction`.
+   *
+   * kTiering lets each level gather `tiers` runs before merging them into the
+   * next level, so a pair is rewritten once per level, but a lookup may read
+   * `tiers` runs of each level. kLeveling keeps every level a single run,
+   * merging each new run into it, for the fewest runs to read and the least
+   * space taken by out of date pairs, but rewrites a level every time it
+   * takes a run. kLazyLeveling tiers every level but the last, which is
+   * leveled. Most of the data is in the last level, so it has close to the
+   * write cost of tiering with close to the lookup and space costs of
+   * leveling.
+   *
+   * Defaults to kTiering.
+   */
+  std::optional<CompactionPolicy> compaction_policy;
+
+  /**
+   * @brief The most threads a single compaction is split over. The level is
+   * split into this many key ranges at the boundaries of its files, each
+   * merged into its own files of the new run on its own thread. The new run
+   * only becomes visible once every range is written.
+   *
+   * Defaults to 1, merging on the compacting thread alone.
+   */
+  std::optional<std::size_t> max_subcompactions;
+
+  /**
+   * @brief Whether to flush full memtables and compact levels on a dedicated
+   * background thread.
+   *
+   * When enabled, a full memtable is handed off as an immutable memtable and a
+   * fresh one takes its place, so `Put()` and `Delete()` only pay for the swap.
+   * A writer only waits if the previous memtable is still being flushed when
+   * the next one fills up. When disabled, the writer that fills the memtable
+   * performs the flush and any cascading compactions itself.
+   *
+   * Defaults to false.
+   */
+  std::optional<bool> background_compaction;
+
+  /**
+   * @brief Whether to log every write to a write-ahead log before it is
+   * acknowledged. The log is replayed into the memtable on `Open()`, so writes
+   * that were not yet flushed survive a crash. A log segment is deleted once
+   * the memtable holding its writes has been flushed.
+   *
+   * Defaults to false.
+   */
+  std::optional<bool> write_ahead_log;
+
+  /**
+   * @brief When writes to the write-ahead log are fsync()ed. Only used with
+   * `write_ahead_log`.
+   *
+   * kSyncEveryWrite syncs before every `Put()` and `Delete()` returns, so no
+   * acknowledged write is ever lost, but every write pays for a disk flush.
+   * A write that fails to be logged or synced throws a
+   * WriteAheadLogFailedException instead of returning, and so does every
+   * write after it, until the database is reopened.
+   *
+   * kSyncGroupCommit also syncs before every write returns, but writes logged
+   * while a sync runs wait for the next one and share it, and all of them
+   * throw if it fails. As the database takes writes from one thread at a time,
+   * its writes only share a sync when they come in one `Write()` batch.
+   *
+   * kSyncNone never syncs, leaving it to the operating system. Writes survive
+   * the process crashing, but not the machine.
+   *
+   * Defaults to kSyncGroupCommit.
+   */
+  std::optional<WalSyncPolicy> wal_sync;
+
+  /**
+   * @brief How long a group commit waits for more writes to join it before it
+   * syncs, see `wal_sync`. Larger windows amortize a single fsync() over more
+   * writes, at the cost of that much latency on every write.
+   *
+   * Defaults to 0.
+   */
+  std::optional<std::chrono::microseconds> wal_group_commit_window;
+
+  /**
+   * @brief The number of shards to split the page buffer into. Each shard has
+   * its own lock and its own share of `buffer_pages_maximum`, so readers on
+   * different threads rarely wait on each other for a page. A good value is
+   * around the number of threads reading from the database.
+   *
+   * Defaults to 1.
+   */
+  std::optional<std::size_t> buffer_pool_shards;
+
+  /**
+   * @brief Which page to evict from the page buffer when it is full.
+   *
+   * kEvictClock approximates LRU cheaply, but a long scan or compaction that
+   * reads every page once pushes the pages that point lookups keep using out
+   * of the buffer. kEvictLru evicts the least recently used page, with the same
+   * weakness. kEvictLruK (with K = 2) and kEvict2Q are scan-resistant: pages
+   * only used once are evicted before pages used again and again. Compare them
+   * for a workload with `BufferPoolStatistics()`.
+   *
+   * Defaults to kEvictClock.
+   */
+  std::optional<BufferPoolEviction> buffer_pool_eviction;
+
+  /**
+   * @brief The maximum number of files the page buffer keeps open to read
+   * pages from on a miss. Past that, the least recently used file is closed,
+   * and reopened when it is read from again. Should stay well under the
+   * process limit on open files.
+   *
+   * Defaults to 64.
+   */
+  std::optional<std::size_t> max_open_files;
+
+  /**
+   * @brief A budget of bytes of memory to hold bloom filters in, outside of
+   * the page buffer. Filters are loaded when the database is opened and as
+   * runs are created, until the budget is used up, and checking a resident
+   * filter never does I/O. Filters past the budget are read through the page
+   * buffer, competing with data pages. Each filter file takes a 4KB page per
+   * ~6500 keys, see `FilterMemoryStatistics()` for what is in use.
+   *
+   * Defaults to 0, every filter is read through the page buffer.
+   */
+  std::optional<std::size_t> resident_filter_bytes;
+
+  /**
+   * @brief The memory given to bloom filters, in bits per key, on average
+   * over the levels. More bits lower the false positive rate of the filters,
+   * and so the number of data pages a lookup of a missing key reads.
+   *
+   * Defaults to 5.
+   */
+  std::optional<double> filter_bits_per_entry;
+
+  /**
+   * @brief Size the bloom filters of each level as Monkey does: shallow
+   * levels, holding few keys, get more bits per key than the average, and the
+   * deepest level fewer. For the same memory, this minimizes the false
+   * positives of a point lookup summed over all levels. When false, every
+   * level gets `filter_bits_per_entry` bits per key.
+   *
+   * Defaults to true.
+   */
+  std::optional<bool> monkey_filters;
+};
+
+/**
+ * A group of puts and deletes, applied to a database at once with
+ * `KvStore::Write()`.
+ */
+class WriteBatch {
+ private:
+  std::vector<std::pair<K, V>> writes;
+
+ public:
+  /**
+   * @brief Add a put of a (key, value) pair to the batch. The same restriction
+   * on values as `KvStore::Put()` applies.
+   */
+  void Put(K key, V value);
+
+  /**
+   * @brief Add a delete of a key to the batch.
+   */
+  void Delete(K key);
+
+  /**
+   * @brief Remove all writes from the batch, to reuse it.
+   */
+  void Clear();
+
+  /**
+   * @brief Get the number of writes in the batch.
+   */
+  [[nodiscard]] std::size_t Size() const;
+
+  /**
+   * @brief Get the writes in the batch, as (key, value) pairs in the order
+   * they were added, deletes having the tombstone value.
+   */
+  [[nodiscard]] const std::vector<std::pair<K, V>>& Writes() const;
+};
+
+/**
+ * An iterator over the (key, value) pairs of a database in a key range, in key
+ * order, see `KvStore::NewIterator()`.
+ */
+class KvIterator {
+ public:
+  class KvIteratorImpl;
+  explicit KvIterator(std::unique_ptr<KvIteratorImpl> impl);
+  ~KvIterator();
+
+  /**
+   * @brief Move to the first pair in the range with a key of at least
+   * @param key.
+   */
+  void Seek(K key);
+
+  /**
+   * @brief Move to the next pair in the range. The iterator must be valid.
+   */
+  void Next();
+
+  /**
+   * @brief Whether the iterator is at a pair, false once it is past the end of
+   * the range.
+   */
+  [[nodiscard]] bool Valid() const;
+
+  /**
+   * @brief The key of the pair the iterator is at. The iterator must be valid.
+   */
+  [[nodiscard]] K Key() const;
+
+  /**
+   * @brief The value of the pair the iterator is at. The iterator must be
+   * valid.
+   */
+  [[nodiscard]] V Value() const;
+
+ private:
+  std::unique_ptr<KvIteratorImpl> impl;
 };
 
+/**
+ * A key-value store. Any number of threads may call `Get()` and `Scan()` at
+ * once, in parallel with a single thread calling `Put()` and `Delete()`. See
+ * docs/concurrency.md.
+ */
 class KvStore {
  private:
   class KvStoreImpl;
@@ -151,6 +437,19 @@ class KvStore {
    */
   [[nodiscard]] std::optional<V> Get(K key) const;
 
+  /**
+   * @brief Get the values of a batch of keys at once, as `Get()` would for
+   * each of them. The keys are looked up in key order, so that the keys that
+   * land in the same file share its filter and B-tree pages, and each file is
+   * searched once for the whole batch.
+   *
+   * @param keys The keys to search for, in any order and possibly repeated.
+   * @return std::vector<std::optional<V>> The value of each key, lined up with
+   * @param keys, std::nullopt for the keys that don't exist in the database.
+   */
+  [[nodiscard]] std::vector<std::optional<V>> MultiGet(
+      const std::vector<K>& keys) const;
+
   /**
    * @brief Get a vector of (key, value) pairs, sorted by key, where all keys k
    * are such that lower <= k <= upper. It is not required that `lower` or
@@ -163,9 +462,34 @@ class KvStore {
    */
   [[nodiscard]] std::vector<std::pair<K, V>> Scan(K lower, K upper) const;
 
+  /**
+   * @brief Get an iterator over the (key, value) pairs with keys k such that
+   * lower <= k <= upper, starting at the first of them. Pairs are read from
+   * the files as the iterator moves, so the first pair is available right
+   * away and the memory held does not grow with the range, only with the
+   * number of runs and the memtable.
+   *
+   * The iterator reads from a snapshot of the database taken when it is
+   * created, and doesn't see later writes. Runs compacted away are kept on
+   * disk until no iterator reads from them, so an iterator should not be held
+   * for longer than it is needed. Every iterator must be destroyed before the
+   * database is closed.
+   *
+   * @param lower The lower bound of the range.
+   * @param upper The upper bound of the range.
+   */
+  [[nodiscard]] std::unique_ptr<KvIterator> NewIterator(K lower,
+                                                        K upper) const;
+
   /**
    * @brief Put a (key, value) pair into the database. If the key already
-   * exists, overwrites the value.
+   * exists, overwrites the value. Throws a WriteAheadLogFailedException if the
+   * write could not be logged, see `Options::wal_sync`.
+   *
+   * Only one thread may write at a time, through `Put()`, `Delete()` and
+   * `Write()`, whatever the `Options::memtable_format`: the skiplist takes
+   * concurrent inserts only when a `MemTable` is used on its own, as rotating
+   * and flushing the memtable assume a single writer.
    *
    * @param key The key to insert.
    * @param value The value to insert.
@@ -179,4 +503,50 @@ class KvStore {
    * @param key The key to delete
    */
   void Delete(K key);
+
+  /**
+   * @brief Apply all writes of a batch, in order, as one write. Readers see
+   * either none or all of the batch, and with the write-ahead log on, it is
+   * logged, and recovered, whole. The batch is never split over two
+   * memtables: if it might not fit in what is left of the memtable, the
+   * memtable is flushed first.
+   *
+   * Throws a WriteBatchTooLargeException if the batch has more distinct keys
+   * than the memtable can hold, `Options::memory_buffer_elements`, without
+   * applying any of it. Throws a WriteAheadLogFailedException like `Put()`.
+   * Only one thread may write at a time, see `Put()`.
+   *
+   * @param batch The writes to apply.
+   */
+  void Write(const WriteBatch& batch);
+
+  /**
+   * @brief Load the pairs of @param pairs into an empty database without
+   * going through the memtable. They are written straight into the data and
+   * filter files of a single run, in the shallowest level whose runs are big
+   * enough to hold them, and registered in the manifest at once, so that
+   * nothing is compacted until later writes reach that level.
+   *
+   * The cursor is read twice from `Seek(0)`: once to check and count the
+   * pairs, and once to write them. Throws a BulkLoadNotSortedException if the
+   * keys are not strictly increasing, an
+   * OnlyTheDatabaseCanUseFunnyValuesException for a tombstone value, and a
+   * DatabaseNotEmptyException if anything was written before, all without
+   * writing anything.
+   *
+   * @param pairs The pairs to load, in increasing key order.
+   */
+  void BulkLoad(Cursor& pairs);
+
+  /**
+   * @brief The page buffer counters since `Open()`, to compare the eviction
+   * policies of `Options::buffer_pool_eviction` on a workload.
+   */
+  [[nodiscard]] BufferPoolStats BufferPoolStatistics() const;
+
+  /**
+   * @brief The memory held by resident bloom filters, see
+   * `Options::resident_filter_bytes`.
+   */
+  [[nodiscard]] FilterMemoryStats FilterMemoryStatistics() const;
 };
\ No newline at end of file
@@ -1,20 +1,118 @@
 #include "lsm.hpp"
 
+#include <algorithm>
+#include <atomic>
 #include <cassert>
 #include <cmath>
 #include <cstdint>
 #include <cstdlib>
 #include <iostream>
+#include <memory>
 #include <optional>
+#include <thread>
 
 #include "buf.hpp"
 #include "constants.hpp"
+#include "cursor.hpp"
 #include "filter.hpp"
 #include "manifest.hpp"
 #include "minheap.hpp"
 #include "naming.hpp"
 #include "sstable.hpp"
 
+/**
+ * @brief Sort the files of a run in key order. Their key ranges don't overlap,
+ * though the files written by parallel subcompactions are not numbered in key
+ * order.
+ */
+void sort_by_key(std::vector<FileMetadata>& files) {
+  std::sort(files.begin(), files.end(),
+            [](const FileMetadata& a, const FileMetadata& b) {
+              return a.minimum < b.minimum;
+            });
+}
+
+/**
+ * A cursor over the files of a run, in key order. It opens a cursor over one
+ * file at a time.
+ */
+class LSMRunCursor : public Cursor {
+ private:
+  const DbNaming& naming;
+  const int level;
+  const int run;
+  const Sstable& sstable_serializer;
+  const AccessHint hint;
+
+  // The files of the run, in key order, which never change once the run is
+  // registered
+  const std::vector<FileMetadata>& files;
+
+  std::size_t file;
+  std::unique_ptr<Cursor> cursor;
+
+  void open_file(std::size_t file) {
+    this->file = file;
+    this->cursor.reset();
+    if (file < this->files.size()) {
+      std::string name = data_file(this->naming, this->level, this->run,
+                                   this->files.at(file).id.intermediate);
+      this->cursor = this->sstable_serializer.NewCursor(name, this->hint);
+    }
+  }
+
+  /**
+   * @brief Move on to the next file, until the cursor is at a pair or past
+   * the last file.
+   */
+  void skip_used_files() {
+    while (this->cursor != nullptr && !this->cursor->Valid()) {
+      this->open_file(this->file + 1);
+      if (this->cursor != nullptr) {
+        this->cursor->Seek(this->files.at(this->file).minimum);
+      }
+    }
+  }
+
+ public:
+  LSMRunCursor(const DbNaming& naming, int level, int run,
+               const Sstable& sstable_serializer, AccessHint hint,
+               const std::vector<FileMetadata>& files)
+      : naming(naming),
+        level(level),
+        run(run),
+        sstable_serializer(sstable_serializer),
+        hint(hint),
+        files(files),
+        file(files.size()) {}
+
+  void Seek(K key) override {
+    // The first file that may hold a key of at least the key
+    auto file = std::lower_bound(
+        this->files.begin(), this->files.end(), key,
+        [](const FileMetadata& file, K key) { return file.maximum < key; });
+    this->open_file(file - this->files.begin());
+    if (this->cursor != nullptr) {
+      this->cursor->Seek(key);
+      this->skip_used_files();
+    }
+  }
+
+  void Next() override {
+    assert(this->Valid());
+    this->cursor->Next();
+    this->skip_used_files();
+  }
+
+  [[nodiscard]] bool Valid() const override {
+    return this->cursor != nullptr && this->cursor->Valid();
+  }
+
+  [[nodiscard]] K Key() const override { return this->cursor->Key(); }
+
+  [[nodiscard]] V Value() const override { return this->cursor->Value(); }
+};
+
 class LSMRun::LSMRunImpl {
  private:
   const DbNaming& naming;
@@ -27,7 +125,13 @@ class LSMRun::LSMRunImpl {
   Sstable& sstable_serializer;
   Filter& filter_serializer;
 
-  std::vector<int> files;
+  // The files in the run, in key order, with their key ranges. Kept in memory
+  // so that reads never need to consult the manifest.
+  std::vector<FileMetadata> files;
+
+  // Whether the run has been compacted away. Its files are deleted once the
+  // last reference to the run is dropped, as readers may still hold it.
+  bool obsolete{false};
 
  public:
   LSMRunImpl(const DbNaming& naming, int level, int run, uint8_t tiers,
@@ -42,13 +146,38 @@ class LSMRun::LSMRunImpl {
         sstable_serializer(sstable_serializer),
         filter_serializer(filter_serializer) {}
 
-  ~LSMRunImpl() = default;
+  ~LSMRunImpl() {
+    if (this->obsolete) {
+      this->delete_files();
+    }
+  }
 
   [[nodiscard]] int NextFile() const { return this->files.size(); }
 
+  [[nodiscard]] int Run() const { return this->run; }
+
+  [[nodiscard]] const std::vector<FileMetadata>& Files() const {
+    return this->files;
+  }
+
+  void DiscoverFiles() {
+    this->files.clear();
+    for (const auto& file : this->manifest.GetFiles(this->level)) {
+      if (file.id.run == static_cast<uint32_t>(this->run)) {
+        this->files.push_back(file);
+      }
+    }
+    sort_by_key(this->files);
+
+    for (const auto& file : this->files) {
+      auto filter_name = filter_file(this->naming, this->level, this->run,
+                                     file.id.intermediate);
+      this->filter_serializer.Load(filter_name);
+    }
+  }
+
   void RegisterNewFile(int intermediate, K minimum, K maximum) {
-    this->files.push_back(intermediate);
-    this->manifest.RegisterNewFiles({FileMetadata{
+    FileMetadata file{
         .id =
             SstableId{
                 .level = static_cast<uint32_t>(this->level),
@@ -57,19 +186,34 @@ class LSMRun::LSMRunImpl {
             },
         .minimum = minimum,
         .maximum = maximum,
-    }});
+    };
+    this->files.push_back(file);
+    this->manifest.RegisterNewFiles({file});
+  }
+
+  void RegisterNewFiles(std::vector<FileMetadata> files) {
+    sort_by_key(files);
+    this->files.insert(this->files.end(), files.begin(), files.end());
+    sort_by_key(this->files);
+    this->manifest.RegisterNewFiles(files);
+  }
+
+  void MarkObsolete() {
+    this->unregister_files();
+    this->obsolete = true;
   }
 
   [[nodiscard]] std::optional<V> Get(K key) const {
     for (const auto& file : this->files) {
-      bool in_range = this->manifest.InRange(this->level, this->run, file, key);
+      bool in_range = file.minimum <= key && key <= file.maximum;
       if (in_range) {
-        auto filter_name =
-            filter_file(this->naming, this->level, this->run, file);
+        auto filter_name = filter_file(this->naming, this->level, this->run,
+                                       file.id.intermediate);
 
         bool in_filter = this->filter_serializer.Has(filter_name, key);
         if (in_filter) {
-          auto name = data_file(this->naming, this->level, this->run, file);
+          auto name = data_file(this->naming, this->level, this->run,
+                                file.id.intermediate);
           std::optional<V> ret =
               this->sstable_serializer.GetFromFile(name, key);
           if (ret.has_value()) {
@@ -82,66 +226,111 @@ class LSMRun::LSMRunImpl {
     return std::nullopt;
   }
 
-  [[nodiscard]] std::vector<std::pair<K, V>> Scan(K lower, K upper) const {
-    // Find first file that may contain keys within the range
-    std::optional<uint32_t> intermediate =
-        this->manifest.FirstFileInRange(this->level, this->run, lower, upper);
-    if (!intermediate.has_value()) {
-      intermediate = 0;
+  [[nodiscard]] std::vector<std::optional<V>> MultiGet(
+      const std::vector<K>& keys) const {
+    std::vector<std::optional<V>> values(keys.size());
+
+    for (const auto& file : this->files) {
+      auto first = std::lower_bound(keys.begin(), keys.end(), file.minimum);
+      auto last = std::upper_bound(first, keys.end(), file.maximum);
+      if (first == last) {
+        continue;
+      }
+
+      // Probe the filter with all keys in range of the file at once, then
+      // search the file for the keys that passed, together
+      auto filter_name = filter_file(this->naming, this->level, this->run,
+                                     file.id.intermediate);
+      std::vector<K> in_range(first, last);
+      std::vector<bool> in_filter =
+          this->filter_serializer.MultiHas(filter_name, in_range);
+
+      std::vector<K> candidates;
+      std::vector<std::size_t> positions;
+      for (std::size_t i = 0; i < in_range.size(); i++) {
+        std::size_t position = (first - keys.begin()) + i;
+        if (in_filter[i] && !values[position].has_value()) {
+          candidates.push_back(in_range[i]);
+          positions.push_back(position);
+        }
+      }
+      if (candidates.empty()) {
+        continue;
+      }
+
+      auto name = data_file(this->naming, this->level, this->run,
+                            file.id.intermediate);
+      std::vector<std::optional<V>> found =
+          this->sstable_serializer.MultiGetFromFile(name, candidates);
+      for (std::size_t i = 0; i < found.size(); i++) {
+        if (found[i].has_value()) {
+          values[positions[i]] = found[i];
+        }
+      }
     }
 
+    return values;
+  }
+
+  [[nodiscard]] std::vector<std::pair<K, V>> Scan(K lower, K upper) const {
     std::vector<std::pair<K, V>> l{};
 
-    // Now that we have a starting file, we loop until we no longer get matches
-    bool matches = true;
-    while (matches) {
-      std::string sstable =
-          data_file(this->naming, this->level, this->run, intermediate.value());
+    // Files are in key order, so only the files overlapping the range are
+    // scanned, stopping at the first file past the range.
+    for (const auto& file : this->files) {
+      if (file.minimum > upper) {
+        break;
+      }
+      if (file.maximum < lower) {
+        continue;
+      }
+
+      // A scan reads each page once, so it should not evict the pages that
+      // point lookups keep using
+      std::string sstable = data_file(this->naming, this->level, this->run,
+                                      file.id.intermediate);
       std::vector<std::pair<K, V>> file_l =
-          this->sstable_serializer.ScanInFile(sstable, lower, upper);
+          this->sstable_serializer.ScanInFile(sstable, lower, upper,
+                                              kSequentialOnce);
       for (auto pair : file_l) {
         l.push_back(pair);
       }
-
-      // If:
-      // 1. the last file searched had some keys (they are sorted, so next files
-      //    will also not match),
-      // 2. there is another file to search, and
-      // 3. there are still more keys to find.
-      if (file_l.size() > 0 && intermediate.value() + 1 < this->files.size() &&
-          file_l.back().first < upper) {
-        intermediate.value()++;
-      } else {
-        matches = false;
-      }
     }
 
     return l;
   }
 
-  void Delete() {
-    for (const auto& intermediate : this->files) {
+  [[nodiscard]] std::unique_ptr<Cursor> NewCursor(AccessHint hint) const {
+    return std::make_unique<LSMRunCursor>(this->naming, this->level,
+                                          this->run, this->sstable_serializer,
+                                          hint, this->files);
+  }
+
+  void delete_files() {
+    for (const auto& file : this->files) {
+      uint32_t intermediate = file.id.intermediate;
       auto filter =
           filter_file(this->naming, this->level, this->run, intermediate);
       this->filter_serializer.Delete(filter);
 
       auto data = data_file(this->naming, this->level, this->run, intermediate);
       this->sstable_serializer.Delete(data);
+    }
+    this->files.clear();
+  }
 
+  void unregister_files() {
+    for (const auto& file : this->files) {
+      uint32_t intermediate = file.id.intermediate;
       this->manifest.RemoveFiles(
           {data_file(this->naming, this->level, this->run, intermediate),
            filter_file(this->naming, this->level, this->run, intermediate)});
     }
   }
 
-  std::vector<std::pair<K, V>> GetVectorFromFile(uint32_t file_num) {
-    if (file_num >= this->files.size()) {
-      return {};
-    }
-
-    std::string filename =
-        data_file(this->naming, this->level, this->run, file_num);
-    return this->sstable_serializer.Drain(filename);
+  void Delete() {
+    this->unregister_files();
+    this->delete_files();
   }
 };
 
@@ -156,150 +345,240 @@ LSMRun::~LSMRun() = default;
 [[nodiscard]] std::optional<V> LSMRun::Get(K key) const {
   return this->impl->Get(key);
 }
+[[nodiscard]] std::vector<std::optional<V>> LSMRun::MultiGet(
+    const std::vector<K>& keys) const {
+  return this->impl->MultiGet(keys);
+}
 std::vector<std::pair<K, V>> LSMRun::Scan(K lower, K upper) const {
   return this->impl->Scan(lower, upper);
 }
+[[nodiscard]] std::unique_ptr<Cursor> LSMRun::NewCursor(
+    AccessHint hint) const {
+  return this->impl->NewCursor(hint);
+}
 [[nodiscard]] int LSMRun::NextFile() const { return this->impl->NextFile(); }
+[[nodiscard]] int LSMRun::Run() const { return this->impl->Run(); }
+[[nodiscard]] const std::vector<FileMetadata>& LSMRun::Files() const {
+  return this->impl->Files();
+}
+void LSMRun::DiscoverFiles() { return this->impl->DiscoverFiles(); }
 void LSMRun::RegisterNewFile(int intermediate, K minimum, K maximum) {
   return this->impl->RegisterNewFile(intermediate, minimum, maximum);
 }
-void LSMRun::Delete() { return this->impl->Delete(); }
-std::vector<std::pair<K, V>> LSMRun::GetVectorFromFile(uint32_t file_num) {
-  return this->impl->GetVectorFromFile(file_num);
+void LSMRun::RegisterNewFiles(std::vector<FileMetadata> files) {
+  return this->impl->RegisterNewFiles(std::move(files));
 }
+void LSMRun::Delete() { return this->impl->Delete(); }
+void LSMRun::MarkObsolete() { return this->impl->MarkObsolete(); }
 
 class LSMLevel::LSMLevelImpl {
  private:
-  const uint64_t max_entries;
+  // The number of files a leveled level holds before it is merged into the
+  // next level, `tiers` times as many as the level above
+  const uint64_t max_files;
   const uint8_t tiers;
   const uint32_t level;
   const std::size_t memtable_capacity;
-  const bool is_final;
+  const CompactionPolicy policy;
+  // The most threads a compaction is split over
+  const std::size_t subcompactions;
   const DbNaming& dbname;
 
   Manifest& manifest;
   BufPool& buf;
   Sstable& sstable_serializer;
+  const FilterTuning filter_tuning;
   Filter filter_serializer;
 
-  std::vector<std::unique_ptr<LSMRun>> runs;
+  std::vector<std::shared_ptr<LSMRun>> runs;
+
+  /**
+   * @brief Merge the pairs of the runs @param inputs, oldest first, from
+   * @param lower up to, but not including, @param upper, or to the end if
+   * there is no upper bound. The pairs are written to new files of run
+   * @param target_run of the level, numbered from @param next_intermediate,
+   * which is shared with the other ranges merged at the same time.
+   *
+   * @return The files written, in key order, not registered yet.
+   */
+  std::vector<FileMetadata> merge_range(
+      const std::vector<std::shared_ptr<LSMRun>>& inputs, uint32_t target_run,
+      double bits_per_entry, std::atomic<uint32_t>& next_intermediate,
+      K lower, std::optional<K> upper) {
+    // Stream the runs through a loser tree, a page of each at a time. Later
+    // runs are newer, and the merge keeps only their pair for a key.
+    std::vector<std::unique_ptr<Cursor>> cursors;
+    cursors.reserve(inputs.size());
+    for (const auto& run : inputs) {
+      cursors.push_back(run->NewCursor(kSequentialOnce));
+    }
+    MergingCursor merged(std::move(cursors));
+    merged.Seek(lower);
+    auto in_range = [&] {
+      return merged.Valid() && (!upper.has_value() || merged.Key() < *upper);
+    };
+
+    std::vector<FileMetadata> files;
+    while (in_range()) {
+      uint32_t intermediate = next_intermediate++;
+
+      // Write the data file in the new level a page at a time, keeping only
+      // its keys for the corresponding Bloom Filter
+      std::string data_name =
+          data_file(this->dbname, this->level, target_run, intermediate);
+      std::unique_ptr<SstableBuilder> builder =
+          this->sstable_serializer.NewBuilder(data_name);
+      std::vector<K> keys;
+      keys.reserve(this->memtable_capacity);
+      for (; in_range() && keys.size() < this->memtable_capacity;
+           merged.Next()) {
+        builder->Add(merged.Key(), merged.Value());
+        keys.push_back(merged.Key());
+      }
+      builder->Finish();
+
+      std::string filter_name =
+          filter_file(this->dbname, this->level, target_run, intermediate);
+      this->filter_serializer.Create(filter_name, keys, bits_per_entry);
+
+      files.push_back(FileMetadata{
+          .id =
+              SstableId{
+                  .level = this->level,
+                  .run = target_run,
+                  .intermediate = intermediate,
+              },
+          .minimum = keys.front(),
+          .maximum = keys.back(),
+      });
+    }
+    return files;
+  }
 
-  std::unique_ptr<LSMRun> compact_runs(
-      std::optional<std::reference_wrapper<LSMLevel>> next_level) {
-    uint32_t run_in_next_level = 0;
-    if (next_level.has_value()) {
-      run_in_next_level = next_level.value().get().NextRun();
+  /**
+   * @brief Keys splitting the runs @param inputs into at most
+   * `subcompactions` key ranges to merge in parallel, each starting at the
+   * minimum of one of their files and holding about as many files as the
+   * others.
+   */
+  [[nodiscard]] std::vector<K> split_keys(
+      const std::vector<std::shared_ptr<LSMRun>>& inputs) const {
+    std::vector<K> minimums;
+    for (const auto& run : inputs) {
+      for (const auto& file : run->Files()) {
+        minimums.push_back(file.minimum);
+      }
+    }
+    std::sort(minimums.begin(), minimums.end());
+    minimums.erase(std::unique(minimums.begin(), minimums.end()),
+                   minimums.end());
+
+    std::vector<K> splits;
+    for (std::size_t i = 1; i < this->subcompactions; i++) {
+      std::size_t split = i * minimums.size() / this->subcompactions;
+      if (split > 0 && (splits.empty() || splits.back() < minimums[split])) {
+        splits.push_back(minimums[split]);
+      }
     }
+    return splits;
+  }
 
-    std::unique_ptr<LSMRun> new_run = std::make_unique<LSMRun>(
-        this->dbname, this->level + 1, run_in_next_level, this->tiers,
+  /**
+   * @brief Merge the runs @param inputs, oldest first, into a single new run
+   * of the level, and mark them obsolete. They may be runs of this level or
+   * of the level above. The key ranges between the split keys are merged on
+   * their own threads, and the files of all of them are registered together
+   * once they are all written.
+   */
+  std::shared_ptr<LSMRun> merge_runs(
+      const std::vector<std::shared_ptr<LSMRun>>& inputs) {
+    uint32_t target_run = this->manifest.NewRun();
+    std::shared_ptr<LSMRun> new_run = std::make_shared<LSMRun>(
+        this->dbname, this->level, target_run, this->tiers,
         this->memtable_capacity, this->manifest, this->buf,
         this->sstable_serializer, this->filter_serializer);
 
-    std::vector<std::pair<K, V>> buffer;
-    buffer.reserve(this->memtable_capacity);
-
-    // Index of current file to read from for each run
-    std::vector<int> file_number(this->runs.size(), 1);
-
-    // Contents of current file for each run
-    std::vector<std::vector<std::pair<K, V>>> file_contents(this->runs.size());
+    double bits_per_entry = this->filter_tuning.BitsPerEntry(
+        this->level, this->manifest.NumLevels(), this->tiers);
+    std::atomic<uint32_t> next_intermediate{0};
+
+    // Range i is [splits[i - 1], splits[i]), the first starting at 0 and the
+    // last unbounded. The first is merged on this thread.
+    std::vector<K> splits = this->split_keys(inputs);
+    std::vector<std::vector<FileMetadata>> range_files(splits.size() + 1);
+    auto merge = [&](std::size_t range) {
+      K lower = range == 0 ? 0 : splits[range - 1];
+      std::optional<K> upper = std::nullopt;
+      if (range < splits.size()) {
+        upper = splits[range];
+      }
+      range_files[range] = this->merge_range(
+          inputs, target_run, bits_per_entry, next_intermediate, lower, upper);
+    };
 
-    // Initialize heap from first key in each run
-    std::vector<K> first_keys(this->runs.size(), 0);
-    for (std::size_t run = 0; run < this->runs.size(); run++) {
-      std::vector<std::pair<K, V>> contents =
-          this->runs.at(run)->GetVectorFromFile(0);
-      file_contents.at(run) = contents;
-      first_keys.at(run) = contents.at(0).first;
+    std::vector<std::thread> workers;
+    for (std::size_t range = 1; range < range_files.size(); range++) {
+      workers.emplace_back(merge, range);
+    }
+    merge(0);
+    for (auto& worker : workers) {
+      worker.join();
     }
 
-    // Index of current position in file for each run
-    std::vector<int> file_cursor(this->runs.size(), 0);
-
-    MinHeap minheap(first_keys);
-
-    int min_run;
-    std::optional<std::pair<K, int>> min_pair;
-    std::optional<std::pair<K, int>> prev_min_pair = std::nullopt;
-
-    while (!minheap.IsEmpty()) {
-      while (!minheap.IsEmpty() && buffer.size() < this->memtable_capacity) {
-        min_pair = minheap.Extract();
-        min_run = min_pair->second;
-
-        // If new key matches previous key, it is out of date, so don't write it
-        if (prev_min_pair == std::nullopt ||
-            prev_min_pair->first != min_pair->first) {
-          std::pair<K, V> min_kv =
-              file_contents.at(min_run).at(file_cursor.at(min_run));
-          buffer.push_back(min_kv);
-        }
-
-        file_cursor.at(min_run)++;
-        // If file position has reached the end of the file, try to load the
-        // next file from the same run
-        if (file_cursor.at(min_run) >= file_contents.at(min_run).size()) {
-          file_cursor.at(min_run) = 0;
-          file_contents.at(min_run) = this->runs.at(min_run)->GetVectorFromFile(
-              file_number.at(min_run));
-          file_number.at(min_run)++;
-        }
-
-        if (!file_contents.at(min_run).empty()) {
-          // insert next key from this file
-          std::pair<K, V> next_key_from_file =
-              file_contents.at(min_run).at(file_cursor.at(min_run));
-          std::optional<std::pair<K, int>> next_pair_to_insert =
-              std::make_pair(next_key_from_file.first, min_run);
-          minheap.Insert(next_pair_to_insert.value());
-        }
-
-        prev_min_pair = min_pair;
-      }
-
-      // Flush buffer to file
-      if (!buffer.empty()) {
-        uint32_t intermediate = new_run->NextFile();
+    std::vector<FileMetadata> files;
+    for (const auto& range : range_files) {
+      files.insert(files.end(), range.begin(), range.end());
+    }
+    new_run->RegisterNewFiles(std::move(files));
 
-        // Create the data file in the new level
-        std::string data_name = data_file(this->dbname, this->level + 1,
-                                          run_in_next_level, intermediate);
-        this->sstable_serializer.Flush(data_name, buffer, true);
+    // Remove the data files after the compaction, once no reader holds them
+    for (const auto& run : inputs) {
+      run->MarkObsolete();
+    }
+    return new_run;
+  }
 
-        // Create the corresponding Bloom Filter
-        std::string filter_name = filter_file(this->dbname, this->level + 1,
-                                              run_in_next_level, intermediate);
-        this->filter_serializer.Create(filter_name, buffer);
+  [[nodiscard]] bool is_leveled(bool is_last) const {
+    return this->policy == kLeveling ||
+           (this->policy == kLazyLeveling && is_last);
+  }
 
-        new_run->RegisterNewFile(intermediate, buffer.front().first,
-                                 buffer.back().first);
-        buffer.clear();
-      }
+  [[nodiscard]] static uint64_t num_files(
+      const std::vector<std::shared_ptr<LSMRun>>& runs) {
+    uint64_t files = 0;
+    for (const auto& run : runs) {
+      // Files are numbered contiguously from 0 within a run
+      files += run->NextFile();
     }
+    return files;
+  }
 
-    // Remove the data files after the compaction
-    for (auto& run : this->runs) {
-      run->Delete();
-    }
+  /**
+   * @brief Hand every run of the level over to the next level, oldest first.
+   */
+  [[nodiscard]] std::vector<std::shared_ptr<LSMRun>> take_runs() {
+    std::vector<std::shared_ptr<LSMRun>> overflow = std::move(this->runs);
     this->runs.clear();
-    return new_run;
+    return overflow;
   }
 
  public:
-  LSMLevelImpl(const DbNaming& dbname, uint8_t tiers, int level, bool is_final,
-               std::size_t memtable_capacity, Manifest& manifest, BufPool& buf,
-               Sstable& sstable_serializer)
-      : max_entries(pow(2, level) * memtable_capacity),
+  LSMLevelImpl(const DbNaming& dbname, uint8_t tiers, int level,
+               CompactionPolicy policy, std::size_t memtable_capacity,
+               Manifest& manifest, BufPool& buf, Sstable& sstable_serializer,
+               FilterTuning filter_tuning, std::size_t subcompactions)
+      : max_files(pow(tiers, level + 1)),
         tiers(tiers),
         level(level),
         memtable_capacity(memtable_capacity),
-        is_final(is_final),
+        policy(policy),
+        subcompactions(std::max<std::size_t>(subcompactions, 1)),
         dbname(dbname),
         manifest(manifest),
         buf(buf),
         sstable_serializer(sstable_serializer),
-        filter_serializer(dbname, buf, 0) {}
+        filter_tuning(filter_tuning),
+        filter_serializer(dbname, buf, 0, filter_tuning.resident) {}
   ~LSMLevelImpl() = default;
 
   [[nodiscard]] uint32_t Level() const { return this->level; }
@@ -324,38 +603,106 @@ class LSMLevel::LSMLevelImpl {
     return minheap_merge(sorted_buffers);
   }
 
-  [[nodiscard]] int NextRun() { return this->runs.size(); }
+  void DiscoverRuns() {
+    this->runs.clear();
 
-  std::optional<std::unique_ptr<LSMRun>> RegisterNewRun(
-      std::unique_ptr<LSMRun> run,
+    // Run ids are handed out in the order the runs were created, across all
+    // levels, so sorting them puts the runs of the level oldest first.
+    std::vector<uint32_t> run_ids;
+    for (const auto& file : this->manifest.GetFiles(this->level)) {
+      run_ids.push_back(file.id.run);
+    }
+    std::sort(run_ids.begin(), run_ids.end());
+    run_ids.erase(std::unique(run_ids.begin(), run_ids.end()), run_ids.end());
+
+    for (uint32_t run : run_ids) {
+      auto lsm_run = std::make_shared<LSMRun>(
+          this->dbname, this->level, run, this->tiers, this->memtable_capacity,
+          this->manifest, this->buf, this->sstable_serializer,
+          this->filter_serializer);
+      lsm_run->DiscoverFiles();
+      this->runs.push_back(std::move(lsm_run));
+    }
+  }
+
+  [[nodiscard]] std::vector<std::shared_ptr<LSMRun>> Runs() const {
+    return this->runs;
+  }
+
+  std::vector<std::shared_ptr<LSMRun>> RegisterNewRun(
+      std::shared_ptr<LSMRun> run,
       std::optional<std::reference_wrapper<LSMLevel>> next_level) {
     this->runs.push_back(std::move(run));
+    if (!this->manifest.CompactionEnabled()) {
+      return {};
+    }
 
-    if (this->runs.size() == this->tiers &&
-        this->manifest.CompactionEnabled()) {
-      std::unique_ptr<LSMRun> new_run = this->compact_runs(next_level);
-      return std::make_optional<std::unique_ptr<LSMRun>>(std::move(new_run));
+    if (this->is_leveled(!next_level.has_value())) {
+      // Hand the runs straight to the next level once the level is full,
+      // rather than merging in place first
+      if (num_files(this->runs) > this->max_files) {
+        return this->take_runs();
+      }
+      if (this->runs.size() > 1) {
+        std::shared_ptr<LSMRun> merged = this->merge_runs(this->runs);
+        this->runs = {std::move(merged)};
+      }
+      return {};
     }
 
-    return std::nullopt;
+    if (this->runs.size() == this->tiers) {
+      return this->take_runs();
+    }
+    return {};
+  }
+
+  std::vector<std::shared_ptr<LSMRun>> MergeRuns(
+      std::vector<std::shared_ptr<LSMRun>> overflow,
+      std::optional<std::reference_wrapper<LSMLevel>> next_level) {
+    if (this->is_leveled(!next_level.has_value())) {
+      // The run of the level is older than those of the level above, and is
+      // merged with them in the same pass, so each pair is written once
+      overflow.insert(overflow.begin(), this->runs.begin(), this->runs.end());
+      this->runs.clear();
+      if (num_files(overflow) > this->max_files) {
+        return overflow;
+      }
+      this->runs.push_back(this->merge_runs(overflow));
+      return {};
+    }
+
+    this->runs.push_back(this->merge_runs(overflow));
+    if (this->runs.size() == this->tiers) {
+      return this->take_runs();
+    }
+    return {};
   }
 };
 LSMLevel::LSMLevel(const DbNaming& dbname, uint8_t tiers, int level,
-                   bool is_final, std::size_t memtable_capacity,
+                   CompactionPolicy policy, std::size_t memtable_capacity,
                    Manifest& manifest, BufPool& buf,
-                   Sstable& sstable_serializer)
-    : impl(std::make_unique<LSMLevelImpl>(dbname, tiers, level, is_final,
-                                          memtable_capacity, manifest, buf,
-                                          sstable_serializer)) {}
+                   Sstable& sstable_serializer, FilterTuning filter_tuning,
+                   std::size_t subcompactions)
+    : impl(std::make_unique<LSMLevelImpl>(
+          dbname, tiers, level, policy, memtable_capacity, manifest, buf,
+          sstable_serializer, filter_tuning, subcompactions)) {}
 LSMLevel::~LSMLevel() = default;
 
-[[nodiscard]] int LSMLevel::NextRun() const { return this->impl->NextRun(); }
-std::optional<std::unique_ptr<LSMRun>> LSMLevel::RegisterNewRun(
-    std::unique_ptr<LSMRun> run,
+void LSMLevel::DiscoverRuns() { return this->impl->DiscoverRuns(); }
+std::vector<std::shared_ptr<LSMRun>> LSMLevel::RegisterNewRun(
+    std::shared_ptr<LSMRun> run,
     std::optional<std::reference_wrapper<LSMLevel>> next_level) {
   return this->impl->RegisterNewRun(std::move(run), next_level);
 }
+std::vector<std::shared_ptr<LSMRun>> LSMLevel::MergeRuns(
+    std::vector<std::shared_ptr<LSMRun>> overflow,
+    std::optional<std::reference_wrapper<LSMLevel>> next_level) {
+  return this->impl->MergeRuns(std::move(overflow), next_level);
+}
 uint32_t LSMLevel::Level() const { return this->impl->Level(); }
+std::vector<std::shared_ptr<LSMRun>> LSMLevel::Runs() const {
+  return this->impl->Runs();
+}
 std::optional<V> LSMLevel::Get(K key) const { return this->impl->Get(key); }
 std::vector<std::pair<K, V>> LSMLevel::Scan(K lower, K upper) const {
   return this->impl->Scan(lower, upper);
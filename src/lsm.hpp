@@ -2,10 +2,13 @@
 
 #include <cstdint>
 #include <cstdlib>
+#include <memory>
 #include <optional>
+#include <vector>
 
 #include "buf.hpp"
 #include "constants.hpp"
+#include "cursor.hpp"
 #include "filter.hpp"
 #include "manifest.hpp"
 #include "naming.hpp"
@@ -39,6 +42,17 @@ class LSMRun {
    */
   [[nodiscard]] std::optional<V> Get(K key) const;
 
+  /**
+   * @brief Get() for a batch of keys. The filter and data file of each file in
+   * the run are searched once, for all of the keys in the file's range.
+   *
+   * @param keys The keys to search for, sorted and without duplicates.
+   * @return std::vector<std::optional<V>> The value of each key, lined up with
+   * @param keys, std::nullopt for the keys that aren't in the run.
+   */
+  [[nodiscard]] std::vector<std::optional<V>> MultiGet(
+      const std::vector<K>& keys) const;
+
   /**
    * @brief Get a vector of (key, value) pairs, sorted by key, where all keys k
    * are such that lower <= k <= upper. It is not required that `lower` or
@@ -51,6 +65,16 @@ class LSMRun {
    */
   [[nodiscard]] std::vector<std::pair<K, V>> Scan(K lower, K upper) const;
 
+  /**
+   * @brief Open a cursor over the pairs of the run, in key order. It reads one
+   * file at a time, and only the part of the file it is at. The run must
+   * outlive the cursor.
+   *
+   * @param hint How the pages read by the cursor are cached.
+   */
+  [[nodiscard]] std::unique_ptr<Cursor> NewCursor(
+      AccessHint hint = kSequentialOnce) const;
+
   /**
    * @brief Discover the files already in the filesystem.
    *
@@ -67,6 +91,17 @@ class LSMRun {
    */
   [[nodiscard]] int NextFile() const;
 
+  /**
+   * @brief The index of the run within its level.
+   */
+  [[nodiscard]] int Run() const;
+
+  /**
+   * @brief The files of the run, in key order. They never change once the run
+   * is registered.
+   */
+  [[nodiscard]] const std::vector<FileMetadata>& Files() const;
+
   /**
    * @brief Meant to be used during compaction (run creation), register a new
    * file to be managed by that run.
@@ -77,20 +112,24 @@ class LSMRun {
    */
   void RegisterNewFile(int intermediate, K minimum, K maximum);
 
+  /**
+   * @brief Register many new files at once, persisting them to the manifest in
+   * a single write. The files may come in any order, but their key ranges must
+   * not overlap those of the files already in the run, or each other.
+   */
+  void RegisterNewFiles(std::vector<FileMetadata> files);
+
   /**
    * @brief Delete all files that correspond to the run.
    */
   void Delete();
 
   /**
-   * @brief Get the contents of the file_numth file in this level as a vector
-   * of key-value pairs.
-   *
-   * @param run_num The index of the run to get.
-   * @param file_num The index of the file to get.
-   * @return The contents of the file as a vector of key-value pairs.
+   * @brief Mark the run as compacted away. It is removed from the manifest
+   * right away, but its files are only deleted when the run is destroyed, so
+   * that readers still holding the run can finish with it.
    */
-  std::vector<std::pair<K, V>> GetVectorFromFile(uint32_t file_num);
+  void MarkObsolete();
 
  private:
   class LSMRunImpl;
@@ -103,14 +142,20 @@ class LSMLevel {
    * @brief Create a new LSM level manager
    *
    * @param level The level, where 0 is the memtable, and 1 is the first file.
-   * @param is_final Important for Dostoevsky, where the final level is merged
-   * through levelling, but all others are merged through tiering.
+   * @param policy How the runs of the level are merged. The level learns
+   * whether it is the last one from `RegisterNewRun()`, as the last level
+   * changes when the tree grows.
    * @param memtable_capacity The size of the memtable, or level 0. Each level
-   * is 2x the size of the previous level.
+   * is `tiers` times the size of the previous level.
+   * @param filter_tuning How to size the filters of the runs the level merges,
+   * and where to hold them in memory.
+   * @param subcompactions The most threads a compaction of the level is split
+   * over, each merging its own key range.
    */
-  LSMLevel(const DbNaming& dbname, uint8_t tiers, int level, bool is_final,
-           std::size_t memtable_capacity, Manifest& manifest, BufPool& buf,
-           Sstable& sstable_serializer);
+  LSMLevel(const DbNaming& dbname, uint8_t tiers, int level,
+           CompactionPolicy policy, std::size_t memtable_capacity,
+           Manifest& manifest, BufPool& buf, Sstable& sstable_serializer,
+           FilterTuning filter_tuning, std::size_t subcompactions = 1);
   ~LSMLevel();
 
   /**
@@ -125,17 +170,42 @@ class LSMLevel {
    */
   void DiscoverRuns();
 
-  std::optional<std::unique_ptr<LSMRun>> RegisterNewRun(
-      std::unique_ptr<LSMRun> run,
+  /**
+   * @brief Get the runs currently in the level, oldest first. Runs are never
+   * modified once registered, so the returned runs can be read from other
+   * threads while the level keeps changing.
+   */
+  [[nodiscard]] std::vector<std::shared_ptr<LSMRun>> Runs() const;
+
+  /**
+   * @brief Add a new run, written into this level, to the level, the newest.
+   * Once a tiered level holds `tiers` runs, or a leveled level holds more
+   * files than it has room for, its runs overflow: they are taken out of the
+   * level unmerged and returned, oldest first, to be passed to `MergeRuns()`
+   * of the next level. A leveled level otherwise merges its runs into a single
+   * run in place.
+   *
+   * @param next_level The next level, std::nullopt if this is the last level.
+   * @return The runs that overflowed, empty if none did.
+   */
+  std::vector<std::shared_ptr<LSMRun>> RegisterNewRun(
+      std::shared_ptr<LSMRun> run,
       std::optional<std::reference_wrapper<LSMLevel>> next_level);
 
   /**
-   * @brief Returns the index of the next run. That is, if the level has two
-   * runs in it, this method returns `2`, as runs are 0-indexed.
+   * @brief Merge the runs that overflowed from the level above into a single
+   * new run of this level, the newest. A leveled level merges its own run into
+   * the same pass, so that the pairs are written once, and if they would not
+   * fit in the level, passes all of them on unmerged instead. Runs overflow
+   * from this level as they do in `RegisterNewRun()`.
    *
-   * Intended to be used during compaction and flushing into the next level.
+   * @param overflow The runs returned by the level above, oldest first.
+   * @param next_level The next level, std::nullopt if this is the last level.
+   * @return The runs that overflowed, empty if none did.
    */
-  [[nodiscard]] int NextRun() const;
+  std::vector<std::shared_ptr<LSMRun>> MergeRuns(
+      std::vector<std::shared_ptr<LSMRun>> overflow,
+      std::optional<std::reference_wrapper<LSMLevel>> next_level);
 
   /**
    * @brief Get a single value from the level by its key. Returns
@@ -26,6 +26,16 @@ class Manifest::ManifestHandleImpl {
 
   std::fstream file;
   std::vector<std::vector<FileMetadata>> levels;
+  // The id of the next run, in any level. Ids are never reused, so that the
+  // names of the files of a new run are never those of files still being read.
+  uint32_t next_run{0};
+
+  /**
+   * @brief Make sure `next_run` is past the run of @param file.
+   */
+  void skip_run(const FileMetadata& file) {
+    this->next_run = std::max(this->next_run, file.id.run + 1);
+  }
 
   uint64_t total_number_of_files() {
     uint64_t total = 0;
@@ -45,10 +55,11 @@ class Manifest::ManifestHandleImpl {
                         std::fstream::out | std::fstream::trunc);
 
     std::vector<uint64_t> page{};
-    page.resize(4);
+    page.resize(5);
     put_magic_numbers(page, FileType::kManifest);
     page[2] = this->levels.size();
     page[3] = this->total_number_of_files();
+    page[4] = this->next_run;
 
     for (std::size_t level = 0; level < this->levels.size(); level++) {
       uint64_t next_level = (static_cast<uint64_t>(level) << 32) |
@@ -93,9 +104,10 @@ class Manifest::ManifestHandleImpl {
 
     uint64_t total_levels = first_page[2];
     uint64_t total_files = first_page[3];
+    this->next_run = first_page[4];
     this->levels.resize(total_levels);
 
-    std::size_t data_size = (total_files * 3) + total_levels + 4;
+    std::size_t data_size = (total_files * 3) + total_levels + 5;
     std::vector<uint64_t> data;
     data.resize(data_size);
 
@@ -104,7 +116,7 @@ class Manifest::ManifestHandleImpl {
                     data_size * sizeof(uint64_t));
     assert(this->file.good());
 
-    uint64_t level_start = 4;
+    uint64_t level_start = 5;
     for (uint32_t level = 0; level < total_levels; level++) {
       uint32_t level_num = (data.at(level_start) >> 32);
       uint32_t level_files = (data.at(level_start) << 32) >> 32;
@@ -132,7 +144,7 @@ class Manifest::ManifestHandleImpl {
             .maximum = max,
         });
       }
-      level_start += (3 * level_files);
+      level_start += 1 + (3 * level_files);
     }
     this->file.close();
   }
@@ -148,7 +160,7 @@ class Manifest::ManifestHandleImpl {
         uint32_t run = parse_data_file_run(name);
         uint32_t intermediate = parse_data_file_intermediate(name);
         if (this->levels.size() <= level) {
-          this->levels.resize(level);
+          this->levels.resize(level + 1);
         }
 
         std::string entry_name = entry.path().filename().string();
@@ -162,6 +174,7 @@ class Manifest::ManifestHandleImpl {
             .minimum = this->serializer.GetMinimum(entry_name),
             .maximum = this->serializer.GetMaximum(entry_name),
         });
+        this->skip_run(this->levels.at(level).back());
       }
     }
   }
@@ -233,11 +246,14 @@ class Manifest::ManifestHandleImpl {
         this->levels.resize(file.id.level + 1);
       }
       this->levels.at(file.id.level).push_back(file);
+      this->skip_run(file);
     }
 
     this->to_file();
   }
 
+  [[nodiscard]] uint32_t NewRun() { return this->next_run++; }
+
   void RemoveFiles(std::vector<std::string> files) {
     for (auto& level : this->levels) {
       auto it = std::remove_if(level.begin(), level.end(), [&](auto& f1) {
@@ -253,24 +269,22 @@ class Manifest::ManifestHandleImpl {
     this->to_file();
   }
 
+  [[nodiscard]] std::vector<FileMetadata> GetFiles(uint32_t level) const {
+    if (level >= this->levels.size()) {
+      return {};
+    }
+    return this->levels.at(level);
+  }
+
   [[nodiscard]] int NumLevels() const { return this->levels.size(); }
 
   [[nodiscard]] int NumRuns(uint32_t level) const {
-    std::vector<int> unique_runs;
-    unique_runs.resize(this->tiers);
-
+    std::vector<uint32_t> runs;
     for (const auto& file : this->levels.at(level)) {
-      if (unique_runs.at(file.id.run) == 0) {
-        unique_runs.at(file.id.run) = 1;
-      }
-    }
-
-    int count = 0;
-    for (const auto& run_bit : unique_runs) {
-      count += run_bit;
+      runs.push_back(file.id.run);
     }
-
-    return count;
+    std::sort(runs.begin(), runs.end());
+    return std::unique(runs.begin(), runs.end()) - runs.begin();
   }
 
   [[nodiscard]] int NumFiles(uint32_t level, uint32_t run) const {
@@ -320,6 +334,11 @@ void Manifest::RemoveFiles(std::vector<std::string> filenames) {
   return this->impl->RemoveFiles(filenames);
 }
 
+uint32_t Manifest::NewRun() { return this->impl->NewRun(); }
+
+std::vector<FileMetadata> Manifest::GetFiles(uint32_t level) const {
+  return this->impl->GetFiles(level);
+}
 int Manifest::NumLevels() const { return this->impl->NumLevels(); };
 int Manifest::NumRuns(uint32_t level) const {
   return this->impl->NumRuns(level);
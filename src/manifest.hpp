@@ -49,6 +49,14 @@ class Manifest {
    */
   void RemoveFiles(std::vector<std::string> filenames);
 
+  /**
+   * @brief Take the id of a new run, in any level. Ids only grow, so a new
+   * run never reuses the file names of a run that was compacted away, even
+   * while readers still have its files open. The id is persisted with the
+   * next change to the manifest.
+   */
+  [[nodiscard]] uint32_t NewRun();
+
   /**
    * @brief For a Get(key) request, search for files in a level if that key is
    * in the files min/max range.
@@ -87,6 +95,14 @@ class Manifest {
                                                          uint32_t run, K lower,
                                                          K upper) const;
 
+  /**
+   * @brief Get the metadata of every file registered in a level, across all of
+   * its runs. Meant for discovering the levels on startup.
+   *
+   * @param level The level to list.
+   */
+  [[nodiscard]] std::vector<FileMetadata> GetFiles(uint32_t level) const;
+
   [[nodiscard]] int NumLevels() const;
   [[nodiscard]] int NumRuns(uint32_t level) const;
   [[nodiscard]] int NumFiles(uint32_t level, uint32_t run) const;
@@ -1,16 +1,27 @@
 #include "memtable.hpp"
 
 #include <algorithm>
+#include <array>
+#include <atomic>
 #include <cassert>
+#include <cstddef>
 #include <cstdint>
 #include <cstdlib>
+#include <deque>
 #include <exception>
+#include <functional>
 #include <iostream>
 #include <iterator>
+#include <limits>
 #include <memory>
+#include <mutex>
+#include <new>
 #include <optional>
+#include <random>
 #include <sstream>
 #include <string>
+#include <thread>
+#include <type_traits>
 #include <utility>
 #include <vector>
 
@@ -19,6 +30,9 @@
 
 enum Color { kRed = 0, kBlack = 1 };
 
+// The fewest pairs worth sorting on a thread of their own
+constexpr std::size_t kMinSortSlice = 16 * 1024;
+
 class RbNode;
 RbNode* nil_sentinel_node = nullptr;
 RbNode* nil_sentinel();
@@ -148,18 +162,110 @@ RbNode* nil_sentinel() {
   return nil_sentinel_node;
 }
 
+/**
+ * A bump allocator for the nodes of a memtable. Nodes are placed one after
+ * the other in blocks, and are only ever freed all at once by `Reset()`, which
+ * keeps the blocks to place the next nodes in. A memtable is filled, flushed
+ * and cleared over and over, so after the first fill it allocates nothing.
+ */
+class NodeArena {
+ private:
+  // The first block is small, for small memtables, and each is twice the size
+  // of the last, up to the largest.
+  static constexpr std::size_t kFirstBlockNodes = 64;
+  static constexpr std::size_t kMaxBlockNodes = 4096;
+
+  using Slot = std::aligned_storage_t<sizeof(RbNode), alignof(RbNode)>;
+  static_assert(std::is_trivially_destructible_v<RbNode>,
+                "Arena nodes are never destroyed");
+
+  std::vector<std::unique_ptr<Slot[]>> blocks;
+  std::vector<std::size_t> block_nodes;
+  // The block new nodes are placed in, and the nodes already placed in it
+  std::size_t block;
+  std::size_t used;
+
+ public:
+  NodeArena() : block(0), used(0) {}
+
+  RbNode* Allocate(K key, V value) {
+    if (this->block < this->blocks.size() &&
+        this->used == this->block_nodes[this->block]) {
+      this->block++;
+      this->used = 0;
+    }
+    if (this->block == this->blocks.size()) {
+      std::size_t nodes =
+          this->block_nodes.empty()
+              ? kFirstBlockNodes
+              : std::min(2 * this->block_nodes.back(), kMaxBlockNodes);
+      this->blocks.push_back(std::make_unique<Slot[]>(nodes));
+      this->block_nodes.push_back(nodes);
+    }
+    return new (&this->blocks[this->block][this->used++]) RbNode(key, value);
+  }
+
+  /**
+   * @brief Free every node at once, reusing their memory for the next nodes.
+   */
+  void Reset() {
+    this->block = 0;
+    this->used = 0;
+  }
+};
+
 const char* MemTableFullException::what() const noexcept {
   return "MemTable is full! Can not insert any more elements, please flush "
          "the contents into a file!";
 }
 
+/**
+ * The ways a memtable can keep its pairs in order, see the methods of
+ * `MemTable` for what each does.
+ */
 class MemTable::MemTableImpl {
+ public:
+  virtual ~MemTableImpl() = default;
+
+  /**
+   * @brief A table of the same format and capacity, with the same pairs.
+   */
+  [[nodiscard]] virtual std::unique_ptr<MemTableImpl> Clone() const = 0;
+
+  virtual void IncreaseCapacity(std::size_t capacity) = 0;
+  [[nodiscard]] virtual std::size_t GetCapacity() const = 0;
+  [[nodiscard]] virtual std::size_t Size() const = 0;
+  [[nodiscard]] virtual std::string Print() const = 0;
+  [[nodiscard]] virtual V* Get(K key) const = 0;
+  virtual std::optional<V> Put(K key, V value) = 0;
+  [[nodiscard]] virtual std::vector<std::pair<K, V>> Scan(
+      K lower_bound, K upper_bound) const = 0;
+  [[nodiscard]] virtual std::unique_ptr<std::vector<std::pair<K, V>>> ScanAll()
+      const = 0;
+  virtual V* Delete(K key) = 0;
+  virtual void Clear() = 0;
+
+ protected:
+  /**
+   * @brief Put all pairs of @param other into the table. The nodes of a table
+   * point into its own arena, so copies are made pair by pair.
+   */
+  void copy_pairs(const MemTableImpl& other) {
+    std::unique_ptr<std::vector<std::pair<K, V>>> pairs = other.ScanAll();
+    for (const auto& [key, value] : *pairs) {
+      this->Put(key, value);
+    }
+  }
+};
+
+class MemTable::RbTreeImpl : public MemTable::MemTableImpl {
  private:
   uint64_t capacity;
   uint64_t size_;
   std::optional<K> least_key_;
   std::optional<K> most_key_;
   RbNode* root;
+  NodeArena arena;
 
   /**
    * @brief Return a vector of pairs, sorted. All pairs (k, v) in
@@ -506,25 +612,34 @@ class MemTable::MemTableImpl {
   }
 
  public:
-  explicit MemTableImpl(uint64_t capacity) {
+  explicit RbTreeImpl(uint64_t capacity) {
     this->capacity = capacity;
     this->size_ = 0;
     this->root = nil_sentinel();
   }
 
-  MemTableImpl(const MemTableImpl& t) = default;
-  MemTableImpl& operator=(const MemTableImpl& t) = default;
+  [[nodiscard]] std::unique_ptr<MemTableImpl> Clone() const override {
+    auto copy = std::make_unique<RbTreeImpl>(this->capacity);
+    copy->copy_pairs(*this);
+    return copy;
+  }
 
-  void IncreaseCapacity(std::size_t capacity) {
+  void IncreaseCapacity(std::size_t capacity) override {
     assert(this->capacity <= capacity);
     this->capacity = capacity;
   }
 
-  [[nodiscard]] std::size_t GetCapacity() const { return this->capacity; }
+  [[nodiscard]] std::size_t GetCapacity() const override {
+    return this->capacity;
+  }
 
-  [[nodiscard]] std::string Print() const { return this->root->print(); }
+  [[nodiscard]] std::size_t Size() const override { return this->size_; }
 
-  [[nodiscard]] V* Get(const K key) const {
+  [[nodiscard]] std::string Print() const override {
+    return this->root->print();
+  }
+
+  [[nodiscard]] V* Get(const K key) const override {
     RbNode* node = rb_search(this->root, key);
     if (node->is_some()) {
       return node->value();
@@ -532,7 +647,7 @@ class MemTable::MemTableImpl {
     return nullptr;
   }
 
-  std::optional<V> Put(const K key, const V value) {
+  std::optional<V> Put(const K key, const V value) override {
     RbNode* preexisting_node = rb_search(this->root, key);
     if (preexisting_node->is_some()) {
       return std::make_optional(preexisting_node->replace_value(value));
@@ -549,15 +664,15 @@ class MemTable::MemTableImpl {
       this->most_key_ = key;
     }
 
-    auto* node = new RbNode(key, value);
+    RbNode* node = this->arena.Allocate(key, value);
     this->rb_insert(node);
     this->size_++;
 
     return std::nullopt;
   }
 
-  [[nodiscard]] std::vector<std::pair<K, V>> Scan(const K lower_bound,
-                                                  const K upper_bound) const {
+  [[nodiscard]] std::vector<std::pair<K, V>> Scan(
+      const K lower_bound, const K upper_bound) const override {
     std::vector<RbNode*> nodes =
         this->rb_in_order(this->root, lower_bound, upper_bound);
 
@@ -569,7 +684,8 @@ class MemTable::MemTableImpl {
     return pairs;
   }
 
-  [[nodiscard]] std::unique_ptr<std::vector<std::pair<K, V>>> ScanAll() const {
+  [[nodiscard]] std::unique_ptr<std::vector<std::pair<K, V>>> ScanAll()
+      const override {
     auto pairs = std::make_unique<std::vector<std::pair<K, V>>>();
     if (!this->least_key_.has_value() || !this->most_key_.has_value()) {
       return pairs;
@@ -585,42 +701,543 @@ class MemTable::MemTableImpl {
     return pairs;
   }
 
-  V* Delete(const K key) {
+  V* Delete(const K key) override {
     RbNode* node = rb_search(this->root, key);
 
     this->rb_delete(node);
 
+    // The node stays in the arena until the table is cleared, so the value
+    // can still be read through it
     V* ret = nullptr;
     if (node->is_some()) {
       ret = node->value();
     }
-    delete node;
 
     return ret;
   }
 
-  void Clear() {
-    for (RbNode* node :
-         this->rb_in_order(this->root, rb_minimum(this->root)->key(),
-                           rb_maximum(this->root)->key())) {
-      if (node == this->root) {
-        this->root = nil_sentinel();
+  void Clear() override {
+    this->arena.Reset();
+    this->root = nil_sentinel();
+    this->size_ = 0;
+    this->least_key_.reset();
+    this->most_key_.reset();
+  }
+};
+
+/**
+ * A node of the skiplist, followed in memory by the rest of its next pointers,
+ * one for each level it is linked into. Only the next pointers change once a
+ * node is linked, so readers need no lock to read the rest.
+ */
+struct SkipNode {
+  const K key;
+  V value;
+  // Newer writes of a key are ordered before older ones
+  const uint64_t sequence;
+  // Whether the write was a `Delete()`
+  const bool deleted;
+  std::atomic<SkipNode*> next[1];
+
+  SkipNode(K key, V value, uint64_t sequence, bool deleted, int height)
+      : key(key), value(value), sequence(sequence), deleted(deleted) {
+    for (int level = 0; level < height; level++) {
+      new (&this->next[level]) std::atomic<SkipNode*>(nullptr);
+    }
+  }
+
+  /**
+   * @brief The bytes taken by a node linked into @param height levels.
+   */
+  static std::size_t Bytes(int height) {
+    return sizeof(SkipNode) + (height - 1) * sizeof(std::atomic<SkipNode*>);
+  }
+
+  /**
+   * @brief Whether the node is ordered before a write of @param key with
+   * @param sequence.
+   */
+  [[nodiscard]] bool Before(K key, uint64_t sequence) const {
+    return this->key < key || (this->key == key && this->sequence > sequence);
+  }
+};
+
+/**
+ * A bump allocator that any number of threads may allocate from at once. An
+ * allocation is a single atomic add within the current block, only moving on
+ * to the next block takes the lock. As with the `NodeArena`, memory is only
+ * freed all at once by `Reset()`, which keeps the blocks.
+ */
+class ConcurrentArena {
+ private:
+  static constexpr std::size_t kBlockBytes = 64 * 1024;
+
+  struct Block {
+    std::unique_ptr<std::byte[]> data;
+    std::atomic<std::size_t> used;
+  };
+
+  // Guards `blocks` and `block`, to move on from a full block
+  std::mutex mutex;
+  std::vector<std::unique_ptr<Block>> blocks;
+  std::size_t block;
+  // The block allocations are taken from, nullptr before the first
+  std::atomic<Block*> current;
+
+ public:
+  ConcurrentArena() : block(0), current(nullptr) {}
+
+  void* Allocate(std::size_t bytes) {
+    bytes = (bytes + alignof(SkipNode) - 1) / alignof(SkipNode) *
+            alignof(SkipNode);
+    assert(bytes <= kBlockBytes);
+
+    while (true) {
+      Block* full = this->current.load(std::memory_order_acquire);
+      if (full != nullptr) {
+        std::size_t offset =
+            full->used.fetch_add(bytes, std::memory_order_relaxed);
+        if (offset + bytes <= kBlockBytes) {
+          return full->data.get() + offset;
+        }
+      }
+
+      // The first thread to find the block full moves on to the next one
+      std::lock_guard<std::mutex> lock(this->mutex);
+      if (this->current.load(std::memory_order_relaxed) != full) {
+        continue;
+      }
+      if (full != nullptr) {
+        this->block++;
+      }
+      if (this->block == this->blocks.size()) {
+        auto next = std::make_unique<Block>();
+        next->data = std::make_unique<std::byte[]>(kBlockBytes);
+        next->used = 0;
+        this->blocks.push_back(std::move(next));
+      }
+      this->current.store(this->blocks[this->block].get(),
+                          std::memory_order_release);
+    }
+  }
+
+  /**
+   * @brief Free every allocation at once, reusing the blocks for the next
+   * ones. Must not be called while any thread allocates.
+   */
+  void Reset() {
+    for (auto& block : this->blocks) {
+      block->used = 0;
+    }
+    this->block = 0;
+    this->current = this->blocks.empty() ? nullptr : this->blocks[0].get();
+  }
+};
+
+/**
+ * A skiplist ordered by key, then newest write first, that any number of
+ * threads may write at once while others read it. A write links its node into
+ * each of its levels with a compare-and-swap, the bottom level first, and
+ * searches again from where it was if another write got in first. Nodes are
+ * never changed or unlinked once they are linked, so writing a key that is
+ * already there links a newer node in front of the old one, and readers just
+ * follow the next pointers, without any lock or retry.
+ */
+class MemTable::SkipListImpl : public MemTable::MemTableImpl {
+ private:
+  // Each level links about a quarter of the nodes of the level below
+  static constexpr int kMaxHeight = 12;
+  static constexpr uint32_t kBranching = 4;
+
+  uint64_t capacity;
+  // Every write takes an element, reserved before its node is linked
+  std::atomic<std::size_t> size_;
+  std::atomic<uint64_t> sequence;
+  // The number of levels with any node in them
+  std::atomic<int> height;
+  ConcurrentArena arena;
+  // The head is ordered before every node. It is kept out of the arena to
+  // outlive `Clear()`.
+  std::unique_ptr<std::byte[]> head_memory;
+  SkipNode* head;
+
+  static int random_height() {
+    thread_local std::minstd_rand rng(std::random_device{}());
+    int height = 1;
+    while (height < kMaxHeight && rng() % kBranching == 0) {
+      height++;
+    }
+    return height;
+  }
+
+  /**
+   * @brief The last node at @param level ordered before a write of @param key
+   * with @param sequence, searching from @param node, which is before it.
+   * Sets @param next to the node it found after it. A write must link in
+   * front of that very node: loading the pointer again could pick up a node
+   * another write has linked in since, which may be ordered before the key.
+   */
+  static SkipNode* last_before(SkipNode* node, int level, K key,
+                               uint64_t sequence, SkipNode*& next) {
+    while (true) {
+      next = node->next[level].load(std::memory_order_acquire);
+      if (next == nullptr || !next->Before(key, sequence)) {
+        return node;
+      }
+      node = next;
+    }
+  }
+
+  /**
+   * @brief The newest write of the first key at least @param key, or nullptr
+   * if there is no such key.
+   */
+  [[nodiscard]] SkipNode* seek(K key) const {
+    SkipNode* node = this->head;
+    SkipNode* next = nullptr;
+    for (int level = this->height.load(std::memory_order_relaxed) - 1;
+         level >= 0; level--) {
+      node = last_before(node, level, key, std::numeric_limits<uint64_t>::max(),
+                         next);
+    }
+    return next;
+  }
+
+  /**
+   * @brief Link a node for a write of @param key, returning the node of the
+   * write it is linked in front of, if that was a write of the same key.
+   */
+  SkipNode* insert(K key, V value, bool deleted) {
+    if (this->size_.fetch_add(1) >= this->capacity) {
+      this->size_--;
+      throw MemTableFullException();
+    }
+
+    int height = random_height();
+    int list_height = this->height.load(std::memory_order_relaxed);
+    while (height > list_height &&
+           !this->height.compare_exchange_weak(list_height, height)) {
+    }
+    list_height = std::max(list_height, height);
+
+    uint64_t sequence = ++this->sequence;
+    auto* node = new (this->arena.Allocate(SkipNode::Bytes(height)))
+        SkipNode(key, value, sequence, deleted, height);
+
+    // Find the nodes it goes between in each level, from the top down
+    std::array<SkipNode*, kMaxHeight> prev{};
+    std::array<SkipNode*, kMaxHeight> next{};
+    SkipNode* before = this->head;
+    for (int level = list_height - 1; level >= 0; level--) {
+      before = last_before(before, level, key, sequence, next[level]);
+      prev[level] = before;
+    }
+
+    for (int level = 0; level < height; level++) {
+      node->next[level].store(next[level], std::memory_order_relaxed);
+      while (!prev[level]->next[level].compare_exchange_strong(
+          next[level], node, std::memory_order_release,
+          std::memory_order_acquire)) {
+        // Another write was linked in between, it is still after `prev`
+        prev[level] =
+            last_before(prev[level], level, key, sequence, next[level]);
+        node->next[level].store(next[level], std::memory_order_relaxed);
+      }
+    }
+
+    if (next[0] != nullptr && next[0]->key == key) {
+      return next[0];
+    }
+    return nullptr;
+  }
+
+ public:
+  explicit SkipListImpl(uint64_t capacity)
+      : capacity(capacity),
+        size_(0),
+        sequence(0),
+        height(1),
+        head_memory(
+            std::make_unique<std::byte[]>(SkipNode::Bytes(kMaxHeight))) {
+    this->head = new (this->head_memory.get())
+        SkipNode(0, 0, 0, false, kMaxHeight);
+  }
+
+  [[nodiscard]] std::unique_ptr<MemTableImpl> Clone() const override {
+    auto copy = std::make_unique<SkipListImpl>(this->capacity);
+    copy->copy_pairs(*this);
+    return copy;
+  }
+
+  void IncreaseCapacity(std::size_t capacity) override {
+    assert(this->capacity <= capacity);
+    this->capacity = capacity;
+  }
+
+  [[nodiscard]] std::size_t GetCapacity() const override {
+    return this->capacity;
+  }
+
+  [[nodiscard]] std::size_t Size() const override { return this->size_; }
+
+  [[nodiscard]] std::string Print() const override {
+    std::ostringstream os;
+    for (int level = this->height - 1; level >= 0; level--) {
+      os << level << ":";
+      for (SkipNode* node = this->head->next[level].load(); node != nullptr;
+           node = node->next[level].load()) {
+        os << " [" << node->key << "] "
+           << (node->deleted ? "deleted" : std::to_string(node->value));
+      }
+      os << '\n';
+    }
+    return os.str();
+  }
+
+  [[nodiscard]] V* Get(const K key) const override {
+    SkipNode* node = this->seek(key);
+    if (node == nullptr || node->key != key || node->deleted) {
+      return nullptr;
+    }
+    return &node->value;
+  }
+
+  std::optional<V> Put(const K key, const V value) override {
+    SkipNode* replaced = this->insert(key, value, false);
+    if (replaced == nullptr || replaced->deleted) {
+      return std::nullopt;
+    }
+    return replaced->value;
+  }
+
+  [[nodiscard]] std::vector<std::pair<K, V>> Scan(
+      const K lower_bound, const K upper_bound) const override {
+    std::vector<std::pair<K, V>> pairs;
+    SkipNode* node = this->seek(lower_bound);
+    while (node != nullptr && node->key <= upper_bound) {
+      // The first node of a key is its newest write, skip the older ones
+      if (!node->deleted) {
+        pairs.emplace_back(node->key, node->value);
       }
-      delete node;
+      K key = node->key;
+      do {
+        node = node->next[0].load(std::memory_order_acquire);
+      } while (node != nullptr && node->key == key);
     }
+    return pairs;
+  }
 
+  [[nodiscard]] std::unique_ptr<std::vector<std::pair<K, V>>> ScanAll()
+      const override {
+    return std::make_unique<std::vector<std::pair<K, V>>>(
+        this->Scan(0, std::numeric_limits<K>::max()));
+  }
+
+  V* Delete(const K key) override {
+    V* old = this->Get(key);
+    if (old == nullptr) {
+      return nullptr;
+    }
+    this->insert(key, 0, true);
+    return old;
+  }
+
+  void Clear() override {
+    this->arena.Reset();
+    for (int level = 0; level < kMaxHeight; level++) {
+      this->head->next[level] = nullptr;
+    }
     this->size_ = 0;
+    this->sequence = 0;
+    this->height = 1;
   }
 };
 
-MemTable::MemTable(uint64_t capacity) {
-  this->impl = std::make_unique<MemTableImpl>(capacity);
+void sort_last_writes(std::vector<std::pair<K, V>>& pairs,
+                      std::size_t threads) {
+  auto by_key = [](const std::pair<K, V>& a, const std::pair<K, V>& b) {
+    return a.first < b.first;
+  };
+  threads = std::max<std::size_t>(
+      1, std::min(threads, pairs.size() / kMinSortSlice));
+
+  // Run `work(i)` for each i in [0, tasks), all but the first on threads of
+  // their own
+  auto parallel = [](std::size_t tasks,
+                     const std::function<void(std::size_t)>& work) {
+    std::vector<std::thread> workers;
+    for (std::size_t task = 1; task < tasks; task++) {
+      workers.emplace_back(work, task);
+    }
+    work(0);
+    for (auto& worker : workers) {
+      worker.join();
+    }
+  };
+
+  // Each thread sorts a slice of its own, then neighbouring slices are
+  // merged, also in parallel, until a single slice is left. Both keep pairs
+  // of the same key in order.
+  std::vector<std::size_t> bounds;
+  for (std::size_t slice = 0; slice <= threads; slice++) {
+    bounds.push_back(slice * pairs.size() / threads);
+  }
+  auto begin = pairs.begin();
+  parallel(threads, [&](std::size_t slice) {
+    std::stable_sort(begin + bounds[slice], begin + bounds[slice + 1], by_key);
+  });
+  while (bounds.size() > 2) {
+    parallel((bounds.size() - 1) / 2, [&](std::size_t merge) {
+      std::inplace_merge(begin + bounds[2 * merge],
+                         begin + bounds[2 * merge + 1],
+                         begin + bounds[2 * merge + 2], by_key);
+    });
+    std::vector<std::size_t> merged;
+    for (std::size_t i = 0; i < bounds.size(); i += 2) {
+      merged.push_back(bounds[i]);
+    }
+    if ((bounds.size() - 1) % 2 == 1) {
+      merged.push_back(bounds.back());
+    }
+    bounds = std::move(merged);
+  }
+
+  // The last pair of each key is its newest write
+  std::size_t kept = 0;
+  for (std::size_t i = 0; i < pairs.size(); i++) {
+    if (i + 1 == pairs.size() || pairs[i + 1].first != pairs[i].first) {
+      pairs[kept++] = pairs[i];
+    }
+  }
+  pairs.resize(kept);
 }
 
-MemTable::MemTable(const MemTable& t) : impl(new MemTableImpl(*t.impl)) {}
+/**
+ * A memtable that appends every write to an array that takes the whole
+ * capacity up front, and only puts the writes in order when they are read.
+ * It does the least work for each write, for loads that don't read until
+ * they flush: the flush sorts the writes once, in parallel, keeping the last
+ * write of each key. A lookup searches every write, newest first, and a scan
+ * sorts the writes in its range.
+ */
+class MemTable::VectorImpl : public MemTable::MemTableImpl {
+ private:
+  uint64_t capacity;
+  std::vector<std::pair<K, V>> writes;
+  // The values removed by `Delete()`, for the pointers it returns
+  std::deque<V> deleted;
+
+  /**
+   * @brief The last write of each key in @param pairs, in key order.
+   */
+  static std::vector<std::pair<K, V>> last_writes(
+      std::vector<std::pair<K, V>> pairs) {
+    sort_last_writes(pairs, std::thread::hardware_concurrency());
+    return pairs;
+  }
+
+ public:
+  explicit VectorImpl(uint64_t capacity) : capacity(capacity) {
+    this->writes.reserve(capacity);
+  }
+
+  [[nodiscard]] std::unique_ptr<MemTableImpl> Clone() const override {
+    auto copy = std::make_unique<VectorImpl>(this->capacity);
+    copy->copy_pairs(*this);
+    return copy;
+  }
+
+  void IncreaseCapacity(std::size_t capacity) override {
+    assert(this->capacity <= capacity);
+    this->capacity = capacity;
+    this->writes.reserve(capacity);
+  }
+
+  [[nodiscard]] std::size_t GetCapacity() const override {
+    return this->capacity;
+  }
+
+  [[nodiscard]] std::size_t Size() const override {
+    return this->writes.size();
+  }
+
+  [[nodiscard]] std::string Print() const override {
+    std::ostringstream os;
+    for (const auto& [key, value] : this->writes) {
+      os << "[" << key << "] " << value << '\n';
+    }
+    return os.str();
+  }
+
+  [[nodiscard]] V* Get(const K key) const override {
+    for (auto it = this->writes.rbegin(); it != this->writes.rend(); it++) {
+      if (it->first == key) {
+        return const_cast<V*>(&it->second);
+      }
+    }
+    return nullptr;
+  }
+
+  std::optional<V> Put(const K key, const V value) override {
+    if (this->writes.size() == this->capacity) {
+      throw MemTableFullException();
+    }
+    this->writes.emplace_back(key, value);
+    return std::nullopt;
+  }
+
+  [[nodiscard]] std::vector<std::pair<K, V>> Scan(
+      const K lower_bound, const K upper_bound) const override {
+    std::vector<std::pair<K, V>> pairs;
+    for (const auto& pair : this->writes) {
+      if (pair.first >= lower_bound && pair.first <= upper_bound) {
+        pairs.push_back(pair);
+      }
+    }
+    return last_writes(std::move(pairs));
+  }
+
+  [[nodiscard]] std::unique_ptr<std::vector<std::pair<K, V>>> ScanAll()
+      const override {
+    return std::make_unique<std::vector<std::pair<K, V>>>(
+        last_writes(this->writes));
+  }
+
+  V* Delete(const K key) override {
+    V* old = this->Get(key);
+    if (old == nullptr) {
+      return nullptr;
+    }
+    this->deleted.push_back(*old);
+    this->writes.erase(
+        std::remove_if(this->writes.begin(), this->writes.end(),
+                       [key](const std::pair<K, V>& pair) {
+                         return pair.first == key;
+                       }),
+        this->writes.end());
+    return &this->deleted.back();
+  }
+
+  void Clear() override {
+    this->writes.clear();
+    this->deleted.clear();
+  }
+};
+
+MemTable::MemTable(uint64_t capacity, MemTableFormat format) {
+  if (format == kSkipList) {
+    this->impl = std::make_unique<SkipListImpl>(capacity);
+  } else if (format == kVector) {
+    this->impl = std::make_unique<VectorImpl>(capacity);
+  } else {
+    this->impl = std::make_unique<RbTreeImpl>(capacity);
+  }
+}
+
+MemTable::MemTable(const MemTable& t) : impl(t.impl->Clone()) {}
 
 MemTable& MemTable::operator=(const MemTable& t) {
-  *this->impl = *t.impl;
+  this->impl = t.impl->Clone();
   return *this;
 }
 
@@ -630,6 +1247,8 @@ void MemTable::IncreaseCapacity(std::size_t capacity) {
 
 std::size_t MemTable::GetCapacity() const { return this->impl->GetCapacity(); }
 
+std::size_t MemTable::Size() const { return this->impl->Size(); }
+
 std::string MemTable::Print() const { return this->impl->Print(); }
 
 V* MemTable::Get(const K key) const { return this->impl->Get(key); }
@@ -16,9 +16,19 @@ class MemTableFullException : public std::exception {
   [[nodiscard]] const char* what() const noexcept override;
 };
 
+/**
+ * @brief Sort @param pairs by key on up to @param threads threads, keeping
+ * only the last pair of each key, as the newest write of the key.
+ */
+void sort_last_writes(std::vector<std::pair<K, V>>& pairs,
+                      std::size_t threads);
+
 class MemTable {
  private:
   class MemTableImpl;
+  class RbTreeImpl;
+  class SkipListImpl;
+  class VectorImpl;
   std::unique_ptr<MemTableImpl> impl;
 
  public:
@@ -27,9 +37,18 @@ class MemTable {
    * parameter. All inserts beyond that size will throw an error, see the
    * `Put()` method for details.
    *
+   * A kSkipList memtable may be written by any number of threads at once,
+   * while others read it, and takes an element for every `Put()` and
+   * `Delete()`, even of a key it holds already. A kVector memtable takes an
+   * element for every `Put()` too, and only sorts its pairs when they are
+   * read, so `Put()` never returns the old value. It and a kRedBlackTree
+   * memtable must not be read or written while they are written, and a
+   * kRedBlackTree memtable only takes an element for each key.
+   *
    * @param capacity The size, in elements, of the memtable.
+   * @param format How the memtable keeps its pairs in order.
    */
-  explicit MemTable(uint64_t capacity);
+  explicit MemTable(uint64_t capacity, MemTableFormat format = kRedBlackTree);
   ~MemTable();
   MemTable(const MemTable&);
   MemTable& operator=(const MemTable&);
@@ -46,6 +65,11 @@ class MemTable {
    */
   [[nodiscard]] std::size_t GetCapacity() const;
 
+  /**
+   * @brief Get the number of elements in the memtable.
+   */
+  [[nodiscard]] std::size_t Size() const;
+
   /**
    * @brief Returns a string representation of the tree, meant only for
    * visualization purposes.
@@ -101,12 +125,14 @@ class MemTable {
    * there, or a pointer to the old value if it is.
    *
    * @param key The key to delete
-   * @return V* A pointer to the old value, or a nullptr
+   * @return V* A pointer to the old value, or a nullptr. It stays valid until
+   * the table is cleared.
    */
   V* Delete(K key);
 
   /**
-   * @brief Removes _all_ elements from the tree, leaving it empty!
+   * @brief Removes _all_ elements from the tree, leaving it empty! The memory
+   * of the elements is kept for the next inserts.
    */
   void Clear();
 };
@@ -1,6 +1,8 @@
 #include "minheap.hpp"
 
 #include <algorithm>
+#include <cassert>
+#include <cstdint>
 #include <cstdlib>
 #include <memory>
 #include <optional>
@@ -10,182 +12,173 @@
 #include "constants.hpp"
 
 std::vector<std::pair<K, V>> minheap_merge(
-    std::vector<std::vector<std::pair<K, V>>> &sorted_buffers) {
+    const std::vector<std::vector<std::pair<K, V>>> &sorted_buffers) {
+  std::size_t total = 0;
+  for (const auto &buf : sorted_buffers) {
+    total += buf.size();
+  }
   std::vector<std::pair<K, V>> result{};
+  result.reserve(total);
 
-  std::vector<std::vector<std::pair<K, V>>> nonempty_buffers;
-  std::vector<K> initial_keys{};
-  std::vector<size_t> cursors{};
-
-  for (auto const &buf : sorted_buffers) {
-    if (buf.size() > 0) {
-      nonempty_buffers.push_back(buf);
-      initial_keys.push_back(buf.at(0).first);
-      cursors.push_back(0);
+  // The position in each buffer, which are read in place
+  std::vector<std::size_t> cursors(sorted_buffers.size(), 0);
+  LoserTree tree(sorted_buffers.size());
+  for (std::size_t i = 0; i < sorted_buffers.size(); i++) {
+    if (!sorted_buffers[i].empty()) {
+      tree.Set(i, sorted_buffers[i].front().first);
     }
   }
+  tree.Build();
 
-  MinHeap heap(initial_keys);
-
-  std::optional<K> prev_key = std::nullopt;
-  std::optional<std::pair<K, size_t>> min;
+  while (!tree.Empty()) {
+    std::size_t buffer_idx = tree.Winner();
+    const std::vector<std::pair<K, V>> &buffer = sorted_buffers[buffer_idx];
+    const std::pair<K, V> &pair = buffer[cursors[buffer_idx]];
 
-  while (!heap.IsEmpty()) {
-    min = heap.Extract();
-    size_t buffer_idx = min->second;
-
-    if (!prev_key.has_value() || prev_key != min->first) {
-      int cursor_idx = cursors.at(buffer_idx);
-      std::vector<std::pair<K, V>> buffer = nonempty_buffers.at(buffer_idx);
-      auto pair = buffer.at(cursor_idx);
+    // The latest buffer comes first for a key, the others are out of date
+    if (result.empty() || result.back().first != pair.first) {
       result.push_back(pair);
     }
 
-    cursors.at(buffer_idx)++;
-
-    if (cursors.at(buffer_idx) < nonempty_buffers.at(buffer_idx).size()) {
-      std::pair<K, V> next =
-          nonempty_buffers.at(buffer_idx).at(cursors.at(buffer_idx));
-      heap.Insert(std::make_pair(next.first, buffer_idx));
+    cursors[buffer_idx]++;
+    if (cursors[buffer_idx] < buffer.size()) {
+      tree.ReplaceWinner(buffer[cursors[buffer_idx]].first);
+    } else {
+      tree.ReplaceWinner(std::nullopt);
     }
-
-    prev_key = min->first;
   }
 
   return result;
 }
 
-bool sortByKey(const std::pair<K, int> &a, const std::pair<K, int> &b) {
-  if (a.first == b.first) {
-    return a.second > b.second;
-  }
-  return a.first < b.first;
+LoserTree::LoserTree(std::size_t inputs)
+    : inputs(inputs),
+      keys(inputs, 0),
+      exhausted(inputs, 1),
+      losers(std::max<std::size_t>(inputs, 1)) {}
+
+bool LoserTree::beats(std::size_t a, std::size_t b) const {
+  // Exhausted inputs lose, then the smaller key wins, then the later input.
+  // Written without short circuits, so the compiler can avoid branching.
+  uint8_t done_a = this->exhausted[a];
+  uint8_t done_b = this->exhausted[b];
+  K key_a = this->keys[a];
+  K key_b = this->keys[b];
+  bool same = (done_a == done_b) & (key_a == key_b);
+  bool smaller = (done_a < done_b) | ((done_a == done_b) & (key_a < key_b));
+  return smaller | (same & (a > b));
 }
 
-class MinHeap::MinHeapImpl {
- private:
-  std::vector<std::pair<K, std::size_t>> heap;  // each key and its run number
+void LoserTree::Set(std::size_t input, std::optional<K> key) {
+  this->keys[input] = key.value_or(0);
+  this->exhausted[input] = !key.has_value();
+}
 
-  std::size_t GetSmallerIndex(std::size_t current_index,
-                              std::size_t new_index) {
-    // Assume current_index is always within vector, but new_index may not be
-    if (new_index >= this->heap.size()) {
-      return current_index;
-    }
+void LoserTree::Build() {
+  if (this->inputs <= 1) {
+    this->losers[0] = 0;
+    return;
+  }
 
-    if (this->heap.at(current_index).first < this->heap.at(new_index).first) {
-      return current_index;
+  // Play the matches bottom up, keeping the winner of each node to play the
+  // next match up
+  std::vector<std::size_t> winners(this->inputs);
+  auto winner_of = [&](std::size_t node) {
+    return node >= this->inputs ? node - this->inputs : winners[node];
+  };
+  for (std::size_t node = this->inputs - 1; node > 0; node--) {
+    std::size_t left = winner_of(2 * node);
+    std::size_t right = winner_of(2 * node + 1);
+    if (this->beats(left, right)) {
+      winners[node] = left;
+      this->losers[node] = right;
+    } else {
+      winners[node] = right;
+      this->losers[node] = left;
     }
+  }
+  this->losers[0] = winners[1];
+}
 
-    if (this->heap.at(new_index).first < this->heap.at(current_index).first) {
-      return new_index;
-    }
+bool LoserTree::Empty() const {
+  return this->inputs == 0 || this->exhausted[this->losers[0]] != 0;
+}
 
-    // If the keys are the same, return the newer version
-    if (this->heap.at(new_index).second > this->heap.at(current_index).second) {
-      return new_index;
-    }
-    return current_index;
-  }
+std::size_t LoserTree::Winner() const {
+  assert(!this->Empty());
+  return this->losers[0];
+}
 
-  void HeapifyUp(int index) {
-    if (index == 0) {
-      return;
-    }
-    int parent = (index - 1) / 2;
-    int smallest = index;
+K LoserTree::WinnerKey() const {
+  assert(!this->Empty());
+  return this->keys[this->losers[0]];
+}
 
-    smallest = GetSmallerIndex(smallest, parent);
+void LoserTree::ReplaceWinner(std::optional<K> key) {
+  std::size_t winner = this->losers[0];
+  this->Set(winner, key);
 
-    if (smallest == index) {
-      std::swap(this->heap.at(index), this->heap.at(parent));
-      this->HeapifyUp(parent);
+  // Only the matches on the path of the winner's leaf change
+  for (std::size_t node = (this->inputs + winner) / 2; node > 0; node /= 2) {
+    if (this->beats(this->losers[node], winner)) {
+      std::swap(this->losers[node], winner);
     }
   }
+  this->losers[0] = winner;
+}
 
-  void HeapifyDown(int index) {
-    int left = 2 * index + 1;
-    int right = 2 * index + 2;
-    int smallest = index;
-
-    smallest = GetSmallerIndex(smallest, left);
-    smallest = GetSmallerIndex(smallest, right);
+VectorCursor::VectorCursor(std::vector<std::pair<K, V>> pairs)
+    : pairs(std::move(pairs)), pair(this->pairs.size()) {}
 
-    if (smallest != index) {
-      std::swap(this->heap.at(index), this->heap.at(smallest));
-      this->HeapifyDown(smallest);
-    }
-  }
+void VectorCursor::Seek(const K key) {
+  auto first = std::lower_bound(
+      this->pairs.begin(), this->pairs.end(), key,
+      [](const std::pair<K, V>& pair, K key) { return pair.first < key; });
+  this->pair = first - this->pairs.begin();
+}
 
- public:
-  explicit MinHeapImpl(std::vector<K> initial_keys) {
-    this->heap.resize(initial_keys.size());
-    for (std::size_t i = 0; i < this->heap.size(); i++) {
-      this->heap.at(i) = std::make_pair(initial_keys.at(i), i);
-    }
-    std::sort(this->heap.begin(), this->heap.end(), sortByKey);
-  }
-  ~MinHeapImpl() = default;
+void VectorCursor::Next() {
+  assert(this->Valid());
+  this->pair++;
+}
 
-  void Insert(std::pair<K, int> new_pair) {
-    this->heap.emplace_back(new_pair);
-    if (this->heap.size() > 1) {
-      this->HeapifyUp(this->heap.size() - 1);
-    }
-  }
+bool VectorCursor::Valid() const { return this->pair < this->pairs.size(); }
 
-  std::optional<std::pair<K, int>> Extract() {
-    if (this->heap.empty()) {
-      return std::nullopt;
-    }
+K VectorCursor::Key() const { return this->pairs.at(this->pair).first; }
 
-    std::pair<K, int> min = heap.at(0);
-    this->heap.at(0) = this->heap.back();
-    this->heap.pop_back();
+V VectorCursor::Value() const { return this->pairs.at(this->pair).second; }
 
-    if (this->heap.size() > 1) {
-      this->HeapifyDown(0);
-    }
+MergingCursor::MergingCursor(std::vector<std::unique_ptr<Cursor>> cursors)
+    : cursors(std::move(cursors)), tree(this->cursors.size()) {}
 
-    return min;
+void MergingCursor::Seek(const K key) {
+  for (std::size_t i = 0; i < this->cursors.size(); i++) {
+    this->cursors[i]->Seek(key);
+    this->tree.Set(i, this->cursors[i]->Valid()
+                          ? std::make_optional(this->cursors[i]->Key())
+                          : std::nullopt);
   }
+  this->tree.Build();
+}
 
-  std::optional<std::pair<K, int>> InsertAndExtract(
-      std::pair<K, int> next_pair) {
-    if (this->heap.empty()) {
-      heap.emplace_back(next_pair);
-      return std::nullopt;
-    }
-
-    std::pair<K, int> previous_min = this->heap.at(0);
-    if (next_pair.first < previous_min.first) {
-      return next_pair;
-    }
-    if (next_pair.first == previous_min.first &&
-        next_pair.second > previous_min.second) {
-      return next_pair;
-    }
-    this->heap.at(0) = next_pair;
-    this->HeapifyDown(0);
-    return previous_min;
+void MergingCursor::Next() {
+  assert(this->Valid());
+
+  // Move every cursor at the current key past it, the older ones are shadowed
+  K key = this->tree.WinnerKey();
+  while (!this->tree.Empty() && this->tree.WinnerKey() == key) {
+    std::size_t i = this->tree.Winner();
+    this->cursors[i]->Next();
+    this->tree.ReplaceWinner(this->cursors[i]->Valid()
+                                 ? std::make_optional(this->cursors[i]->Key())
+                                 : std::nullopt);
   }
+}
 
-  bool IsEmpty() const { return this->heap.empty(); }
-  std::size_t Size() const { return this->heap.size(); }
-};
+bool MergingCursor::Valid() const { return !this->tree.Empty(); }
 
-MinHeap::MinHeap(const std::vector<K> &initial_keys)
-    : impl(std::make_unique<MinHeapImpl>(initial_keys)) {}
-MinHeap::~MinHeap() = default;
-bool MinHeap::IsEmpty() const { return this->impl->IsEmpty(); }
-std::optional<std::pair<K, std::size_t>> MinHeap::Extract() {
-  return this->impl->Extract();
-}
-std::size_t MinHeap::Size() const { return this->impl->Size(); }
-std::optional<std::pair<K, std::size_t>> MinHeap::InsertAndExtract(
-    std::pair<K, std::size_t> next_pair) {
-  return this->impl->InsertAndExtract(next_pair);
-}
-void MinHeap::Insert(std::pair<K, std::size_t> next_pair) {
-  return this->impl->Insert(next_pair);
+K MergingCursor::Key() const { return this->tree.WinnerKey(); }
+
+V MergingCursor::Value() const {
+  return this->cursors[this->tree.Winner()]->Value();
 }
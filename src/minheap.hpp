@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cstdint>
 #include <cstdlib>
 #include <memory>
 #include <optional>
@@ -7,6 +8,7 @@
 #include <vector>
 
 #include "constants.hpp"
+#include "cursor.hpp"
 
 /**
  * @brief Merge a vector of sorted buffers. The semantics are: The buffers that
@@ -18,51 +20,107 @@
  * @return std::vector<std::pair<K, V>>
  */
 std::vector<std::pair<K, V>> minheap_merge(
-    std::vector<std::vector<std::pair<K, V>>>& sorted_buffers);
+    const std::vector<std::vector<std::pair<K, V>>>& sorted_buffers);
+
+/**
+ * A tournament tree of losers over k sorted inputs. It picks the input with
+ * the smallest key, the one with the HIGHER index for equal keys, as in
+ * `minheap_merge()`. Replacing the winner's key replays a single leaf-to-root
+ * path, about log2(k) comparisons against the losers stored along it, and
+ * nothing is allocated after construction.
+ */
+class LoserTree {
+ private:
+  std::size_t inputs;
+
+  // The current key of each input, and whether it is exhausted, side by side
+  // so that a match reads two contiguous arrays
+  std::vector<K> keys;
+  std::vector<uint8_t> exhausted;
+
+  // The loser of the match at each internal node, 1 to k - 1, and the overall
+  // winner at 0. Leaf i is node k + i.
+  std::vector<std::size_t> losers;
+
+  [[nodiscard]] bool beats(std::size_t a, std::size_t b) const;
 
-class MinHeap {
  public:
   /**
-   * @brief Construct a minheap to store the next key from a set of LSMRuns.
-   * @param initial_keys The initial keys to add to the minheap.
-   * Assumes each key's index in the initial_keys vector is equal to the index
-   * of that key's run in its LSMLevel.
+   * @brief Construct a tree over @param inputs inputs, all of them exhausted
+   * until they are given a key with `Set()` and the tree is built.
    */
-  explicit MinHeap(const std::vector<K>& initial_keys);
-  ~MinHeap();
+  explicit LoserTree(std::size_t inputs);
 
   /**
-   * @brief
-   * @param
+   * @brief Set the key of @param input, without replaying any match. Call
+   * `Build()` once all keys are set.
    */
-  bool IsEmpty() const;
+  void Set(std::size_t input, std::optional<K> key);
 
   /**
-   * @brief
-   * @param
+   * @brief Play every match from scratch, in k - 1 comparisons.
    */
-  [[nodiscard]] std::optional<std::pair<K, std::size_t>> Extract();
+  void Build();
 
-  [[nodiscard]] std::size_t Size() const;
+  /**
+   * @brief Whether every input is exhausted.
+   */
+  [[nodiscard]] bool Empty() const;
 
   /**
-   * @brief Insert a key and extract the previous minumum
-   *
-   * @param key The key to insert
-   * return
+   * @brief The input with the smallest key. The tree must not be empty.
    */
-  [[nodiscard]] std::optional<std::pair<K, std::size_t>> InsertAndExtract(
-      std::pair<K, std::size_t> next_pair);
+  [[nodiscard]] std::size_t Winner() const;
 
   /**
-   * @brief Insert a key
-   *
-   * @param key The key to insert
-   * return
+   * @brief The smallest key. The tree must not be empty.
    */
-  void Insert(std::pair<K, std::size_t> next_pair);
+  [[nodiscard]] K WinnerKey() const;
 
+  /**
+   * @brief Give the winner its next key, or std::nullopt if it is exhausted,
+   * and replay its matches to find the new winner.
+   */
+  void ReplaceWinner(std::optional<K> key);
+};
+
+/**
+ * A cursor over a sorted buffer, which it owns.
+ */
+class VectorCursor : public Cursor {
  private:
-  class MinHeapImpl;
-  const std::unique_ptr<MinHeapImpl> impl;
+  const std::vector<std::pair<K, V>> pairs;
+  std::size_t pair;
+
+ public:
+  explicit VectorCursor(std::vector<std::pair<K, V>> pairs);
+
+  void Seek(K key) override;
+  void Next() override;
+  [[nodiscard]] bool Valid() const override;
+  [[nodiscard]] K Key() const override;
+  [[nodiscard]] V Value() const override;
+};
+
+/**
+ * A cursor merging sorted cursors, with the same semantics as
+ * `minheap_merge()`: for a key in more than one of them, the pair of the
+ * cursor that comes LATER wins, and the others are skipped. It holds only the
+ * cursors and one key of each.
+ */
+class MergingCursor : public Cursor {
+ private:
+  std::vector<std::unique_ptr<Cursor>> cursors;
+
+  // The key of each cursor, std::nullopt once it is no longer valid
+  LoserTree tree;
+
+ public:
+  explicit MergingCursor(std::vector<std::unique_ptr<Cursor>> cursors);
+
+  void Seek(K key) override;
+  void Next() override;
+  [[nodiscard]] bool Valid() const override;
+  [[nodiscard]] K Key() const override;
+  [[nodiscard]] V Value() const override;
 };
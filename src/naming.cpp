@@ -79,6 +79,19 @@ int parse_filter_file_intermediate(const std::string& filename) {
   return level;
 }
 
+std::string wal_file(const DbNaming& naming, uint64_t segment) {
+  return naming.dirpath / (naming.name + ".WAL.S" + std::to_string(segment));
+}
+
+uint64_t parse_wal_file_segment(const std::string& filename) {
+  std::smatch m;
+  std::regex_match(filename, m, std::regex(R"(^.*\.WAL\.S(\d+)$)"));
+  assert(m.size() == 2);
+
+  uint64_t segment = std::stoull(m[1].str());
+  return segment;
+}
+
 std::string lock_file(const DbNaming& naming) {
   return naming.dirpath / (naming.name + ".LOCK");
 }
\ No newline at end of file
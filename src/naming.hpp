@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cstdint>
 #include <filesystem>
 #include <string>
 
@@ -22,4 +23,7 @@ int parse_filter_file_level(const std::string& filename);
 int parse_filter_file_run(const std::string& filename);
 int parse_filter_file_intermediate(const std::string& filename);
 
+std::string wal_file(const DbNaming& naming, uint64_t segment);
+uint64_t parse_wal_file_segment(const std::string& filename);
+
 std::string lock_file(const DbNaming& naming);
\ No newline at end of file
@@ -1,6 +1,8 @@
 #pragma once
 
+#include <cstddef>
 #include <cstdint>
+#include <memory>
 #include <optional>
 #include <string>
 #include <utility>
@@ -8,6 +10,7 @@
 
 #include "buf.hpp"
 #include "constants.hpp"
+#include "cursor.hpp"
 
 struct SstableId {
   uint32_t level;
@@ -15,6 +18,32 @@ struct SstableId {
   uint32_t intermediate;
 };
 
+/**
+ * Writes a data file a page at a time, from pairs given in increasing key
+ * order, so that a file can be written without holding all of its pairs.
+ */
+class SstableBuilder {
+ public:
+  virtual ~SstableBuilder() = default;
+
+  /**
+   * @brief Append a pair to the file. The key must be larger than the key of
+   * every pair added before it.
+   */
+  virtual void Add(K key, V value) = 0;
+
+  /**
+   * @brief The number of pairs added so far.
+   */
+  [[nodiscard]] virtual std::size_t Size() const = 0;
+
+  /**
+   * @brief Write the last page and the metadata of the file. The file can be
+   * read once this returns, and no pairs can be added after it.
+   */
+  virtual void Finish() = 0;
+};
+
 class Sstable {
  public:
   virtual ~Sstable() = default;
@@ -31,6 +60,14 @@ class Sstable {
   virtual void Flush(std::string& filename, std::vector<std::pair<K, V>>& pairs,
                      bool truncate = false) const = 0;
 
+  /**
+   * @brief Start a new file in the data directory with name @param filename,
+   * truncating it if it exists. The file is the same as one `Flush()` would
+   * write from the pairs added to the builder.
+   */
+  virtual std::unique_ptr<SstableBuilder> NewBuilder(
+      std::string& filename) const = 0;
+
   /**
    * @brief Get a value from a file, or std::nullopt if it doesn't exist.
    *
@@ -40,16 +77,38 @@ class Sstable {
    */
   virtual std::optional<V> GetFromFile(std::string& filename, K key) const = 0;
 
+  /**
+   * @brief Get the values of many keys from a file at once. The file is
+   * searched once for the whole batch, reading each of its pages at most once.
+   *
+   * @param keys The keys to search for, sorted and without duplicates.
+   * @return std::vector<std::optional<V>> The value of each key, lined up with
+   * @param keys, std::nullopt for the keys that aren't in the file.
+   */
+  virtual std::vector<std::optional<V>> MultiGetFromFile(
+      std::string& filename, const std::vector<K>& keys) const = 0;
+
   /**
    * @brief Scan keys in range [lower, upper] from @param file.
    *
    * @param file The file to scan in
    * @param lower The lower bound of the scan
    * @param upper The upper bound of the scan
+   * @param hint How the pages read by the scan are cached
    * @return std::vector<std::pair<K, V>>
    */
-  virtual std::vector<std::pair<K, V>> ScanInFile(std::string& filename,
-                                                  K lower, K upper) const = 0;
+  virtual std::vector<std::pair<K, V>> ScanInFile(
+      std::string& filename, K lower, K upper,
+      AccessHint hint = kReuse) const = 0;
+
+  /**
+   * @brief Open a cursor over the pairs of @param file, reading only the part
+   * of the file it is at. The file must outlive the cursor.
+   *
+   * @param hint How the pages read by the cursor are cached
+   */
+  virtual std::unique_ptr<Cursor> NewCursor(
+      std::string& filename, AccessHint hint = kSequentialOnce) const = 0;
 
   /**
    * @brief Get the minimum key in the file. Assumes file is a datafile.
@@ -62,7 +121,9 @@ class Sstable {
   virtual K GetMaximum(std::string& filename) const = 0;
 
   /**
-   * @brief Drain the file into a vector of key-value pairs.
+   * @brief Drain the file into a vector of key-value pairs. The file is read
+   * once with kSequentialOnce, leaving the buffer pool to the pages of point
+   * lookups.
    */
   virtual std::vector<std::pair<K, V>> Drain(std::string& filename) const = 0;
 
@@ -83,9 +144,17 @@ class SstableNaive : public Sstable {
   SstableNaive(BufPool& buffer_pool);
   void Flush(std::string& filename, std::vector<std::pair<K, V>>& pairs,
              bool truncate = false) const override;
+  std::unique_ptr<SstableBuilder> NewBuilder(
+      std::string& filename) const override;
   std::optional<V> GetFromFile(std::string& filename, K key) const override;
-  std::vector<std::pair<K, V>> ScanInFile(std::string& filename, K lower,
-                                          K upper) const override;
+  std::vector<std::optional<V>> MultiGetFromFile(
+      std::string& filename, const std::vector<K>& keys) const override;
+  std::vector<std::pair<K, V>> ScanInFile(
+      std::string& filename, K lower, K upper,
+      AccessHint hint = kReuse) const override;
+  std::unique_ptr<Cursor> NewCursor(
+      std::string& filename,
+      AccessHint hint = kSequentialOnce) const override;
   K GetMinimum(std::string& filename) const override;
   K GetMaximum(std::string& filename) const override;
   std::vector<std::pair<K, V>> Drain(std::string& filename) const override;
@@ -100,9 +169,17 @@ class SstableBTree : public Sstable {
   SstableBTree(BufPool& buffer_pool);
   void Flush(std::string& filename, std::vector<std::pair<K, V>>& pairs,
              bool truncate = false) const override;
+  std::unique_ptr<SstableBuilder> NewBuilder(
+      std::string& filename) const override;
   std::optional<V> GetFromFile(std::string& filename, K key) const override;
-  std::vector<std::pair<K, V>> ScanInFile(std::string& filename, K lower,
-                                          K upper) const override;
+  std::vector<std::optional<V>> MultiGetFromFile(
+      std::string& filename, const std::vector<K>& keys) const override;
+  std::vector<std::pair<K, V>> ScanInFile(
+      std::string& filename, K lower, K upper,
+      AccessHint hint = kReuse) const override;
+  std::unique_ptr<Cursor> NewCursor(
+      std::string& filename,
+      AccessHint hint = kSequentialOnce) const override;
   K GetMinimum(std::string& filename) const override;
   K GetMaximum(std::string& filename) const override;
   std::vector<std::pair<K, V>> Drain(std::string& filename) const override;
@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <array>
 #include <cassert>
 #include <cmath>
@@ -6,6 +7,7 @@
 #include <filesystem>
 #include <fstream>
 #include <iostream>
+#include <memory>
 #include <optional>
 #include <queue>
 #include <utility>
@@ -33,73 +35,27 @@ struct SstableBtreeNode {
   uint64_t global_max;
 };
 
-using KeyPage = std::array<uint64_t, kPageSize / sizeof(uint64_t)>;
-
 SstableBTree::SstableBTree(BufPool& buffer_pool) : buffer_pool(buffer_pool){};
 
 K SstableBTree::GetMinimum(std::string& filename) const {
-  KeyPage p;
-
-  PageId id = {.filename = filename, .page = 0};
-  std::optional<BufferedPage> page = buffer_pool.GetPage(id);
-  if (page == std::nullopt) {
-    std::fstream file(
-        filename, std::fstream::binary | std::fstream::in | std::fstream::out);
-    assert(file.is_open());
-    assert(file.good());
-
-    file.seekg(0);
-    assert(file.good());
-
-    file.read(reinterpret_cast<char*>(p.data()), kPageSize);
-    buffer_pool.PutPage(id, p);
-  } else {
-    p = std::any_cast<KeyPage>(page.value().contents);
-  }
-
-  return p.at(4);
+  PageId id{.filename = filename, .page = 0};
+  PageHandle page = buffer_pool.ReadPage(id);
+  return page.As<uint64_t>()[4];
 }
 K SstableBTree::GetMaximum(std::string& filename) const {
-  KeyPage p;
-
-  PageId id = {.filename = filename, .page = 0};
-  std::optional<BufferedPage> page = buffer_pool.GetPage(id);
-  if (page == std::nullopt) {
-    std::fstream file(
-        filename, std::fstream::binary | std::fstream::in | std::fstream::out);
-    assert(file.is_open());
-    assert(file.good());
-
-    file.seekg(0);
-    assert(file.good());
-
-    file.read(reinterpret_cast<char*>(p.data()), kPageSize);
-    buffer_pool.PutPage(id, p);
-  } else {
-    p = std::any_cast<KeyPage>(page.value().contents);
-  }
-
-  return p.at(5);
+  PageId id{.filename = filename, .page = 0};
+  PageHandle page = buffer_pool.ReadPage(id);
+  return page.As<uint64_t>()[5];
 }
 
 std::vector<std::pair<K, V>> SstableBTree::Drain(std::string& filename) const {
-  return SstableBTree::ScanInFile(filename, 0, UINT64_MAX);
+  return SstableBTree::ScanInFile(filename, 0, UINT64_MAX, kSequentialOnce);
 }
 
 void SstableBTree::Delete(std::string& filename) const {
-  std::fstream file(
-      filename, std::fstream::binary | std::fstream::in | std::fstream::out);
-  assert(file.is_open());
-  assert(file.good());
-
-  std::array<uint64_t, 5> buf{};
-  file.read(reinterpret_cast<char*>(buf.data()), 5 * sizeof(uint64_t));
-  assert(file.good());
-
-  uint64_t pairs = buf.at(2);
-
-  constexpr std::size_t kPairsInPage = kPageSize / (kKeySize + kValSize);
-  uint32_t pages = ceil(static_cast<float>(pairs) / kPairsInPage) + 1;
+  // Every page that was written may be cached, internal pages included
+  uint64_t pages =
+      (std::filesystem::file_size(filename) + kPageSize - 1) / kPageSize;
 
   // Invalidate cache entries from the buffer pool
   for (uint32_t page = 0; page < pages; page++) {
@@ -107,7 +63,8 @@ void SstableBTree::Delete(std::string& filename) const {
     this->buffer_pool.RemovePage(page_id);
   }
 
-  // Remove the file
+  // Remove the file, closing it first as the name will be reused
+  this->buffer_pool.CloseFile(filename);
   bool removed = std::filesystem::remove(filename);
   assert(removed);
 }
@@ -285,22 +242,9 @@ void SstableBTree::Flush(std::string& filename,
 
 std::optional<V> SstableBTree::GetFromFile(std::string& filename,
                                            const K key) const {
-  KeyPage buf;
-  std::fstream file(
-      filename, std::fstream::binary | std::fstream::in | std::fstream::out);
-  assert(file.is_open());
-  assert(file.good());
-  PageId id = {.filename = filename, .page = 0};
-  std::optional<BufferedPage> page = buffer_pool.GetPage(id);
-  if (page == std::nullopt) {
-    file.seekg(0);
-    assert(file.good());
-
-    file.read(reinterpret_cast<char*>(buf.data()), kPageSize);
-    buffer_pool.PutPage(id, buf);
-  } else {
-    buf = std::any_cast<KeyPage>(page.value().contents);
-  }
+  PageId id{.filename = filename, .page = 0};
+  PageHandle page = buffer_pool.ReadPage(id);
+  const uint64_t* buf = page.As<uint64_t>();
 
   if (buf[0] != 0x00db00beef00db00) {
     std::cout << "Magic number wrong! Expected " << 0x00db00beef00db00
@@ -317,17 +261,10 @@ std::optional<V> SstableBTree::GetFromFile(std::string& filename,
   uint64_t cur_offset = buf[3];  // meta block size + root block ptr
   bool leaf_node = false;
   while (!leaf_node) {
-    PageId id = {.filename = filename,
-                 .page = static_cast<uint32_t>(cur_offset / kPageSize)};
-    std::optional<BufferedPage> page = buffer_pool.GetPage(id);
-    if (page == std::nullopt) {
-      file.seekg(cur_offset);
-      file.read(reinterpret_cast<char*>(buf.data()), kPageSize);
-      assert(file.good());
-      buffer_pool.PutPage(id, buf);
-    } else {
-      buf = std::any_cast<KeyPage>(page.value().contents);
-    }
+    // Reading the next node unpins the previous one
+    id.page = static_cast<uint32_t>(cur_offset / kPageSize);
+    page = buffer_pool.ReadPage(id);
+    buf = page.As<uint64_t>();
 
     int header_size = 2;
     int pair_size = 2;
@@ -396,19 +333,384 @@ std::optional<V> SstableBTree::GetFromFile(std::string& filename,
   return std::nullopt;
 };
 
-std::vector<std::pair<K, V>> SstableBTree::ScanInFile(std::string& filename,
-                                                      const K lower,
-                                                      const K upper) const {
-  std::fstream file(
-      filename, std::fstream::binary | std::fstream::in | std::fstream::out);
+/**
+ * @brief The number of pairs in the leaf node @param buf, of a file with
+ * @param elems pairs. Only the rightmost leaf may not be full.
+ */
+std::size_t leaf_pairs(const uint64_t* buf, uint64_t elems) {
+  constexpr std::size_t kLeafPairs = (kPageSize - 16) / 16;
+  if (buf[1] == 0xffffffffffffffff && elems % kLeafPairs != 0) {
+    return elems % kLeafPairs;
+  }
+  return kLeafPairs;
+}
 
-  uint64_t buf[kPageSize];
-  assert(file.is_open());
-  assert(file.good());
+/**
+ * @brief Search the B-tree node at @param offset for the keys in [begin, end)
+ * of the sorted @param keys, saving what is found into the same positions of
+ * @param values. Each child is visited once, for all the keys that fall into
+ * it, so every page is read at most once for the batch.
+ *
+ * @param elems The number of pairs in the file, to size the rightmost leaf.
+ */
+void multi_get_in_node(BufPool& buffer_pool, PageId& id, uint64_t offset,
+                       uint64_t elems, const std::vector<K>& keys,
+                       std::size_t begin, std::size_t end,
+                       std::vector<std::optional<V>>& values) {
+  id.page = static_cast<uint32_t>(offset / kPageSize);
+  PageHandle page = buffer_pool.ReadPage(id);
+  const uint64_t* buf = page.As<uint64_t>();
+
+  int header_size = 2;
+  int pair_size = 2;
+
+  if ((buf[0] >> 32) == 0x00db0011) {  // leaf node
+    std::size_t pairs = leaf_pairs(buf, elems);
+
+    // Both the keys and the pairs are sorted, so a single pass over the leaf
+    // finds all of them
+    std::size_t pair = 0;
+    for (std::size_t k = begin; k < end && pair < pairs; k++) {
+      while (pair < pairs && buf[header_size + pair * pair_size] < keys[k]) {
+        pair++;
+      }
+      if (pair < pairs && buf[header_size + pair * pair_size] == keys[k]) {
+        values[k] = buf[header_size + pair * pair_size + 1];
+      }
+    }
+    return;
+  }
 
-  file.seekg(0);
-  file.read(reinterpret_cast<char*>(buf), kPageSize);
-  assert(file.good());
+  if ((buf[0] >> 32) != 0x00db00ff) {  // not an internal node either
+    std::cout << "Magic number wrong! Expected " << 0x00db0011 << " or "
+              << 0x00db00ff << " but got " << (buf[0] >> 32) << '\n';
+    exit(1);
+  }
+
+  // A key belongs to the first child whose maximum is at least the key, and
+  // to the last child when it is past all of them
+  uint32_t num_children = buf[0] & 0x00000000ffffffff;
+  std::size_t k = begin;
+  for (uint32_t child = 0; child + 1 < num_children && k < end; child++) {
+    K child_max = buf[header_size + child * pair_size];
+    std::size_t child_end = k;
+    while (child_end < end && keys[child_end] <= child_max) {
+      child_end++;
+    }
+    if (child_end > k) {
+      multi_get_in_node(buffer_pool, id,
+                        buf[header_size + child * pair_size + 1], elems, keys,
+                        k, child_end, values);
+      k = child_end;
+    }
+  }
+  if (k < end) {
+    multi_get_in_node(buffer_pool, id, buf[1], elems, keys, k, end, values);
+  }
+}
+
+std::vector<std::optional<V>> SstableBTree::MultiGetFromFile(
+    std::string& filename, const std::vector<K>& keys) const {
+  assert(std::is_sorted(keys.begin(), keys.end()));
+  std::vector<std::optional<V>> values(keys.size());
+
+  PageId id{.filename = filename, .page = 0};
+  PageHandle page = buffer_pool.ReadPage(id);
+  const uint64_t* buf = page.As<uint64_t>();
+
+  if (buf[0] != 0x00db00beef00db00) {
+    std::cout << "Magic number wrong! Expected " << 0x00db00beef00db00
+              << " but got " << buf[0] << '\n';
+    exit(1);
+  }
+
+  // if there are no elements
+  uint64_t elems = buf[2];
+  if (elems == 0 || keys.empty()) {
+    return values;
+  }
+
+  // meta block size + root block ptr
+  multi_get_in_node(buffer_pool, id, buf[3], elems, keys, 0, keys.size(),
+                    values);
+  return values;
+}
+
+/**
+ * A cursor over the leaves of a B-tree file, left to right. It holds only the
+ * leaf it is at, pinned in the buffer pool.
+ */
+class SstableBTreeCursor : public Cursor {
+ private:
+  BufPool& buffer_pool;
+  const AccessHint hint;
+  PageId id;
+  uint64_t elems;
+  uint64_t root;
+
+  std::optional<PageHandle> leaf;
+  std::size_t pairs{0};
+  std::size_t pair{0};
+
+  [[nodiscard]] const uint64_t* leaf_buf() const {
+    return this->leaf->As<uint64_t>();
+  }
+
+  void read_leaf(uint64_t offset) {
+    this->id.page = static_cast<uint32_t>(offset / kPageSize);
+    this->leaf = this->buffer_pool.ReadPage(this->id, this->hint);
+    this->pairs = leaf_pairs(this->leaf_buf(), this->elems);
+    this->pair = 0;
+  }
+
+  /**
+   * @brief Move on to the next leaf once the current one is used up.
+   */
+  void skip_used_leaf() {
+    if (this->pair < this->pairs) {
+      return;
+    }
+    uint64_t right_leaf = this->leaf_buf()[1];
+    if (right_leaf == 0xffffffffffffffff) {
+      this->leaf.reset();
+      return;
+    }
+    this->read_leaf(right_leaf);
+  }
+
+ public:
+  SstableBTreeCursor(BufPool& buffer_pool, std::string& filename,
+                     AccessHint hint)
+      : buffer_pool(buffer_pool),
+        hint(hint),
+        id{.filename = filename, .page = 0} {
+    // The metadata page is shared with point lookups, the rest follow the hint
+    PageHandle page = buffer_pool.ReadPage(this->id);
+    const uint64_t* buf = page.As<uint64_t>();
+
+    if (buf[0] != 0x00db00beef00db00) {
+      std::cout << "Magic number wrong! Expected " << 0x00db00beef00db00
+                << " but got " << buf[0] << '\n';
+      exit(1);
+    }
+    this->elems = buf[2];
+    this->root = buf[3];
+  }
+
+  void Seek(K key) override {
+    this->leaf.reset();
+    if (this->elems == 0) {
+      return;
+    }
+
+    int header_size = 2;
+    int pair_size = 2;
+
+    uint64_t offset = this->root;
+    while (true) {
+      this->id.page = static_cast<uint32_t>(offset / kPageSize);
+      PageHandle page = this->buffer_pool.ReadPage(this->id, this->hint);
+      const uint64_t* buf = page.As<uint64_t>();
+
+      if ((buf[0] >> 32) == 0x00db0011) {  // leaf node
+        this->leaf = page;
+        break;
+      }
+      if ((buf[0] >> 32) != 0x00db00ff) {  // not an internal node either
+        std::cout << "Magic number wrong! Expected " << 0x00db0011 << " or "
+                  << 0x00db00ff << " but got " << (buf[0] >> 32) << '\n';
+        exit(1);
+      }
+
+      // The first child whose maximum is at least the key, or the last child
+      uint32_t num_children = buf[0] & 0x00000000ffffffff;
+      offset = buf[1];
+      for (uint32_t child = 0; child + 1 < num_children; child++) {
+        if (key <= buf[header_size + child * pair_size]) {
+          offset = buf[header_size + child * pair_size + 1];
+          break;
+        }
+      }
+    }
+
+    // Binary search for the first pair with a key of at least the key
+    const uint64_t* buf = this->leaf_buf();
+    this->pairs = leaf_pairs(buf, this->elems);
+    std::size_t left = 0;
+    std::size_t right = this->pairs;
+    while (left < right) {
+      std::size_t mid = left + (right - left) / 2;
+      if (buf[header_size + mid * pair_size] < key) {
+        left = mid + 1;
+      } else {
+        right = mid;
+      }
+    }
+    this->pair = left;
+    this->skip_used_leaf();
+  }
+
+  void Next() override {
+    assert(this->Valid());
+    this->pair++;
+    this->skip_used_leaf();
+  }
+
+  [[nodiscard]] bool Valid() const override { return this->leaf.has_value(); }
+
+  [[nodiscard]] K Key() const override {
+    return this->leaf_buf()[2 + this->pair * 2];
+  }
+
+  [[nodiscard]] V Value() const override {
+    return this->leaf_buf()[2 + this->pair * 2 + 1];
+  }
+};
+
+std::unique_ptr<Cursor> SstableBTree::NewCursor(std::string& filename,
+                                                const AccessHint hint) const {
+  return std::make_unique<SstableBTreeCursor>(this->buffer_pool, filename,
+                                              hint);
+}
+
+/**
+ * Writes a B-tree file a leaf at a time. Only the leaf being filled and the
+ * offset and maximum of every leaf written are held, the internal nodes are
+ * written after the last leaf, as `SstableBTree::Flush()` lays them out.
+ */
+class SstableBTreeBuilder : public SstableBuilder {
+ private:
+  static constexpr std::size_t kPageKeys = kPageSize / sizeof(uint64_t);
+  static constexpr uint64_t kOrder = kPageKeys / 2 - 1;
+
+  std::fstream file;
+  std::size_t pairs{0};
+  K minimum{0};
+  K maximum{0};
+
+  // The leaf being filled, written once the pair after it is known
+  std::array<uint64_t, kPageKeys> leaf{};
+  uint64_t leaf_pairs{0};
+
+  // The offset and largest key of each leaf written, in order
+  std::vector<SstableBtreeNode> nodes;
+
+  void write_page(std::array<uint64_t, kPageKeys>& page) {
+    this->file.write(reinterpret_cast<char*>(page.data()), kPageSize);
+    assert(this->file.good());
+  }
+
+  void write_leaf(uint64_t right_leaf_block_ptr) {
+    SstableBtreeNode node{
+        .offset = (1 + this->nodes.size()) * kPageSize,
+        .global_max = this->maximum,
+    };
+    this->leaf[0] = static_cast<uint64_t>(0x00db0011) << 32;
+    this->leaf[1] = right_leaf_block_ptr;
+    this->write_page(this->leaf);
+    this->nodes.push_back(node);
+
+    this->leaf.fill(0);
+    this->leaf_pairs = 0;
+  }
+
+  /**
+   * @brief Write the internal nodes above the leaves, a level at a time, and
+   * return the offset of the root.
+   */
+  uint64_t write_internal_nodes() {
+    std::vector<SstableBtreeNode> children = std::move(this->nodes);
+    uint64_t next_offset = (1 + children.size()) * kPageSize;
+
+    while (children.size() > 1) {
+      std::vector<SstableBtreeNode> parents;
+      for (std::size_t first = 0; first < children.size(); first += kOrder) {
+        std::size_t last = std::min(first + kOrder, children.size()) - 1;
+
+        std::array<uint64_t, kPageKeys> page{};
+        page[0] = static_cast<uint64_t>(0x00db00ff) << 32 | (last - first + 1);
+        page[1] = children[last].offset;
+        for (std::size_t child = first; child < last; child++) {
+          page[2 + 2 * (child - first)] = children[child].global_max;
+          page[3 + 2 * (child - first)] = children[child].offset;
+        }
+        this->write_page(page);
+
+        parents.push_back(SstableBtreeNode{
+            .offset = next_offset,
+            .global_max = children[last].global_max,
+        });
+        next_offset += kPageSize;
+      }
+      children = std::move(parents);
+    }
+
+    return children.empty() ? 0 : children.front().offset;
+  }
+
+ public:
+  explicit SstableBTreeBuilder(std::string& filename)
+      : file(filename, std::fstream::binary | std::fstream::in |
+                           std::fstream::out | std::fstream::trunc) {
+    assert(this->file.is_open());
+
+    // Leave room for the metadata, written once the file is finished
+    std::array<uint64_t, kPageKeys> metadata{};
+    this->write_page(metadata);
+  }
+
+  void Add(K key, V value) override {
+    assert(this->pairs == 0 || this->maximum < key);
+    if (this->leaf_pairs == kOrder) {
+      this->write_leaf((2 + this->nodes.size()) * kPageSize);
+    }
+
+    this->leaf[2 + 2 * this->leaf_pairs] = key;
+    this->leaf[3 + 2 * this->leaf_pairs] = value;
+    this->leaf_pairs++;
+
+    if (this->pairs == 0) {
+      this->minimum = key;
+    }
+    this->maximum = key;
+    this->pairs++;
+  }
+
+  [[nodiscard]] std::size_t Size() const override { return this->pairs; }
+
+  void Finish() override {
+    if (this->leaf_pairs > 0) {
+      this->write_leaf(BLOCK_NULL);
+    }
+    uint64_t root = this->write_internal_nodes();
+
+    std::array<uint64_t, kPageKeys> metadata{};
+    metadata[0] = 0x00db00beef00db00;  // magic number
+    metadata[1] = 0x0000000000000001;
+    metadata[2] = this->pairs;
+    metadata[3] = root;
+    metadata[4] = this->minimum;
+    metadata[5] = this->maximum;
+    this->file.seekp(0);
+    this->write_page(metadata);
+
+    this->file.flush();
+    assert(this->file.good());
+  }
+};
+
+std::unique_ptr<SstableBuilder> SstableBTree::NewBuilder(
+    std::string& filename) const {
+  return std::make_unique<SstableBTreeBuilder>(filename);
+}
+
+std::vector<std::pair<K, V>> SstableBTree::ScanInFile(
+    std::string& filename, const K lower, const K upper,
+    const AccessHint hint) const {
+  // The metadata page is shared with point lookups, the rest follow the hint
+  PageId id{.filename = filename, .page = 0};
+  PageHandle page = buffer_pool.ReadPage(id);
+  const uint64_t* buf = page.As<uint64_t>();
 
   if (buf[0] != 0x00db00beef00db00) {
     std::cout << "Magic number wrong! Expected " << 0x00db00beef00db00
@@ -427,9 +729,9 @@ std::vector<std::pair<K, V>> SstableBTree::ScanInFile(std::string& filename,
   bool leaf_node = false;
   int mid = 0;
   while (!leaf_node) {
-    file.seekg(cur_offset);
-    file.read(reinterpret_cast<char*>(buf), kPageSize);
-    assert(file.good());
+    id.page = static_cast<uint32_t>(cur_offset / kPageSize);
+    page = buffer_pool.ReadPage(id, hint);
+    buf = page.As<uint64_t>();
 
     int header_size = 2;
     int pair_size = 2;
@@ -499,8 +801,8 @@ std::vector<std::pair<K, V>> SstableBTree::ScanInFile(std::string& filename,
     }
   }
   std::size_t walk = mid;
-  while ((buf[0] >> 32 == 0x00db0011) && buf[walk] <= upper &&
-         walk < kPageSize / sizeof(uint64_t)) {
+  while ((buf[0] >> 32 == 0x00db0011) && walk < kPageSize / sizeof(uint64_t) &&
+         buf[walk] <= upper) {
     if (buf[1] == 0xffffffffffffffff && elems % ((kPageSize - 16) / 16) != 0 &&
         walk >= 2 + (elems % ((kPageSize - 16) / 16)) * 2) {
       break;
@@ -509,9 +811,9 @@ std::vector<std::pair<K, V>> SstableBTree::ScanInFile(std::string& filename,
     walk += 2;
 
     if (walk == kPageSize / sizeof(uint64_t) && buf[1] != 0xffffffffffffffff) {
-      file.seekg(buf[1]);
-      file.read(reinterpret_cast<char*>(buf), kPageSize);
-      assert(file.good());
+      id.page = static_cast<uint32_t>(buf[1] / kPageSize);
+      page = buffer_pool.ReadPage(id, hint);
+      buf = page.As<uint64_t>();
       walk = 2;
     }
   }
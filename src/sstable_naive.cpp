@@ -6,6 +6,7 @@
 #include <filesystem>
 #include <fstream>
 #include <iostream>
+#include <memory>
 #include <optional>
 #include <string>
 #include <utility>
@@ -49,23 +50,13 @@ K SstableNaive::GetMaximum(std::string& filename) const {
 }
 
 std::vector<std::pair<K, V>> SstableNaive::Drain(std::string& filename) const {
-  return this->ScanInFile(filename, 0, UINT64_MAX);
+  return this->ScanInFile(filename, 0, UINT64_MAX, kSequentialOnce);
 }
 
 void SstableNaive::Delete(std::string& filename) const {
-  std::fstream file(
-      filename, std::fstream::binary | std::fstream::in | std::fstream::out);
-  assert(file.is_open());
-  assert(file.good());
-
-  std::array<uint64_t, 5> buf{};
-  file.read(reinterpret_cast<char*>(buf.data()), 5 * sizeof(uint64_t));
-  assert(file.good());
-
-  uint64_t pairs = buf.at(2);
-
-  constexpr std::size_t kPairsInPage = kPageSize / (kKeySize + kValSize);
-  uint32_t pages = ceil(static_cast<float>(pairs) / kPairsInPage) + 1;
+  // Every page that was written may be cached
+  uint64_t pages =
+      (std::filesystem::file_size(filename) + kPageSize - 1) / kPageSize;
 
   // Invalidate cache entries from the buffer pool
   for (uint32_t page = 0; page < pages; page++) {
@@ -73,7 +64,8 @@ void SstableNaive::Delete(std::string& filename) const {
     this->buffer_pool.RemovePage(page_id);
   }
 
-  // Remove the file
+  // Remove the file, closing it first as the name will be reused
+  this->buffer_pool.CloseFile(filename);
   bool removed = std::filesystem::remove(filename);
   assert(removed);
 }
@@ -214,9 +206,187 @@ std::optional<V> SstableNaive::GetFromFile(std::string& filename,
   return std::nullopt;
 };
 
-std::vector<std::pair<K, V>> SstableNaive::ScanInFile(std::string& filename,
-                                                      const K lower,
-                                                      const K upper) const {
+/**
+ * A cursor over the pairs of a flat file, holding the one page it is at.
+ */
+class SstableNaiveCursor : public Cursor {
+ private:
+  static constexpr std::size_t kPageKeys = kPageSize / sizeof(uint64_t);
+
+  mutable std::fstream file;
+  uint64_t elems;
+  uint64_t pair;
+
+  mutable std::array<uint64_t, kPageKeys> page{};
+  mutable uint64_t page_idx{0};
+
+  /**
+   * @brief The page holding @param pair, read if it isn't the one held.
+   */
+  const std::array<uint64_t, kPageKeys>& page_of(uint64_t pair) const {
+    // first page is metadata page
+    uint64_t page_idx = ((pair * kPairSize * sizeof(uint64_t)) / kPageSize) + 1;
+    if (page_idx != this->page_idx) {
+      assert(this->file.good());
+      this->file.seekg(static_cast<std::streamoff>(page_idx * kPageSize));
+      this->file.read(reinterpret_cast<char*>(this->page.data()), kPageSize);
+      assert(this->file.good());
+      this->page_idx = page_idx;
+    }
+    return this->page;
+  }
+
+  [[nodiscard]] K key_at(uint64_t pair) const {
+    return this->page_of(pair).at((pair * kPairSize) % kPageKeys);
+  }
+
+ public:
+  explicit SstableNaiveCursor(std::string& filename)
+      : file(filename, std::fstream::binary | std::fstream::in) {
+    assert(this->file.is_open());
+    std::array<uint64_t, kPageKeys> metadata{};
+    this->file.read(reinterpret_cast<char*>(metadata.data()), kPageSize);
+    assert(this->file.good());
+
+    if (!has_magic_numbers(metadata, FileType::kData)) {
+      std::cout << "Magic number wrong! Expected " << file_magic()
+                << " but got " << metadata[0] << '\n';
+      exit(1);
+    }
+    this->elems = metadata.at(2);
+    this->pair = this->elems;
+  }
+
+  void Seek(K key) override {
+    // Binary search for the first pair with a key of at least the key
+    uint64_t left = 0;
+    uint64_t right = this->elems;
+    while (left < right) {
+      uint64_t mid = left + (right - left) / 2;
+      if (this->key_at(mid) < key) {
+        left = mid + 1;
+      } else {
+        right = mid;
+      }
+    }
+    this->pair = left;
+  }
+
+  void Next() override {
+    assert(this->Valid());
+    this->pair++;
+  }
+
+  [[nodiscard]] bool Valid() const override {
+    return this->pair < this->elems;
+  }
+
+  [[nodiscard]] K Key() const override { return this->key_at(this->pair); }
+
+  [[nodiscard]] V Value() const override {
+    return this->page_of(this->pair).at((this->pair * kPairSize) % kPageKeys +
+                                        1);
+  }
+};
+
+// The flat files are not read through the buffer pool, so the hint does not
+// matter.
+std::unique_ptr<Cursor> SstableNaive::NewCursor(
+    std::string& filename, AccessHint /* hint */) const {
+  return std::make_unique<SstableNaiveCursor>(filename);
+}
+
+/**
+ * Writes a flat file a page of pairs at a time, and the metadata last.
+ */
+class SstableNaiveBuilder : public SstableBuilder {
+ private:
+  static constexpr std::size_t kPageKeys = kPageSize / sizeof(uint64_t);
+
+  std::fstream file;
+  std::size_t pairs{0};
+  K minimum{0};
+  K maximum{0};
+
+  // The page being filled
+  std::array<uint64_t, kPageKeys> page{};
+  std::size_t page_keys{0};
+
+  void write_page() {
+    this->file.write(reinterpret_cast<char*>(this->page.data()), kPageSize);
+    assert(this->file.good());
+    this->page.fill(0);
+    this->page_keys = 0;
+  }
+
+ public:
+  explicit SstableNaiveBuilder(std::string& filename)
+      : file(filename, std::fstream::binary | std::fstream::in |
+                           std::fstream::out | std::fstream::trunc) {
+    assert(this->file.is_open());
+
+    // Leave room for the metadata, written once the file is finished
+    this->write_page();
+  }
+
+  void Add(K key, V value) override {
+    assert(this->pairs == 0 || this->maximum < key);
+    this->page.at(this->page_keys++) = key;
+    this->page.at(this->page_keys++) = value;
+    if (this->page_keys == kPageKeys) {
+      this->write_page();
+    }
+
+    if (this->pairs == 0) {
+      this->minimum = key;
+    }
+    this->maximum = key;
+    this->pairs++;
+  }
+
+  [[nodiscard]] std::size_t Size() const override { return this->pairs; }
+
+  void Finish() override {
+    // Always end on a page that isn't full, as Flush() does, since reads of a
+    // page of pairs may read the one after it
+    this->write_page();
+
+    std::array<uint64_t, kPageKeys> metadata_buf{};
+    put_magic_numbers(metadata_buf, FileType::kData);
+    metadata_buf.at(2) = this->pairs;
+    metadata_buf.at(3) = this->minimum;
+    metadata_buf.at(4) = this->maximum;
+    this->file.seekp(0);
+    this->file.write(reinterpret_cast<char*>(metadata_buf.data()), kPageSize);
+    assert(this->file.good());
+
+    this->file.flush();
+    assert(this->file.good());
+  }
+};
+
+std::unique_ptr<SstableBuilder> SstableNaive::NewBuilder(
+    std::string& filename) const {
+  return std::make_unique<SstableNaiveBuilder>(filename);
+}
+
+// The flat files are not read through the buffer pool, so there are no pages
+// for the keys to share.
+std::vector<std::optional<V>> SstableNaive::MultiGetFromFile(
+    std::string& filename, const std::vector<K>& keys) const {
+  std::vector<std::optional<V>> values;
+  values.reserve(keys.size());
+  for (K key : keys) {
+    values.push_back(this->GetFromFile(filename, key));
+  }
+  return values;
+}
+
+// The flat files are not read through the buffer pool, so the hint does not
+// matter.
+std::vector<std::pair<K, V>> SstableNaive::ScanInFile(
+    std::string& filename, const K lower, const K upper,
+    AccessHint /* hint */) const {
   assert(lower <= upper);
   std::fstream file(
       filename, std::fstream::binary | std::fstream::in | std::fstream::out);
@@ -0,0 +1,378 @@
+#include "wal.hpp"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cassert>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "constants.hpp"
+#include "fileutil.hpp"
+#include "naming.hpp"
+#include "xxhash.h"
+
+const char* WriteAheadLogFailedException::what() const noexcept {
+  return "Failed to write or sync the write-ahead log! The write may not be "
+         "durable, and the database takes no more writes until it is reopened.";
+};
+
+enum WalFileLocations {
+  kSegment = 2,
+};
+
+/**
+ * Each batch is a single header word followed by its (key, value) pairs. The
+ * header holds the number of pairs in the upper 32 bits and a checksum of the
+ * pairs in the lower 32 bits, so that a batch torn by a crash is never
+ * replayed.
+ */
+uint32_t batch_checksum(const uint64_t* pairs, uint32_t count) {
+  return XXH32(pairs, count * 2 * sizeof(uint64_t), count);
+}
+
+class WriteAheadLog::WriteAheadLogImpl {
+ private:
+  const DbNaming& naming;
+  const WalTuning tuning;
+
+  // The segments that existed before this log was opened, sorted.
+  std::vector<uint64_t> replayable;
+
+  uint64_t segment;
+  int fd{-1};
+
+  // The number of records appended, and how many of the first of them are
+  // known to be synced. Records are numbered from 1 in the order they are
+  // written, across segments.
+  uint64_t appended{0};
+  uint64_t synced{0};
+  // Whether an append is leading a group commit, syncing the segment without
+  // holding `mutex`. The segment is not closed until it is done.
+  bool syncing{false};
+  // Whether a write or sync failed. The segment is closed and never used
+  // again, as a failed fdatasync() may have dropped its unsynced pages.
+  std::atomic<bool> failed{false};
+
+  // Guards the active segment, the counts above and setting `failed`.
+  std::mutex mutex;
+  // Signalled when a group commit is done, or the log has failed.
+  std::condition_variable synced_cv;
+
+  [[nodiscard]] std::vector<uint64_t> existing_segments() const {
+    std::vector<uint64_t> segments;
+    if (!std::filesystem::exists(this->naming.dirpath)) {
+      return segments;
+    }
+
+    std::string prefix = this->naming.name + ".WAL.S";
+    for (auto const& entry :
+         std::filesystem::directory_iterator(this->naming.dirpath)) {
+      std::string name = entry.path().filename().string();
+      if (name.rfind(prefix, 0) == 0) {
+        segments.push_back(parse_wal_file_segment(name));
+      }
+    }
+
+    std::sort(segments.begin(), segments.end());
+    return segments;
+  }
+
+  void close_fd() {
+    if (this->fd >= 0) {
+      ::close(this->fd);
+      this->fd = -1;
+    }
+  }
+
+  /**
+   * @brief Stop using the active segment and throw. The segment is closed
+   * right away, unless a group commit is syncing it, which closes it when it
+   * is done. Callers must hold `mutex`.
+   */
+  [[noreturn]] void fail_locked() {
+    this->failed = true;
+    if (!this->syncing) {
+      this->close_fd();
+    }
+    this->synced_cv.notify_all();
+    throw WriteAheadLogFailedException();
+  }
+
+  void write_all(const uint64_t* data, std::size_t words) {
+    if (this->failed) {
+      throw WriteAheadLogFailedException();
+    }
+
+    auto bytes = reinterpret_cast<const char*>(data);
+    std::size_t remaining = words * sizeof(uint64_t);
+    while (remaining > 0) {
+      ssize_t written = ::write(this->fd, bytes, remaining);
+      if (written < 0 && errno == EINTR) {
+        continue;
+      }
+      if (written <= 0) {
+        this->fail_locked();
+      }
+      bytes += written;
+      remaining -= written;
+    }
+  }
+
+  /**
+   * @brief Sync the active segment. Callers must hold `mutex`.
+   */
+  void sync_locked() {
+    if (this->failed) {
+      throw WriteAheadLogFailedException();
+    }
+
+    if (::fdatasync(this->fd) != 0) {
+      this->fail_locked();
+    }
+    this->synced = this->appended;
+    this->synced_cv.notify_all();
+  }
+
+  /**
+   * @brief Wait until record number @param record is synced. The first
+   * append to find no sync running leads the next one, which commits every
+   * record appended by then. It waits for the group commit window first,
+   * letting appends on other threads join, and syncs without holding `mutex`,
+   * so that more records can be appended for the sync after it. Throws if the
+   * log fails before the record is synced.
+   */
+  void wait_for_sync(std::unique_lock<std::mutex>& lock, uint64_t record) {
+    while (this->synced < record) {
+      if (this->failed) {
+        throw WriteAheadLogFailedException();
+      }
+      if (this->syncing) {
+        this->synced_cv.wait(lock);
+        continue;
+      }
+
+      this->syncing = true;
+      if (this->tuning.group_commit_window > std::chrono::microseconds(0)) {
+        this->synced_cv.wait_for(lock, this->tuning.group_commit_window,
+                                 [this] { return this->failed.load(); });
+      }
+      uint64_t target = this->appended;
+      int result = 0;
+      if (!this->failed) {
+        int fd = this->fd;
+        lock.unlock();
+        result = ::fdatasync(fd);
+        lock.lock();
+      }
+
+      this->syncing = false;
+      if (result != 0) {
+        this->failed = true;
+      }
+      if (this->failed) {
+        this->close_fd();
+      } else {
+        this->synced = std::max(this->synced, target);
+      }
+      this->synced_cv.notify_all();
+    }
+  }
+
+  /**
+   * @brief Create the segment numbered `segment` and make it the active one.
+   * Callers must hold `mutex`, or be the constructor.
+   */
+  void open_segment() {
+    this->fd = ::open(wal_file(this->naming, this->segment).c_str(),
+                      O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0644);
+    if (this->fd < 0) {
+      this->fail_locked();
+    }
+
+    std::array<uint64_t, kPageSize / sizeof(uint64_t)> page{};
+    put_magic_numbers(page, FileType::kWal);
+    page[WalFileLocations::kSegment] = this->segment;
+    this->write_all(page.data(), page.size());
+    if (this->tuning.sync) {
+      this->sync_locked();
+    }
+  }
+
+  void close_segment() {
+    if (this->fd < 0) {
+      return;
+    }
+
+    if (this->tuning.sync) {
+      this->sync_locked();
+    }
+    ::close(this->fd);
+    this->fd = -1;
+  }
+
+  void replay_segment(
+      uint64_t segment,
+      const std::function<void(const std::vector<std::pair<K, V>>&)>& apply)
+      const {
+    std::string filename = wal_file(this->naming, segment);
+    std::size_t size = std::filesystem::file_size(filename);
+    if (size < kPageSize) {
+      // The header page itself never made it to disk.
+      return;
+    }
+
+    std::vector<uint64_t> data;
+    data.resize(size / sizeof(uint64_t));
+    std::fstream f(filename, std::fstream::binary | std::fstream::in);
+    assert(f.good());
+    f.read(reinterpret_cast<char*>(data.data()),
+           data.size() * sizeof(uint64_t));
+    assert(f.good());
+    f.close();
+
+    std::array<uint64_t, kPageSize / sizeof(uint64_t)> page{};
+    std::copy_n(data.begin(), page.size(), page.begin());
+    assert(has_magic_numbers(page, FileType::kWal));
+    assert(page[WalFileLocations::kSegment] == segment);
+
+    std::vector<std::pair<K, V>> batch;
+    std::size_t pos = kPageSize / sizeof(uint64_t);
+    while (pos < data.size()) {
+      uint64_t header = data.at(pos);
+      auto count = static_cast<uint32_t>(header >> 32);
+      auto checksum = static_cast<uint32_t>(header);
+      if (count == 0 || pos + 1 + (2 * count) > data.size()) {
+        break;
+      }
+      if (batch_checksum(&data.at(pos + 1), count) != checksum) {
+        break;
+      }
+
+      batch.clear();
+      for (uint32_t i = 0; i < count; i++) {
+        batch.emplace_back(data.at(pos + 1 + (2 * i)),
+                           data.at(pos + 2 + (2 * i)));
+      }
+      apply(batch);
+      pos += 1 + (2 * count);
+    }
+  }
+
+ public:
+  WriteAheadLogImpl(const DbNaming& naming, WalTuning tuning)
+      : naming(naming), tuning(tuning) {
+    this->replayable = this->existing_segments();
+    this->segment = this->replayable.empty() ? 0 : this->replayable.back() + 1;
+    this->open_segment();
+  }
+
+  ~WriteAheadLogImpl() {
+    // A clean shutdown always syncs, whatever the tuning.
+    std::lock_guard<std::mutex> lock(this->mutex);
+    if (this->fd >= 0) {
+      ::fdatasync(this->fd);
+      ::close(this->fd);
+    }
+  }
+
+  void Replay(
+      const std::function<void(const std::vector<std::pair<K, V>>&)>& apply) {
+    for (const auto& segment : this->replayable) {
+      this->replay_segment(segment, apply);
+    }
+  }
+
+  void Append(const std::vector<std::pair<K, V>>& batch) {
+    if (batch.empty()) {
+      return;
+    }
+
+    std::vector<uint64_t> record;
+    record.reserve(1 + (2 * batch.size()));
+    record.push_back(0);
+    for (const auto& [key, value] : batch) {
+      record.push_back(key);
+      record.push_back(value);
+    }
+    auto count = static_cast<uint32_t>(batch.size());
+    record.at(0) = (static_cast<uint64_t>(count) << 32) |
+                   batch_checksum(&record.at(1), count);
+
+    std::unique_lock<std::mutex> lock(this->mutex);
+    this->write_all(record.data(), record.size());
+    uint64_t appended = ++this->appended;
+    if (!this->tuning.sync) {
+      return;
+    }
+
+    if (this->tuning.group_commit) {
+      this->wait_for_sync(lock, appended);
+    } else {
+      this->sync_locked();
+    }
+  }
+
+  void Sync() {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    this->sync_locked();
+  }
+
+  [[nodiscard]] bool Failed() const { return this->failed; }
+
+  uint64_t NewSegment() {
+    std::unique_lock<std::mutex> lock(this->mutex);
+    this->synced_cv.wait(lock, [this] { return !this->syncing; });
+    if (this->failed) {
+      throw WriteAheadLogFailedException();
+    }
+    this->close_segment();
+    this->segment++;
+    this->open_segment();
+    return this->segment;
+  }
+
+  void RemoveSegmentsBefore(uint64_t segment) {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    for (const auto& s : this->existing_segments()) {
+      if (s < segment) {
+        std::filesystem::remove(wal_file(this->naming, s));
+      }
+    }
+
+    auto it = std::remove_if(this->replayable.begin(), this->replayable.end(),
+                             [&](uint64_t s) { return s < segment; });
+    this->replayable.erase(it, this->replayable.end());
+  }
+};
+
+WriteAheadLog::WriteAheadLog(const DbNaming& naming, WalTuning tuning)
+    : impl(std::make_unique<WriteAheadLogImpl>(naming, tuning)) {}
+WriteAheadLog::~WriteAheadLog() = default;
+
+void WriteAheadLog::Replay(
+    const std::function<void(const std::vector<std::pair<K, V>>&)>& apply) {
+  return this->impl->Replay(apply);
+}
+void WriteAheadLog::Append(const std::vector<std::pair<K, V>>& batch) {
+  return this->impl->Append(batch);
+}
+void WriteAheadLog::Sync() { return this->impl->Sync(); }
+bool WriteAheadLog::Failed() const { return this->impl->Failed(); }
+uint64_t WriteAheadLog::NewSegment() { return this->impl->NewSegment(); }
+void WriteAheadLog::RemoveSegmentsBefore(uint64_t segment) {
+  return this->impl->RemoveSegmentsBefore(segment);
+}
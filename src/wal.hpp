@@ -0,0 +1,109 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "constants.hpp"
+#include "naming.hpp"
+
+class WriteAheadLogFailedException : public std::exception {
+ public:
+  [[nodiscard]] const char* what() const noexcept override;
+};
+
+struct WalTuning {
+  /**
+   * @brief Whether appended records are ever fsync()ed. If false, records are
+   * still written to the OS on every append, so they survive the process
+   * crashing, but not the machine crashing.
+   */
+  bool sync;
+
+  /**
+   * @brief Whether appends share syncs. Either way, a synced append only
+   * returns once its record is synced. Without group commit, each append
+   * syncs the segment itself. With it, appends on other threads that arrive
+   * while a sync runs wait for the next one, which commits all of their
+   * records with a single fsync(), and all of them throw if it fails.
+   */
+  bool group_commit{false};
+
+  /**
+   * @brief How long the append leading a group commit waits for more appends
+   * to join it before it syncs. Defaults to not waiting.
+   */
+  std::chrono::microseconds group_commit_window{0};
+};
+
+class WriteAheadLog {
+ private:
+  class WriteAheadLogImpl;
+  const std::unique_ptr<WriteAheadLogImpl> impl;
+
+ public:
+  /**
+   * @brief Opens the write-ahead log of a database. Existing segments in the
+   * data directory are left untouched until they are replayed and retired,
+   * new records go into a fresh segment.
+   *
+   * @param naming The database naming scheme.
+   * @param tuning When appended records are synced to disk.
+   */
+  WriteAheadLog(const DbNaming& naming, WalTuning tuning);
+  ~WriteAheadLog();
+
+  /**
+   * @brief Replay every record in the segments that existed before this log
+   * was opened, oldest first. Batches are passed to `apply` whole, in the
+   * order they were appended. Replay of a segment stops at the first torn or
+   * corrupt batch, as that is where the previous writer crashed.
+   *
+   * @param apply Called once per batch of (key, value) pairs.
+   */
+  void Replay(
+      const std::function<void(const std::vector<std::pair<K, V>>&)>& apply);
+
+  /**
+   * @brief Append a batch of (key, value) pairs to the active segment. The
+   * batch is replayed all-or-nothing. Whether it is durable when this returns
+   * depends on the WalTuning.
+   *
+   * Throws a WriteAheadLogFailedException if the batch could not be written
+   * or synced, or if the log failed before. What reached the disk after a
+   * failed sync is unknown, so a failed log takes no more records.
+   */
+  void Append(const std::vector<std::pair<K, V>>& batch);
+
+  /**
+   * @brief fsync() the active segment, regardless of the WalTuning. Throws a
+   * WriteAheadLogFailedException like `Append()`.
+   */
+  void Sync();
+
+  /**
+   * @brief Whether a write or sync of the log failed, see `Append()`.
+   */
+  [[nodiscard]] bool Failed() const;
+
+  /**
+   * @brief Close the active segment and start appending to a new one. Intended
+   * to be called when the memtable is rotated out to be flushed, see
+   * `RemoveSegmentsBefore()`. Throws a WriteAheadLogFailedException like
+   * `Append()`.
+   *
+   * @return uint64_t The number of the new, active segment.
+   */
+  uint64_t NewSegment();
+
+  /**
+   * @brief Delete all segments numbered strictly less than `segment`. Intended
+   * to be called once the memtable holding their records has been flushed to
+   * level 0.
+   */
+  void RemoveSegmentsBefore(uint64_t segment);
+};
@@ -0,0 +1,75 @@
+#include "bloom.hpp"
+
+#include <gtest/gtest.h>
+
+#include <bitset>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+std::vector<BucketCheckFn> all_bucket_checks() {
+  std::vector<BucketCheckFn> checks = {&bucket_check_scalar, bucket_check()};
+#if defined(__x86_64__) || defined(__i386__)
+  checks.push_back(&bucket_check_sse2);
+  if (__builtin_cpu_supports("avx2")) {
+    checks.push_back(&bucket_check_avx2);
+  }
+#endif
+  return checks;
+}
+
+int bits_set(const BloomBucket& bucket) {
+  int bits = 0;
+  for (uint32_t word : bucket.words) {
+    bits += std::bitset<32>(word).count();
+  }
+  return bits;
+}
+
+TEST(BloomBucket, SetsOneBitPerHash) {
+  for (uint32_t num_hashes = 1; num_hashes <= kMaxBucketHashes; num_hashes++) {
+    BloomBucket bucket{};
+    bucket_insert(bucket, 0xdeadbeef, num_hashes);
+    ASSERT_EQ(bits_set(bucket), num_hashes);
+  }
+}
+
+TEST(BloomBucket, EveryCheckFindsInsertedHashes) {
+  std::mt19937 eng(0);
+  for (uint32_t num_hashes = 1; num_hashes <= kMaxBucketHashes; num_hashes++) {
+    BloomBucket bucket{};
+    std::vector<uint32_t> hashes;
+    for (int i = 0; i < 16; i++) {
+      hashes.push_back(eng());
+      bucket_insert(bucket, hashes.back(), num_hashes);
+    }
+
+    for (BucketCheckFn check : all_bucket_checks()) {
+      for (uint32_t hash : hashes) {
+        ASSERT_TRUE(check(bucket, hash, num_hashes));
+      }
+    }
+  }
+}
+
+TEST(BloomBucket, EveryCheckAgrees) {
+  std::mt19937 eng(1);
+  BloomBucket bucket{};
+  for (int i = 0; i < 24; i++) {
+    bucket_insert(bucket, eng(), 4);
+  }
+
+  int negatives = 0;
+  for (int i = 0; i < 10000; i++) {
+    uint32_t hash = eng();
+    for (uint32_t num_hashes = 1; num_hashes <= kMaxBucketHashes;
+         num_hashes++) {
+      bool expected = bucket_check_scalar(bucket, hash, num_hashes);
+      negatives += !expected;
+      for (BucketCheckFn check : all_bucket_checks()) {
+        ASSERT_EQ(check(bucket, hash, num_hashes), expected);
+      }
+    }
+  }
+  ASSERT_GT(negatives, 0);
+}
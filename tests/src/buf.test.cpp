@@ -2,10 +2,16 @@
 
 #include <gtest/gtest.h>
 
-#include <any>
+#include <cstddef>
 #include <cstdint>
+#include <fstream>
+#include <memory>
 #include <optional>
 #include <string>
+#include <thread>
+#include <vector>
+
+#include "testutil.hpp"
 
 uint32_t test_hash(const PageId& elem) { return elem.page; }
 
@@ -27,7 +33,7 @@ TEST(BufPool, GetNonExistantPage) {
   BufPool buf(BufPoolTuning{.initial_elements = 1, .max_elements = 1},
               &test_hash);
   PageId id = {.filename = std::string("file"), .page = 2};
-  std::optional<BufferedPage> page = buf.GetPage(id);
+  std::optional<PageHandle> page = buf.GetPage(id);
   ASSERT_EQ(page, std::nullopt);
 }
 
@@ -42,10 +48,9 @@ TEST(BufPool, ReplaceDuplicates) {
     buf.PutPage(id, BytePage{std::byte{(uint8_t)i}});
   }
 
-  std::optional<BufferedPage> page = buf.GetPage(id);
+  std::optional<PageHandle> page = buf.GetPage(id);
   ASSERT_TRUE(page.has_value());
-  ASSERT_EQ(std::any_cast<BytePage>(page.value().contents),
-            BytePage{std::byte{9}});
+  ASSERT_EQ(page.value().bytes(), BytePage{std::byte{9}});
 }
 
 TEST(BufPool, GetRealPage) {
@@ -54,12 +59,10 @@ TEST(BufPool, GetRealPage) {
 
   PageId id = {.filename = std::string("file"), .page = 3};
   buf.PutPage(id, BytePage{});
-  std::optional<BufferedPage> page = buf.GetPage(id);
+  std::optional<PageHandle> page = buf.GetPage(id);
 
   ASSERT_TRUE(page.has_value());
-  ASSERT_EQ(page.value().id.filename, std::string("file"));
-  ASSERT_EQ(page.value().id.page, 3);
-  ASSERT_EQ(std::any_cast<BytePage>(page.value().contents), BytePage{});
+  ASSERT_EQ(page.value().bytes(), BytePage{});
 }
 
 TEST(BufPool, Evolution) {
@@ -229,14 +232,13 @@ TEST(BufPool, Invalidation) {
                                           "[]: ()\n"));
   for (uint32_t i = 0; i < 10; i++) {
     PageId page_id{.filename = "file" + std::to_string(i), .page = i};
-    buf.PutPage(page_id, std::make_any<uint32_t>(i));
+    buf.PutPage(page_id, BytePage{std::byte(i)});
   }
 
   for (uint32_t i = 0; i < 10; i++) {
     PageId page_id{.filename = "file" + std::to_string(i), .page = i};
     auto buffered = buf.GetPage(page_id);
-    ASSERT_EQ(buffered.value().id, page_id);
-    ASSERT_EQ(std::any_cast<uint32_t>(buffered.value().contents), i);
+    ASSERT_EQ(buffered.value().data()[0], std::byte(i));
     buf.RemovePage(page_id);
   }
 
@@ -245,6 +247,7 @@ TEST(BufPool, Invalidation) {
     auto buffered = buf.GetPage(page_id);
     ASSERT_EQ(buffered, std::nullopt);
   }
+  ASSERT_NE(buf.DebugPrint().find("elements: 0\n"), std::string::npos);
 }
 
 TEST(BufPool, PagesAreEvictedOnFullRotation) {
@@ -301,15 +304,188 @@ TEST(BufPool, PagesAreEvictedOnFullRotation) {
   ASSERT_EQ(buf.GetPage(id0).has_value(), false);
   ASSERT_EQ(buf.GetPage(id1).has_value(), false);
 
-  std::optional<BufferedPage> page2 = buf.GetPage(id2);
+  std::optional<PageHandle> page2 = buf.GetPage(id2);
   ASSERT_EQ(page2.has_value(), true);
-  ASSERT_EQ(page2.value().id, id2);
-  ASSERT_EQ(std::any_cast<BytePage>(page2.value().contents),
-            BytePage{std::byte(0x02)});
+  ASSERT_EQ(page2.value().bytes(), BytePage{std::byte(0x02)});
 
-  std::optional<BufferedPage> page3 = buf.GetPage(id3);
+  std::optional<PageHandle> page3 = buf.GetPage(id3);
   ASSERT_EQ(page3.has_value(), true);
-  ASSERT_EQ(page3.value().id, id3);
-  ASSERT_EQ(std::any_cast<BytePage>(page3.value().contents),
-            BytePage{std::byte(0x03)});
+  ASSERT_EQ(page3.value().bytes(), BytePage{std::byte(0x03)});
+}
+
+TEST(BufPool, ShardsSplitTheElements) {
+  BufPool buf(BufPoolTuning{
+      .initial_elements = 8,
+      .max_elements = 64,
+      .shards = 4,
+  });
+
+  std::string debug = buf.DebugPrint();
+  ASSERT_NE(debug.find("shard 0:\nmax: 16\n"), std::string::npos);
+  ASSERT_NE(debug.find("shard 3:\nmax: 16\n"), std::string::npos);
+  ASSERT_EQ(debug.find("shard 4:"), std::string::npos);
+
+  for (uint32_t i = 0; i < 32; i++) {
+    PageId page_id{.filename = "file" + std::to_string(i % 3), .page = i};
+    buf.PutPage(page_id, BytePage{std::byte(i)});
+  }
+
+  for (uint32_t i = 0; i < 32; i++) {
+    PageId page_id{.filename = "file" + std::to_string(i % 3), .page = i};
+    auto buffered = buf.GetPage(page_id);
+    if (buffered.has_value()) {
+      ASSERT_EQ(buffered.value().data()[0], std::byte(i));
+    }
+    buf.RemovePage(page_id);
+    ASSERT_EQ(buf.GetPage(page_id), std::nullopt);
+  }
+}
+
+TEST(BufPool, ShardsAreThreadSafe) {
+  BufPool buf(BufPoolTuning{
+      .initial_elements = 16,
+      .max_elements = 128,
+      .shards = 8,
+  });
+
+  std::vector<std::thread> threads;
+  for (uint32_t t = 0; t < 8; t++) {
+    threads.emplace_back([&buf, t] {
+      for (uint32_t i = 0; i < 2000; i++) {
+        PageId page_id{.filename = "file" + std::to_string(t), .page = i % 64};
+        buf.PutPage(page_id, BytePage{std::byte(t)});
+        auto buffered = buf.GetPage(page_id);
+        if (buffered.has_value()) {
+          ASSERT_EQ(buffered.value().data()[0], std::byte(t));
+        }
+      }
+    });
+  }
+
+  for (auto& thread : threads) {
+    thread.join();
+  }
+}
+
+TEST(BufPool, PinnedPagesOutliveEviction) {
+  BufPool buf(BufPoolTuning{.initial_elements = 1, .max_elements = 2},
+              &test_hash);
+
+  PageId id0 = make_test_id(0b001, 3);
+  PageHandle pinned = buf.PutPage(id0, BytePage{std::byte{0x00}});
+  PageId id1 = make_test_id(0b101, 3);
+  buf.PutPage(id1, BytePage{std::byte{0x01}});
+
+  // Evict both pages, while the first one is still pinned
+  PageId id2 = make_test_id(0b010, 3);
+  buf.PutPage(id2, BytePage{std::byte{0x02}});
+  PageId id3 = make_test_id(0b110, 3);
+  buf.PutPage(id3, BytePage{std::byte{0x03}});
+  ASSERT_EQ(buf.GetPage(id0), std::nullopt);
+  ASSERT_EQ(buf.GetPage(id1), std::nullopt);
+
+  // The pinned frame is not reused, the unpinned one is
+  PageId id4 = make_test_id(0b011, 3);
+  std::shared_ptr<PageFrame> frame = buf.NewFrame(id4);
+  ASSERT_NE(frame.get()->bytes.data(), pinned.data());
+  frame->bytes.fill(std::byte{0x04});
+  buf.PutPage(id4, frame);
+
+  ASSERT_EQ(pinned.bytes(), BytePage{std::byte{0x00}});
+  ASSERT_EQ(buf.GetPage(id4).value().data()[kPageSize - 1], std::byte{0x04});
+}
+
+TEST(BufPool, FramesArePageAligned) {
+  BufPool buf(BufPoolTuning{.initial_elements = 1, .max_elements = 4});
+
+  PageId id = make_test_id(1);
+  PageHandle handle = buf.PutPage(id, BytePage{});
+  ASSERT_EQ(reinterpret_cast<std::uintptr_t>(handle.data()) % kPageSize, 0);
+}
+
+TEST(BufPool, CountsHitsMissesAndEvictions) {
+  BufPool buf(BufPoolTuning{.initial_elements = 2, .max_elements = 2});
+
+  PageId id0 = make_test_id(0);
+  PageId id1 = make_test_id(1);
+  PageId id2 = make_test_id(2);
+  ASSERT_EQ(buf.GetPage(id0), std::nullopt);
+  buf.PutPage(id0, BytePage{});
+  buf.PutPage(id1, BytePage{});
+  ASSERT_TRUE(buf.GetPage(id0).has_value());
+  buf.PutPage(id2, BytePage{});
+
+  BufPoolStats stats = buf.Stats();
+  ASSERT_EQ(stats.hits, 1);
+  ASSERT_EQ(stats.misses, 1);
+  ASSERT_EQ(stats.evictions, 1);
+}
+
+TEST(BufPool, EveryShardGetsAnEvictor) {
+  BufPool buf(
+      BufPoolTuning{
+          .initial_elements = 4,
+          .max_elements = 8,
+          .shards = 2,
+      },
+      [] { return std::make_unique<LruEvictor>(); }, &Hash);
+
+  for (uint32_t i = 0; i < 64; i++) {
+    PageId page_id = make_test_id(i);
+    buf.PutPage(page_id, BytePage{std::byte(i)});
+    ASSERT_EQ(buf.GetPage(page_id).value().data()[0], std::byte(i));
+  }
+
+  BufPoolStats stats = buf.Stats();
+  ASSERT_EQ(stats.hits, 64);
+  ASSERT_EQ(stats.evictions, 64 - 8);
+}
+
+TEST(BufPool, SequentialAccessesDoNotKeepPages) {
+  BufPool buf(BufPoolTuning{.initial_elements = 2, .max_elements = 2},
+              [] { return std::make_unique<LruEvictor>(); }, &Hash);
+
+  PageId id0 = make_test_id(0);
+  PageId id1 = make_test_id(1);
+  PageId id2 = make_test_id(2);
+  buf.PutPage(id0, BytePage{});
+  buf.PutPage(id1, BytePage{});
+
+  // Only the first access counts, so the first page is still the oldest
+  ASSERT_TRUE(buf.GetPage(id0, kSequentialOnce).has_value());
+  buf.PutPage(id2, BytePage{});
+  ASSERT_EQ(buf.GetPage(id0), std::nullopt);
+
+  // A page read once is not cached at all
+  PageId id3 = make_test_id(3);
+  PageHandle handle = buf.PutPage(id3, buf.NewFrame(id3), kSequentialOnce);
+  ASSERT_EQ(buf.GetPage(id3), std::nullopt);
+  ASSERT_TRUE(buf.GetPage(id1).has_value());
+  ASSERT_TRUE(buf.GetPage(id2).has_value());
+}
+
+TEST(BufPool, ReadsPagesFromFile) {
+  auto naming = create_dir("BufPool.ReadsPagesFromFile");
+  std::string filename = naming.dirpath / "file";
+  {
+    // A full page of ones, then a page cut short
+    std::ofstream file(filename, std::ofstream::binary);
+    std::string contents(kPageSize, '\x01');
+    contents += "\x02\x02";
+    file << contents;
+  }
+  BufPool buf(BufPoolTuning{.initial_elements = 2, .max_elements = 2});
+
+  PageId id0{.filename = filename, .page = 0};
+  PageId id1{.filename = filename, .page = 1};
+  ASSERT_EQ(buf.ReadPage(id0).data()[kPageSize - 1], std::byte{1});
+  PageHandle last = buf.ReadPage(id1);
+  ASSERT_EQ(last.data()[1], std::byte{2});
+  ASSERT_EQ(last.data()[2], std::byte{0});
+
+  // The second read of a page is served from the pool
+  buf.ReadPage(id0);
+  BufPoolStats stats = buf.Stats();
+  ASSERT_EQ(stats.hits, 1);
+  ASSERT_EQ(stats.misses, 2);
 }
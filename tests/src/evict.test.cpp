@@ -4,6 +4,7 @@
 
 #include <cstdint>
 #include <optional>
+#include <vector>
 
 #include "buf.hpp"
 
@@ -14,17 +15,19 @@ PageId make_test_page(uint32_t d) {
 TEST(ClockEviction, NonDirtyMembersEvicted) {
   ClockEvictor evictor;
   evictor.Resize(1);
+  EvictorSlot slot1, slot2;
 
   const PageId page1 = make_test_page(0);
-  ASSERT_EQ(evictor.Insert(page1), std::nullopt);
+  ASSERT_EQ(evictor.Insert(page1, slot1), std::nullopt);
 
   const PageId page2 = make_test_page(1);
-  ASSERT_EQ(evictor.Insert(page2).value(), page1);
+  ASSERT_EQ(evictor.Insert(page2, slot2).value(), page1);
 }
 
 TEST(ClockEviction, DirtyMembersAllKept) {
   ClockEvictor evictor;
   evictor.Resize(3);
+  EvictorSlot slot1, slot2, slot3, slot4, slot5, slot6;
 
   PageId page1 = make_test_page(1);
   PageId page2 = make_test_page(2);
@@ -33,73 +36,188 @@ TEST(ClockEviction, DirtyMembersAllKept) {
   PageId page5 = make_test_page(5);
   PageId page6 = make_test_page(6);
 
-  ASSERT_EQ(evictor.Insert(page1), std::nullopt);
-  ASSERT_EQ(evictor.Insert(page2), std::nullopt);
-  ASSERT_EQ(evictor.Insert(page3), std::nullopt);
-  evictor.MarkUsed(page1);
-  evictor.MarkUsed(page2);
-  evictor.MarkUsed(page3);
-  ASSERT_EQ(evictor.Insert(page4).value(), page1);
-  ASSERT_EQ(evictor.Insert(page5).value(), page2);
-  ASSERT_EQ(evictor.Insert(page6).value(), page3);
+  ASSERT_EQ(evictor.Insert(page1, slot1), std::nullopt);
+  ASSERT_EQ(evictor.Insert(page2, slot2), std::nullopt);
+  ASSERT_EQ(evictor.Insert(page3, slot3), std::nullopt);
+  evictor.MarkUsed(slot1);
+  evictor.MarkUsed(slot2);
+  evictor.MarkUsed(slot3);
+  ASSERT_EQ(evictor.Insert(page4, slot4).value(), page1);
+  ASSERT_EQ(evictor.Insert(page5, slot5).value(), page2);
+  ASSERT_EQ(evictor.Insert(page6, slot6).value(), page3);
 }
 
 TEST(ClockEviction, SomeDirtyMembersKeptOne) {
   ClockEvictor evictor;
   evictor.Resize(3);
+  EvictorSlot slot0, slot1, slot2, slot3;
 
   PageId page0 = make_test_page(0);
   PageId page1 = make_test_page(1);
   PageId page2 = make_test_page(2);
   PageId page3 = make_test_page(3);
 
-  ASSERT_EQ(evictor.Insert(page0), std::nullopt);
-  ASSERT_EQ(evictor.Insert(page1), std::nullopt);
-  ASSERT_EQ(evictor.Insert(page2), std::nullopt);
-  evictor.MarkUsed(page0);
+  ASSERT_EQ(evictor.Insert(page0, slot0), std::nullopt);
+  ASSERT_EQ(evictor.Insert(page1, slot1), std::nullopt);
+  ASSERT_EQ(evictor.Insert(page2, slot2), std::nullopt);
+  evictor.MarkUsed(slot0);
 
-  ASSERT_EQ(evictor.Insert(page3).value(), page1);
+  ASSERT_EQ(evictor.Insert(page3, slot3).value(), page1);
 }
 
 TEST(ClockEviction, PutGetPattern) {
   ClockEvictor evictor;
   evictor.Resize(2);
+  EvictorSlot slot0, slot1, slot2, slot3;
 
   PageId page0 = make_test_page(0);
   PageId page1 = make_test_page(1);
   PageId page2 = make_test_page(2);
   PageId page3 = make_test_page(3);
 
-  ASSERT_EQ(evictor.Insert(page0), std::nullopt);
-  ASSERT_EQ(evictor.Insert(page1), std::nullopt);
-  evictor.MarkUsed(page0);
-  evictor.MarkUsed(page1);
+  ASSERT_EQ(evictor.Insert(page0, slot0), std::nullopt);
+  ASSERT_EQ(evictor.Insert(page1, slot1), std::nullopt);
+  evictor.MarkUsed(slot0);
+  evictor.MarkUsed(slot1);
 
-  ASSERT_EQ(evictor.Insert(page2).value(), page0);
-  ASSERT_EQ(evictor.Insert(page3).value(), page1);
+  ASSERT_EQ(evictor.Insert(page2, slot2).value(), page0);
+  ASSERT_EQ(evictor.Insert(page3, slot3).value(), page1);
 }
 
 TEST(ClockEviction, SomeDirtyMembersKeptTwo) {
   ClockEvictor evictor;
   evictor.Resize(2);
+  EvictorSlot slot0, slot1, slot2, slot3;
 
   PageId page0 = make_test_page(0);
   PageId page1 = make_test_page(1);
   PageId page2 = make_test_page(2);
   PageId page3 = make_test_page(3);
 
-  ASSERT_EQ(evictor.Insert(page0), std::nullopt);
-  ASSERT_EQ(evictor.Insert(page1), std::nullopt);
+  ASSERT_EQ(evictor.Insert(page0, slot0), std::nullopt);
+  ASSERT_EQ(evictor.Insert(page1, slot1), std::nullopt);
 
-  ASSERT_EQ(evictor.Insert(page2).value(), page0);
-  ASSERT_EQ(evictor.Insert(page3).value(), page1);
+  ASSERT_EQ(evictor.Insert(page2, slot2).value(), page0);
+  ASSERT_EQ(evictor.Insert(page3, slot3).value(), page1);
 }
 
 TEST(ClockEviction, MarkUnknownUsed) {
   ClockEvictor evictor;
   evictor.Resize(3);
 
-  auto page0 = make_test_page(0);
-  evictor.MarkUsed(page0);
+  evictor.MarkUsed(0);
   ASSERT_TRUE(true);
-}
\ No newline at end of file
+}
+
+TEST(ClockEviction, SlotsAreReusedAfterRemoval) {
+  ClockEvictor evictor;
+  evictor.Resize(2);
+  EvictorSlot slot0, slot1, slot2;
+
+  PageId page0 = make_test_page(0);
+  PageId page1 = make_test_page(1);
+  PageId page2 = make_test_page(2);
+
+  ASSERT_EQ(evictor.Insert(page0, slot0), std::nullopt);
+  ASSERT_EQ(evictor.Insert(page1, slot1), std::nullopt);
+  ASSERT_NE(slot0, slot1);
+
+  // The removed page is never evicted, its slot is taken first
+  evictor.MarkForRemoval(slot0);
+  ASSERT_EQ(evictor.Insert(page2, slot2), std::nullopt);
+  ASSERT_EQ(slot2, slot0);
+  ASSERT_EQ(evictor.Insert(page0, slot0).value(), page1);
+}
+
+TEST(LruEviction, LeastRecentlyUsedEvicted) {
+  LruEvictor evictor;
+  evictor.Resize(3);
+  EvictorSlot slot0, slot1, slot2, slot3;
+
+  PageId page0 = make_test_page(0);
+  PageId page1 = make_test_page(1);
+  PageId page2 = make_test_page(2);
+  PageId page3 = make_test_page(3);
+
+  ASSERT_EQ(evictor.Insert(page0, slot0), std::nullopt);
+  ASSERT_EQ(evictor.Insert(page1, slot1), std::nullopt);
+  ASSERT_EQ(evictor.Insert(page2, slot2), std::nullopt);
+  evictor.MarkUsed(slot0);
+
+  ASSERT_EQ(evictor.Insert(page3, slot3).value(), page1);
+  ASSERT_EQ(slot3, slot1);
+  ASSERT_EQ(evictor.Insert(page1, slot1).value(), page2);
+  ASSERT_EQ(evictor.Insert(page2, slot2).value(), page0);
+}
+
+TEST(LruEviction, RemovedSlotsAreReused) {
+  LruEvictor evictor;
+  evictor.Resize(2);
+  EvictorSlot slot0, slot1, slot2;
+
+  PageId page0 = make_test_page(0);
+  PageId page1 = make_test_page(1);
+  PageId page2 = make_test_page(2);
+
+  ASSERT_EQ(evictor.Insert(page0, slot0), std::nullopt);
+  ASSERT_EQ(evictor.Insert(page1, slot1), std::nullopt);
+  evictor.MarkForRemoval(slot1);
+  evictor.MarkUsed(slot1);
+
+  ASSERT_EQ(evictor.Insert(page2, slot2), std::nullopt);
+  ASSERT_EQ(slot2, slot1);
+  ASSERT_EQ(evictor.Insert(page1, slot1).value(), page0);
+}
+
+TEST(LruKEviction, PagesUsedOnceEvictedFirst) {
+  LruKEvictor evictor(2);
+  evictor.Resize(3);
+  EvictorSlot slot0, slot1, slot2, slot3, slot4;
+
+  PageId page0 = make_test_page(0);
+  PageId page1 = make_test_page(1);
+  PageId page2 = make_test_page(2);
+  PageId page3 = make_test_page(3);
+  PageId page4 = make_test_page(4);
+
+  ASSERT_EQ(evictor.Insert(page0, slot0), std::nullopt);
+  ASSERT_EQ(evictor.Insert(page1, slot1), std::nullopt);
+  evictor.MarkUsed(slot0);
+  evictor.MarkUsed(slot1);
+
+  // A scan of pages used once only ever evicts its own pages
+  ASSERT_EQ(evictor.Insert(page2, slot2), std::nullopt);
+  ASSERT_EQ(evictor.Insert(page3, slot3).value(), page2);
+  ASSERT_EQ(evictor.Insert(page4, slot4).value(), page3);
+
+  // Among pages used twice, the oldest second-to-last access goes first
+  evictor.MarkUsed(slot4);
+  evictor.MarkUsed(slot1);
+  ASSERT_EQ(evictor.Insert(page2, slot2).value(), page0);
+}
+
+TEST(TwoQueueEviction, ScansDoNotEvictHotPages) {
+  TwoQueueEvictor evictor;
+  evictor.Resize(8);
+
+  // Pages that come back after falling out of the FIFO queue are hot
+  std::vector<EvictorSlot> slots(100);
+  for (uint32_t page = 0; page < 8; page++) {
+    ASSERT_EQ(evictor.Insert(make_test_page(page), slots.at(page)),
+              std::nullopt);
+  }
+  for (uint32_t page = 8; page < 12; page++) {
+    evictor.Insert(make_test_page(page), slots.at(page));
+  }
+  for (uint32_t page = 0; page < 2; page++) {
+    evictor.Insert(make_test_page(page), slots.at(page));
+  }
+
+  // A long scan of pages never seen before
+  for (uint32_t page = 16; page < 100; page++) {
+    std::optional<PageId> evicted =
+        evictor.Insert(make_test_page(page), slots.at(page));
+    ASSERT_TRUE(evicted.has_value());
+    ASSERT_GE(evicted.value().page, 2);
+  }
+}
@@ -0,0 +1,79 @@
+#include "file_cache.hpp"
+
+#include <gtest/gtest.h>
+
+#include <array>
+#include <cstddef>
+#include <filesystem>
+#include <fstream>
+#include <string>
+
+#include "naming.hpp"
+#include "testutil.hpp"
+
+std::string write_test_file(const DbNaming& naming, const std::string& name,
+                            const std::string& contents) {
+  std::string filename = naming.dirpath / name;
+  std::ofstream file(filename, std::ofstream::binary | std::ofstream::trunc);
+  file << contents;
+  return filename;
+}
+
+TEST(FileCache, ReadsAtOffset) {
+  auto naming = create_dir("FileCache.ReadsAtOffset");
+  std::string filename = write_test_file(naming, "file", "0123456789");
+  FileCache cache(4);
+
+  std::array<std::byte, 4> buf{};
+  ASSERT_EQ(cache.Read(filename, 3, buf.data(), buf.size()), 4);
+  ASSERT_EQ(static_cast<char>(buf.at(0)), '3');
+  ASSERT_EQ(static_cast<char>(buf.at(3)), '6');
+}
+
+TEST(FileCache, ShortReadAtEndOfFile) {
+  auto naming = create_dir("FileCache.ShortReadAtEndOfFile");
+  std::string filename = write_test_file(naming, "file", "0123456789");
+  FileCache cache(4);
+
+  std::array<std::byte, 4> buf{};
+  ASSERT_EQ(cache.Read(filename, 8, buf.data(), buf.size()), 2);
+  ASSERT_EQ(cache.Read(filename, 10, buf.data(), buf.size()), 0);
+}
+
+TEST(FileCache, ClosesLeastRecentlyUsedFile) {
+  auto naming = create_dir("FileCache.ClosesLeastRecentlyUsedFile");
+  std::string a = write_test_file(naming, "a", "a");
+  std::string b = write_test_file(naming, "b", "b");
+  std::string c = write_test_file(naming, "c", "c");
+  FileCache cache(2);
+
+  std::array<std::byte, 1> buf{};
+  cache.Read(a, 0, buf.data(), buf.size());
+  cache.Read(b, 0, buf.data(), buf.size());
+  cache.Read(a, 0, buf.data(), buf.size());
+  ASSERT_EQ(cache.OpenFiles(), 2);
+
+  // b is the least recently used, and is closed
+  cache.Read(c, 0, buf.data(), buf.size());
+  ASSERT_EQ(cache.OpenFiles(), 2);
+  cache.Close(a);
+  cache.Close(c);
+  ASSERT_EQ(cache.OpenFiles(), 0);
+}
+
+TEST(FileCache, ReopensReplacedFileAfterClose) {
+  auto naming = create_dir("FileCache.ReopensReplacedFileAfterClose");
+  std::string filename = write_test_file(naming, "file", "old");
+  FileCache cache(4);
+
+  std::array<std::byte, 1> buf{};
+  cache.Read(filename, 0, buf.data(), buf.size());
+  ASSERT_EQ(static_cast<char>(buf.at(0)), 'o');
+
+  cache.Close(filename);
+  std::filesystem::remove(filename);
+  write_test_file(naming, "file", "new");
+
+  cache.Read(filename, 0, buf.data(), buf.size());
+  ASSERT_EQ(static_cast<char>(buf.at(0)), 'n');
+}
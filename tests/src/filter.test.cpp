@@ -3,6 +3,7 @@
 #include <gtest/gtest.h>
 
 #include <cassert>
+#include <cmath>
 #include <filesystem>
 #include <fstream>
 #include <utility>
@@ -178,3 +179,132 @@ TEST(Filter, DoesNotHaveElement) {
 
   ASSERT_FALSE(f.Has(filt_name, 2048));
 }
+
+TEST(Filter, LookupsOnlyReadTheirBlock) {
+  auto naming = create_dir("Filter.LookupsOnlyReadTheirBlock");
+  auto buf = test_buffer();
+  auto keys = test_keys(1);
+
+  auto filt_name = filter_file(naming, 0, 0, 0);
+  {
+    Filter f(naming, buf, 0);
+    f.Create(filt_name, keys);
+    ASSERT_TRUE(f.Has(filt_name, 0));
+    ASSERT_TRUE(f.Has(filt_name, 0));
+
+    // The metadata page is never read, the single block page is read once
+    BufPoolStats stats = buf.Stats();
+    ASSERT_EQ(stats.misses, 1);
+    ASSERT_EQ(stats.hits, 1);
+  }
+
+  // A filter that did not create the file reads its metadata page once
+  Filter f(naming, buf, 0);
+  ASSERT_TRUE(f.Has(filt_name, 0));
+  ASSERT_TRUE(f.Has(filt_name, 0));
+  BufPoolStats stats = buf.Stats();
+  ASSERT_EQ(stats.misses, 2);
+  ASSERT_EQ(stats.hits, 3);
+}
+
+TEST(Filter, ResidentFiltersSkipTheBufferPool) {
+  auto naming = create_dir("Filter.ResidentFiltersSkipTheBufferPool");
+  auto buf = test_buffer();
+  auto keys = test_keys(1024);
+  ResidentFilters resident(kPageSize);
+
+  auto filt_name = filter_file(naming, 0, 0, 0);
+  Filter f(naming, buf, 0, &resident);
+  f.Create(filt_name, keys);
+  for (auto &key : keys) {
+    ASSERT_TRUE(f.Has(filt_name, key.first));
+  }
+
+  BufPoolStats stats = buf.Stats();
+  ASSERT_EQ(stats.hits + stats.misses, 0);
+  ASSERT_EQ(resident.Stats().files, 1);
+
+  f.Delete(filt_name);
+  ASSERT_EQ(resident.Stats().bytes, 0);
+}
+
+TEST(Filter, ResidentFiltersStayWithinBudget) {
+  auto naming = create_dir("Filter.ResidentFiltersStayWithinBudget");
+  auto buf = test_buffer();
+  auto keys = test_keys(1024);
+  ResidentFilters resident(kPageSize);
+
+  auto first = filter_file(naming, 0, 0, 0);
+  auto second = filter_file(naming, 0, 0, 1);
+  Filter f(naming, buf, 0, &resident);
+  f.Create(first, keys);
+  f.Create(second, keys);
+  ASSERT_EQ(resident.Stats().files, 1);
+  ASSERT_EQ(resident.Stats().bytes, kPageSize);
+
+  // The filter past the budget is still served, through the buffer pool
+  for (auto &key : keys) {
+    ASSERT_TRUE(f.Has(second, key.first));
+  }
+  ASSERT_GT(buf.Stats().hits, 0);
+
+  // Once the first is deleted, the second fits
+  f.Delete(first);
+  f.Load(second);
+  ASSERT_NE(resident.Get(second), nullptr);
+}
+
+int count_false_positives(Filter &f, std::string &filename, K from, K to) {
+  int false_positives = 0;
+  for (K key = from; key < to; key++) {
+    false_positives += f.Has(filename, key);
+  }
+  return false_positives;
+}
+
+TEST(Filter, MoreBitsPerEntryFewerFalsePositives) {
+  auto naming = create_dir("Filter.MoreBitsPerEntryFewerFalsePositives");
+  auto buf = test_buffer();
+  auto keys = test_keys(4096);
+
+  auto small = filter_file(naming, 0, 0, 0);
+  auto large = filter_file(naming, 0, 0, 1);
+  {
+    Filter f(naming, buf, 0);
+    f.Create(small, keys, 2);
+    f.Create(large, keys, 12);
+  }
+
+  // A new serializer reads the sizing back from the files
+  Filter f(naming, buf, 0);
+  for (auto &key : keys) {
+    ASSERT_TRUE(f.Has(small, key.first));
+    ASSERT_TRUE(f.Has(large, key.first));
+  }
+  ASSERT_LT(count_false_positives(f, large, 4096, 4096 * 4),
+            count_false_positives(f, small, 4096, 4096 * 4));
+  ASSERT_GT(std::filesystem::file_size(large),
+            std::filesystem::file_size(small));
+}
+
+TEST(Filter, MonkeyKeepsTheAverageBitsPerEntry) {
+  for (uint32_t levels = 1; levels <= 6; levels++) {
+    for (uint8_t ratio = 2; ratio <= 4; ratio++) {
+      double entries = 0;
+      double bits = 0;
+      double level_entries = 1;
+      double prev = INFINITY;
+      for (uint32_t level = 0; level < levels; level++) {
+        double level_bits = monkey_bits_per_entry(level, levels, ratio, 5);
+        // Deeper levels get fewer bits per entry
+        ASSERT_LT(level_bits, prev);
+        prev = level_bits;
+
+        entries += level_entries;
+        bits += level_entries * level_bits;
+        level_entries *= ratio;
+      }
+      ASSERT_NEAR(bits / entries, 5, 1e-9);
+    }
+  }
+}
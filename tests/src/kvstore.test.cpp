@@ -2,18 +2,24 @@
 
 #include <gtest/gtest.h>
 
+#include <atomic>
 #include <cmath>
 #include <cstdlib>
 #include <functional>
 #include <iostream>
+#include <map>
 #include <memory>
 #include <optional>
 #include <random>
+#include <set>
 #include <sstream>
+#include <thread>
 #include <string>
 #include <vector>
 
 #include "memtable.hpp"
+#include "minheap.hpp"
+#include "naming.hpp"
 #include "sstable.hpp"
 #include "testutil.hpp"
 
@@ -96,6 +102,98 @@ TEST(KvStore, ScanGoesBeyondKeySizes) {
   ASSERT_EQ(v[2].second, 30);
 }
 
+void iterator_matches_scan(const std::string& name, DataFileFormat format) {
+  std::filesystem::remove_all("/tmp/" + name);
+
+  KvStore table;
+  table.Open(name, Options{
+                       .dir = "/tmp",
+                       .memory_buffer_elements = 30,
+                       .serialization = format,
+                   });
+  for (int i = 0; i < 3000; i++) {
+    table.Put(i, i);
+  }
+  for (int i = 0; i < 3000; i += 3) {
+    table.Put(i, 2 * i);
+  }
+  for (int i = 0; i < 3000; i += 5) {
+    table.Delete(i);
+  }
+
+  // Deleted keys are skipped, and newer values win
+  std::unique_ptr<KvIterator> it = table.NewIterator(100, 2000);
+  for (int i = 100; i <= 2000; i++) {
+    if (i % 5 == 0) {
+      continue;
+    }
+    ASSERT_TRUE(it->Valid());
+    ASSERT_EQ(it->Key(), i);
+    ASSERT_EQ(it->Value(), i % 3 == 0 ? 2 * i : i);
+    it->Next();
+  }
+  ASSERT_FALSE(it->Valid());
+
+  // Seeking stays within the range
+  it->Seek(0);
+  ASSERT_EQ(it->Key(), 101);
+  it->Seek(1500);
+  ASSERT_EQ(it->Key(), 1501);
+  it->Seek(2001);
+  ASSERT_FALSE(it->Valid());
+  it.reset();
+
+  std::vector<std::pair<K, V>> scanned = table.Scan(0, 5000);
+  ASSERT_EQ(scanned.size(), 3000 - 600);
+  for (const auto& [key, value] : scanned) {
+    ASSERT_NE(key % 5, 0);
+    ASSERT_NE(value, kTombstoneValue);
+  }
+}
+
+TEST(KvStore, IteratorMatchesScan) {
+  iterator_matches_scan("KvStore.IteratorMatchesScan", DataFileFormat::kBTree);
+}
+
+TEST(KvStore, IteratorMatchesScanFlatFiles) {
+  iterator_matches_scan("KvStore.IteratorMatchesScanFlatFiles",
+                        DataFileFormat::kFlatSorted);
+}
+
+TEST(KvStore, WriterHoldsIteratorThroughCompactions) {
+  std::string name = "KvStore.WriterHoldsIteratorThroughCompactions";
+  std::filesystem::remove_all("/tmp/" + name);
+
+  KvStore table;
+  table.Open(name, Options{
+                       .dir = "/tmp",
+                       .memory_buffer_elements = 10,
+                       .tiers = 2,
+                   });
+  for (int i = 0; i < 100; i++) {
+    table.Put(i, i);
+  }
+
+  // The runs the iterator reads are compacted away under it, and the flushes
+  // go on without waiting for it
+  std::unique_ptr<KvIterator> it = table.NewIterator(0, 99);
+  for (int i = 0; i < 1000; i++) {
+    table.Put(i % 100, i);
+  }
+  for (int i = 0; i < 100; i++) {
+    ASSERT_TRUE(it->Valid());
+    ASSERT_EQ(it->Key(), i);
+    ASSERT_EQ(it->Value(), i);
+    it->Next();
+  }
+  ASSERT_FALSE(it->Valid());
+  it.reset();
+
+  for (int i = 0; i < 100; i++) {
+    ASSERT_EQ(table.Get(i), 900 + i);
+  }
+}
+
 TEST(KvStore, UnopenedGetThrow) {
   KvStore db;
   ASSERT_THROW(
@@ -702,6 +800,98 @@ TEST(KvStore, BatchLevelStructure) {
   }
 }
 
+/**
+ * @brief The runs of each level that have data files, by level.
+ */
+std::map<int, std::set<int>> runs_on_disk(const std::string& dir) {
+  std::map<int, std::set<int>> runs;
+  for (const auto& entry : std::filesystem::directory_iterator(dir)) {
+    std::string filename = entry.path().string();
+    if (filename.find(".DATA.") != std::string::npos) {
+      runs[parse_data_file_level(filename)].insert(
+          parse_data_file_run(filename));
+    }
+  }
+  return runs;
+}
+
+void compaction_policy_keeps_data(const std::string& name,
+                                  CompactionPolicy policy,
+                                  std::size_t max_subcompactions = 1) {
+  std::filesystem::remove_all("/tmp/" + name);
+  Options options{
+      .dir = "/tmp",
+      .memory_buffer_elements = 10,
+      .tiers = 3,
+      .compaction_policy = policy,
+      .max_subcompactions = max_subcompactions,
+  };
+
+  KvStore table;
+  table.Open(name, options);
+
+  std::map<K, V> expected;
+  std::mt19937 g(policy);
+  std::uniform_int_distribution<K> keys(0, 499);
+  for (int op = 0; op < 3000; op++) {
+    K key = keys(g);
+    if (g() % 10 < 3) {
+      table.Delete(key);
+      expected.erase(key);
+    } else {
+      table.Put(key, op);
+      expected[key] = op;
+    }
+
+    if (op % 25 != 0) {
+      continue;
+    }
+
+    // Tiered levels never hold `tiers` runs, leveled levels at most one
+    std::map<int, std::set<int>> runs = runs_on_disk("/tmp/" + name);
+    for (const auto& [level, level_runs] : runs) {
+      bool is_last = level == runs.rbegin()->first;
+      bool leveled =
+          policy == kLeveling || (policy == kLazyLeveling && is_last);
+      ASSERT_LE(level_runs.size(), leveled ? 1 : 2);
+    }
+  }
+
+  // Including after reopening, where the runs of a level are discovered
+  for (int reopen = 0; reopen < 2; reopen++) {
+    for (K key = 0; key < 500; key++) {
+      auto it = expected.find(key);
+      ASSERT_EQ(table.Get(key), it == expected.end()
+                                    ? std::nullopt
+                                    : std::make_optional(it->second));
+    }
+    std::vector<std::pair<K, V>> pairs(expected.begin(), expected.end());
+    ASSERT_EQ(table.Scan(0, 499), pairs);
+
+    table.Close();
+    table.Open(name, options);
+  }
+  table.Close();
+}
+
+TEST(KvStore, TieringKeepsAllData) {
+  compaction_policy_keeps_data("KvStore.TieringKeepsAllData", kTiering);
+}
+
+TEST(KvStore, LevelingKeepsAllData) {
+  compaction_policy_keeps_data("KvStore.LevelingKeepsAllData", kLeveling);
+}
+
+TEST(KvStore, LazyLevelingKeepsAllData) {
+  compaction_policy_keeps_data("KvStore.LazyLevelingKeepsAllData",
+                               kLazyLeveling);
+}
+
+TEST(KvStore, SubcompactionsKeepAllData) {
+  compaction_policy_keeps_data("KvStore.SubcompactionsKeepAllData", kLeveling,
+                               4);
+}
+
 TEST(KvStore, InsertManyAndGetMany) {
   std::filesystem::remove_all("/tmp/KvStore.InsertManyAndGetMany");
 
@@ -732,6 +922,73 @@ TEST(KvStore, InsertManyAndGetMany) {
   ASSERT_EQ(val4.value(), 40);
 }
 
+TEST(KvStore, MultiGetMatchesGet) {
+  std::filesystem::remove_all("/tmp/KvStore.MultiGetMatchesGet");
+
+  KvStore table;
+  table.Open("KvStore.MultiGetMatchesGet", Options{
+                                               .dir = "/tmp",
+                                               .memory_buffer_elements = 30,
+                                           });
+  for (int i = 0; i < 2000; i++) {
+    table.Put(i, i);
+  }
+  // Newer values and deletes in younger levels and in the memtable
+  for (int i = 0; i < 2000; i += 3) {
+    table.Put(i, 2 * i);
+  }
+  for (int i = 0; i < 2000; i += 7) {
+    table.Delete(i);
+  }
+
+  // Out of order, with repeats and keys that were never put
+  std::vector<K> keys;
+  for (int i = 2500; i >= 0; i -= 2) {
+    keys.push_back(i);
+    keys.push_back(i % 100);
+  }
+
+  std::vector<std::optional<V>> values = table.MultiGet(keys);
+  ASSERT_EQ(values.size(), keys.size());
+  for (std::size_t i = 0; i < keys.size(); i++) {
+    ASSERT_EQ(values[i], table.Get(keys[i]));
+  }
+  ASSERT_TRUE(table.MultiGet({}).empty());
+}
+
+TEST(KvStore, MultiGetSharesPages) {
+  std::filesystem::remove_all("/tmp/KvStore.MultiGetSharesPages");
+
+  KvStore table;
+  table.Open("KvStore.MultiGetSharesPages", Options{
+                                                .dir = "/tmp",
+                                                .memory_buffer_elements = 300,
+                                            });
+  for (int i = 0; i < 5000; i++) {
+    table.Put(i, i);
+  }
+
+  std::vector<K> keys;
+  for (int i = 0; i < 5000; i += 5) {
+    keys.push_back(i);
+  }
+
+  BufferPoolStats before = table.BufferPoolStatistics();
+  for (K key : keys) {
+    ASSERT_EQ(table.Get(key), std::make_optional(key));
+  }
+  BufferPoolStats middle = table.BufferPoolStatistics();
+  std::vector<std::optional<V>> values = table.MultiGet(keys);
+  BufferPoolStats after = table.BufferPoolStatistics();
+
+  for (std::size_t i = 0; i < keys.size(); i++) {
+    ASSERT_EQ(values[i], std::make_optional(keys[i]));
+  }
+  uint64_t gets = middle.hits + middle.misses - before.hits - before.misses;
+  uint64_t multi_get = after.hits + after.misses - middle.hits - middle.misses;
+  ASSERT_LT(multi_get * 5, gets);
+}
+
 TEST(KvStore, InsertVeryManyAndGet) {
   std::filesystem::remove_all("/tmp/KvStore.InsertVeryManyAndGet");
 
@@ -752,3 +1009,537 @@ TEST(KvStore, InsertVeryManyAndGet) {
     ASSERT_EQ(val.value(), 2 * i);
   }
 }
+
+TEST(KvStore, BackgroundCompactionInsertAndGet) {
+  std::filesystem::remove_all("/tmp/KvStore.BackgroundCompactionInsertAndGet");
+
+  KvStore table;
+  table.Open("KvStore.BackgroundCompactionInsertAndGet",
+             Options{
+                 .dir = "/tmp",
+                 .memory_buffer_elements = 30,
+                 .background_compaction = true,
+             });
+  for (int i = 0; i < 10 * 1000; i++) {
+    table.Put(i, 2 * i);
+  }
+
+  std::vector<std::pair<K, V>> v = table.Scan(100, 199);
+  ASSERT_EQ(v.size(), 100);
+  for (std::size_t i = 0; i < v.size(); i++) {
+    ASSERT_EQ(v.at(i).first, 100 + i);
+    ASSERT_EQ(v.at(i).second, 2 * (100 + i));
+  }
+
+  for (int i = 0; i < 10 * 1000; i += 2) {
+    table.Delete(i);
+  }
+
+  for (int i = 0; i < 10 * 1000; i++) {
+    const auto val = table.Get(i);
+    if (i % 2 == 0) {
+      ASSERT_EQ(val, std::nullopt);
+    } else {
+      ASSERT_TRUE(val.has_value());
+      ASSERT_EQ(val.value(), 2 * i);
+    }
+  }
+
+  table.Close();
+}
+
+TEST(KvStore, WriteAheadLogRecoversOnReopen) {
+  std::filesystem::remove_all("/tmp/KvStore.WriteAheadLogRecoversOnReopen");
+
+  Options opts = Options{
+      .dir = "/tmp",
+      .memory_buffer_elements = 30,
+      .write_ahead_log = true,
+  };
+
+  {
+    KvStore table;
+    table.Open("KvStore.WriteAheadLogRecoversOnReopen", opts);
+    for (int i = 0; i < 1000; i++) {
+      table.Put(i, 2 * i);
+    }
+    for (int i = 0; i < 1000; i += 2) {
+      table.Delete(i);
+    }
+    table.Close();
+  }
+
+  KvStore table;
+  table.Open("KvStore.WriteAheadLogRecoversOnReopen", opts);
+  for (int i = 0; i < 1000; i++) {
+    const auto val = table.Get(i);
+    if (i % 2 == 0) {
+      ASSERT_EQ(val, std::nullopt);
+    } else {
+      ASSERT_TRUE(val.has_value());
+      ASSERT_EQ(val.value(), 2 * i);
+    }
+  }
+
+  // Writes after recovery are logged and recovered too
+  table.Put(0, 1);
+  table.Close();
+  table.Open("KvStore.WriteAheadLogRecoversOnReopen", opts);
+  ASSERT_EQ(table.Get(0), std::make_optional(1));
+  ASSERT_EQ(table.Get(1), std::make_optional(2));
+}
+
+TEST(KvStore, WriteBatchAppliesInOrder) {
+  std::filesystem::remove_all("/tmp/KvStore.WriteBatchAppliesInOrder");
+
+  Options opts = Options{
+      .dir = "/tmp",
+      .memory_buffer_elements = 30,
+      .write_ahead_log = true,
+  };
+
+  {
+    KvStore table;
+    table.Open("KvStore.WriteBatchAppliesInOrder", opts);
+    WriteBatch batch;
+    for (int round = 0; round < 100; round++) {
+      batch.Clear();
+      for (int i = 0; i < 10; i++) {
+        batch.Put(10 * round + i, round);
+      }
+      batch.Delete(10 * round);
+      batch.Put(10 * round + 1, round + 1);
+      ASSERT_EQ(batch.Size(), 12);
+      table.Write(batch);
+    }
+    ASSERT_THROW(batch.Put(1, kTombstoneValue),
+                 OnlyTheDatabaseCanUseFunnyValuesException);
+    table.Close();
+  }
+
+  // Later writes of a batch win, including after recovery from the log
+  KvStore table;
+  table.Open("KvStore.WriteBatchAppliesInOrder", opts);
+  for (int round = 0; round < 100; round++) {
+    ASSERT_EQ(table.Get(10 * round), std::nullopt);
+    ASSERT_EQ(table.Get(10 * round + 1), std::make_optional(round + 1));
+    for (int i = 2; i < 10; i++) {
+      ASSERT_EQ(table.Get(10 * round + i), std::make_optional(round));
+    }
+  }
+}
+
+void write_batch_too_large_is_not_applied(const std::string& name,
+                                          MemTableFormat memtable_format) {
+  std::filesystem::remove_all("/tmp/" + name);
+
+  KvStore table;
+  table.Open(name, Options{
+                       .dir = "/tmp",
+                       .memory_buffer_elements = 30,
+                       .memtable_format = memtable_format,
+                   });
+
+  WriteBatch batch;
+  for (int i = 0; i < 31; i++) {
+    batch.Put(i, i);
+  }
+  ASSERT_THROW(table.Write(batch), WriteBatchTooLargeException);
+  for (int i = 0; i < 31; i++) {
+    ASSERT_EQ(table.Get(i), std::nullopt);
+  }
+
+  // Repeated keys take no extra room
+  batch.Clear();
+  for (int i = 0; i < 90; i++) {
+    batch.Put(i % 30, i);
+  }
+  table.Write(batch);
+  for (int i = 0; i < 30; i++) {
+    ASSERT_EQ(table.Get(i), std::make_optional(60 + i));
+  }
+}
+
+TEST(KvStore, WriteBatchTooLargeIsNotApplied) {
+  write_batch_too_large_is_not_applied("KvStore.WriteBatchTooLargeIsNotApplied",
+                                       kRedBlackTree);
+}
+
+TEST(KvStore, WriteBatchTooLargeIsNotAppliedSkipList) {
+  write_batch_too_large_is_not_applied(
+      "KvStore.WriteBatchTooLargeIsNotAppliedSkipList", kSkipList);
+}
+
+void failed_log_write_fails_the_write(const std::string& name,
+                                      bool batches) {
+  std::filesystem::remove_all("/tmp/" + name);
+
+  KvStore table;
+  table.Open(name, Options{
+                       .dir = "/tmp",
+                       .write_ahead_log = true,
+                       .wal_sync = WalSyncPolicy::kSyncEveryWrite,
+                   });
+  auto write = [&](K key, V value) {
+    if (batches) {
+      WriteBatch batch;
+      batch.Put(key, value);
+      table.Write(batch);
+    } else {
+      table.Put(key, value);
+    }
+  };
+
+  // Each write logs a record, until the log segment reaches the cap
+  K failed = 0;
+  with_file_size_limit(2 * kPageSize, [&] {
+    for (; failed < 1000; failed++) {
+      try {
+        write(failed, failed);
+      } catch (WriteAheadLogFailedException& e) {
+        break;
+      }
+    }
+  });
+  ASSERT_GT(failed, 0);
+  ASSERT_LT(failed, 1000);
+
+  // No write is taken after the failure, the acknowledged ones are still read,
+  // and the write that failed was never taken
+  ASSERT_THROW(table.Put(failed + 1, 0), WriteAheadLogFailedException);
+  WriteBatch batch;
+  batch.Put(failed + 2, 0);
+  ASSERT_THROW(table.Write(batch), WriteAheadLogFailedException);
+  for (K key = 0; key < failed; key++) {
+    ASSERT_EQ(table.Get(key), std::make_optional(key));
+  }
+  ASSERT_EQ(table.Get(failed), std::nullopt);
+  ASSERT_EQ(table.Get(failed + 1), std::nullopt);
+  ASSERT_EQ(table.Get(failed + 2), std::nullopt);
+}
+
+TEST(KvStore, FailedLogWriteFailsTheWrite) {
+  failed_log_write_fails_the_write("KvStore.FailedLogWriteFailsTheWrite",
+                                   false);
+}
+
+TEST(KvStore, FailedLogWriteFailsTheBatch) {
+  failed_log_write_fails_the_write("KvStore.FailedLogWriteFailsTheBatch", true);
+}
+
+TEST(KvStore, WriteBatchIsSeenWhole) {
+  std::filesystem::remove_all("/tmp/KvStore.WriteBatchIsSeenWhole");
+
+  KvStore table;
+  table.Open("KvStore.WriteBatchIsSeenWhole",
+             Options{
+                 .dir = "/tmp",
+                 .memory_buffer_elements = 25,
+                 .background_compaction = true,
+             });
+
+  // Every batch rewrites the same keys, and adds a new one so that the
+  // memtable keeps filling up and is flushed between batches
+  constexpr int kKeys = 10;
+  std::vector<K> keys;
+  for (int i = 0; i < kKeys; i++) {
+    keys.push_back(i);
+  }
+  WriteBatch batch;
+  for (K key : keys) {
+    batch.Put(key, 0);
+  }
+  table.Write(batch);
+
+  std::atomic<bool> done{false};
+  std::atomic<int> failures{0};
+  std::thread reader([&] {
+    while (!done.load()) {
+      std::vector<std::optional<V>> values = table.MultiGet(keys);
+      for (const auto& value : values) {
+        if (value != values.front()) {
+          failures++;
+        }
+      }
+    }
+  });
+
+  for (int round = 1; round < 2000; round++) {
+    batch.Clear();
+    for (K key : keys) {
+      batch.Put(key, round);
+    }
+    batch.Put(1000 + round, round);
+    table.Write(batch);
+  }
+  done.store(true);
+  reader.join();
+
+  ASSERT_EQ(failures.load(), 0);
+  ASSERT_EQ(table.MultiGet(keys),
+            std::vector<std::optional<V>>(kKeys, std::make_optional(1999)));
+}
+
+TEST(KvStore, WriteAheadLogWithBackgroundCompaction) {
+  std::filesystem::remove_all(
+      "/tmp/KvStore.WriteAheadLogWithBackgroundCompaction");
+
+  Options opts = Options{
+      .dir = "/tmp",
+      .memory_buffer_elements = 30,
+      .background_compaction = true,
+      .write_ahead_log = true,
+      .wal_sync = WalSyncPolicy::kSyncNone,
+  };
+
+  {
+    KvStore table;
+    table.Open("KvStore.WriteAheadLogWithBackgroundCompaction", opts);
+    for (int i = 0; i < 1000; i++) {
+      table.Put(i, 2 * i);
+    }
+    table.Close();
+  }
+
+  KvStore table;
+  table.Open("KvStore.WriteAheadLogWithBackgroundCompaction", opts);
+  for (int i = 0; i < 1000; i++) {
+    const auto val = table.Get(i);
+    ASSERT_TRUE(val.has_value());
+    ASSERT_EQ(val.value(), 2 * i);
+  }
+}
+
+void concurrent_readers_with_writer(
+    const std::string& name, bool background_compaction,
+    MemTableFormat memtable_format = kRedBlackTree) {
+  std::filesystem::remove_all("/tmp/" + name);
+
+  KvStore table;
+  table.Open(name, Options{
+                       .dir = "/tmp",
+                       .memory_buffer_elements = 50,
+                       .memtable_format = memtable_format,
+                       .background_compaction = background_compaction,
+                       .buffer_pool_shards = 4,
+                   });
+
+  const int existing = 1000;
+  for (int i = 0; i < existing; i++) {
+    table.Put(i, 2 * i);
+  }
+
+  // Readers check the keys that were there before they started, while the
+  // writer keeps flushing and compacting underneath them.
+  std::atomic<bool> done{false};
+  std::atomic<int> failures{0};
+  std::vector<std::thread> readers;
+  for (int r = 0; r < 4; r++) {
+    readers.emplace_back([&, r] {
+      std::mt19937 g(r);
+      std::uniform_int_distribution<int> dist(0, existing - 1);
+      while (!done.load()) {
+        int key = dist(g);
+        if (table.Get(key) != std::make_optional<V>(2 * key)) {
+          failures++;
+        }
+
+        auto v = table.Scan(key, key + 9);
+        for (std::size_t i = 0; i < v.size(); i++) {
+          if (v.at(i).first != key + i) {
+            failures++;
+          }
+        }
+      }
+    });
+  }
+
+  for (int i = existing; i < 4 * existing; i++) {
+    table.Put(i, 2 * i);
+  }
+  done.store(true);
+  for (auto& reader : readers) {
+    reader.join();
+  }
+
+  ASSERT_EQ(failures.load(), 0);
+  for (int i = 0; i < 4 * existing; i++) {
+    ASSERT_EQ(table.Get(i), std::make_optional<V>(2 * i));
+  }
+  table.Close();
+}
+
+TEST(KvStore, ConcurrentReadersWithWriter) {
+  concurrent_readers_with_writer("KvStore.ConcurrentReadersWithWriter", false);
+}
+
+TEST(KvStore, ConcurrentReadersWithBackgroundCompaction) {
+  concurrent_readers_with_writer(
+      "KvStore.ConcurrentReadersWithBackgroundCompaction", true);
+}
+
+TEST(KvStore, ConcurrentReadersWithSkipListMemTable) {
+  concurrent_readers_with_writer(
+      "KvStore.ConcurrentReadersWithSkipListMemTable", true, kSkipList);
+}
+
+TEST(KvStore, ConcurrentReadersWithVectorMemTable) {
+  concurrent_readers_with_writer(
+      "KvStore.ConcurrentReadersWithVectorMemTable", true, kVector);
+}
+
+TEST(KvStore, EveryEvictionPolicyServesReads) {
+  for (BufferPoolEviction eviction :
+       {kEvictClock, kEvictLru, kEvictLruK, kEvict2Q}) {
+    std::string name =
+        "KvStore.EveryEvictionPolicyServesReads" + std::to_string(eviction);
+    std::filesystem::remove_all("/tmp/" + name);
+
+    KvStore table;
+    table.Open(name, Options{
+                         .dir = "/tmp",
+                         .memory_buffer_elements = 30,
+                         .buffer_pages_initial = 4,
+                         .buffer_pages_maximum = 16,
+                         .buffer_pool_eviction = eviction,
+                     });
+    for (int i = 0; i < 2000; i++) {
+      table.Put(i, 2 * i);
+    }
+
+    for (int i = 0; i < 2000; i++) {
+      ASSERT_EQ(table.Get(i), std::make_optional(2 * i));
+    }
+    for (int i = 0; i < 2000; i++) {
+      ASSERT_EQ(table.Get(i % 10), std::make_optional(2 * (i % 10)));
+    }
+
+    BufferPoolStats stats = table.BufferPoolStatistics();
+    ASSERT_GT(stats.hits, 0);
+    ASSERT_GT(stats.misses, 0);
+    ASSERT_GT(stats.evictions, 0);
+  }
+}
+
+TEST(KvStore, ResidentFiltersAreLoadedOnOpen) {
+  std::string name = "KvStore.ResidentFiltersAreLoadedOnOpen";
+  std::filesystem::remove_all("/tmp/" + name);
+  Options options{
+      .dir = "/tmp",
+      .memory_buffer_elements = 30,
+      .resident_filter_bytes = 1 << 20,
+  };
+
+  uint64_t resident_files = 0;
+  {
+    KvStore table;
+    table.Open(name, options);
+    for (int i = 0; i < 600; i++) {
+      table.Put(2 * i, i);
+    }
+
+    FilterMemoryStats stats = table.FilterMemoryStatistics();
+    ASSERT_GT(stats.resident_files, 0);
+    ASSERT_EQ(stats.resident_bytes, stats.resident_files * kPageSize);
+    ASSERT_EQ(stats.budget_bytes, 1 << 20);
+    resident_files = stats.resident_files;
+    table.Close();
+  }
+
+  KvStore table;
+  table.Open(name, options);
+  ASSERT_EQ(table.FilterMemoryStatistics().resident_files, resident_files);
+
+  // Keys that are not in the database only check the resident filters, and
+  // only read data pages on a false positive
+  BufferPoolStats before = table.BufferPoolStatistics();
+  for (int i = 1; i < 1200; i += 2) {
+    ASSERT_EQ(table.Get(i), std::nullopt);
+  }
+  BufferPoolStats after = table.BufferPoolStatistics();
+  ASSERT_LT(after.misses + after.hits - before.misses - before.hits, 600 / 10);
+}
+
+TEST(KvStore, BulkLoadGoesStraightToItsLevel) {
+  std::string name = "KvStore.BulkLoadGoesStraightToItsLevel";
+  std::filesystem::remove_all("/tmp/" + name);
+  Options options{
+      .dir = "/tmp",
+      .memory_buffer_elements = 10,
+      .tiers = 3,
+      .write_ahead_log = true,
+  };
+
+  std::map<K, V> expected;
+  std::vector<std::pair<K, V>> pairs;
+  for (K key = 0; key < 1000; key++) {
+    pairs.emplace_back(2 * key, key);
+    expected[2 * key] = key;
+  }
+  VectorCursor cursor(pairs);
+
+  {
+    KvStore table;
+    table.Open(name, options);
+    table.BulkLoad(cursor);
+
+    // 100 files fill a run of level 5, merged from 3^5 memtables
+    std::map<int, std::set<int>> runs = runs_on_disk("/tmp/" + name);
+    ASSERT_EQ(runs.size(), 1);
+    ASSERT_EQ(runs[5].size(), 1);
+    ASSERT_EQ(table.Scan(0, 2000), pairs);
+
+    // Later writes are newer than the loaded pairs, through compactions
+    std::mt19937 g(0);
+    std::uniform_int_distribution<K> keys(0, 3000);
+    for (V i = 0; i < 2000; i++) {
+      K key = keys(g);
+      if (i % 5 == 0) {
+        table.Delete(key);
+        expected.erase(key);
+      } else {
+        table.Put(key, i);
+        expected[key] = i;
+      }
+    }
+    ASSERT_THROW(table.BulkLoad(cursor), DatabaseNotEmptyException);
+    std::vector<std::pair<K, V>> survivors(expected.begin(), expected.end());
+    ASSERT_EQ(table.Scan(0, 3000), survivors);
+    table.Close();
+  }
+
+  KvStore table;
+  table.Open(name, options);
+  std::vector<std::pair<K, V>> survivors(expected.begin(), expected.end());
+  ASSERT_EQ(table.Scan(0, 3000), survivors);
+}
+
+TEST(KvStore, BulkLoadChecksPairsFirst) {
+  std::string name = "KvStore.BulkLoadChecksPairsFirst";
+  std::filesystem::remove_all("/tmp/" + name);
+
+  KvStore table;
+  table.Open(name, Options{.dir = "/tmp", .memory_buffer_elements = 10});
+
+  std::vector<std::pair<K, V>> pairs;
+  for (K key = 0; key < 100; key++) {
+    pairs.emplace_back(key, key);
+  }
+  pairs.emplace_back(50, 50);
+  VectorCursor unsorted(pairs);
+  ASSERT_THROW(table.BulkLoad(unsorted), BulkLoadNotSortedException);
+
+  pairs.back() = {100, kTombstoneValue};
+  VectorCursor tombstone(pairs);
+  ASSERT_THROW(table.BulkLoad(tombstone),
+               OnlyTheDatabaseCanUseFunnyValuesException);
+  ASSERT_TRUE(runs_on_disk("/tmp/" + name).empty());
+
+  // Nothing was loaded, so the pairs can still be loaded once they are fixed
+  pairs.pop_back();
+  VectorCursor sorted(pairs);
+  table.BulkLoad(sorted);
+  for (K key = 0; key < 100; key++) {
+    ASSERT_EQ(table.Get(key), std::make_optional(key));
+  }
+}
@@ -2,10 +2,25 @@
 
 #include <gtest/gtest.h>
 
+#include <algorithm>
+#include <memory>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
 #include "buf.hpp"
 #include "constants.hpp"
 #include "testutil.hpp"
 
+FilterTuning test_filter_tuning() {
+  return FilterTuning{
+      .bits_per_entry = kDefaultBitsPerEntry,
+      .monkey = false,
+      .resident = nullptr,
+  };
+}
+
 TEST(LSMRun, Initialize) {
   DbNaming naming = create_dir("LSMRun.Initialize");
   BufPool buf(BufPoolTuning{
@@ -102,7 +117,8 @@ TEST(LSMLevel, Initialize) {
   SstableBTree serializer(buf);
   Manifest manifest(naming, 4, serializer, true);
 
-  LSMLevel lsm(naming, 4, 0, false, 20, manifest, buf, serializer);
+  LSMLevel lsm(naming, 4, 0, kTiering, 20, manifest, buf, serializer,
+               test_filter_tuning());
 
   ASSERT_EQ(1, 1);
 }
@@ -116,7 +132,141 @@ TEST(LSMLevel, LevelCorrect) {
   SstableBTree serializer(buf);
   Manifest manifest(naming, 4, serializer, true);
 
-  LSMLevel lsm(naming, 4, 1, false, 20, manifest, buf, serializer);
+  LSMLevel lsm(naming, 4, 1, kTiering, 20, manifest, buf, serializer,
+               test_filter_tuning());
 
   ASSERT_EQ(lsm.Level(), 1);
 }
+
+TEST(LSMLevel, CompactionKeepsNewestValues) {
+  DbNaming naming = create_dir("LSMLevel.CompactionKeepsNewestValues");
+  BufPool buf(BufPoolTuning{
+      .initial_elements = 4,
+      .max_elements = 16,
+  });
+  SstableBTree serializer(buf);
+  Filter filter(naming, buf, 0);
+  Manifest manifest(naming, 3, serializer, true);
+
+  LSMLevel lsm(naming, 3, 0, kTiering, 4, manifest, buf, serializer,
+               test_filter_tuning());
+
+  // Run r holds keys r to r + 7 over two files, so every run overlaps the
+  // others and the newest run holds most keys.
+  std::vector<std::shared_ptr<LSMRun>> overflow;
+  for (int r = 0; r < 3; r++) {
+    auto run = std::make_shared<LSMRun>(naming, 0, r, 3, 4, manifest, buf,
+                                        serializer, filter);
+    for (int f = 0; f < 2; f++) {
+      std::vector<std::pair<K, V>> keys{};
+      K first = r + 4 * f;
+      for (K key = first; key < first + 4; key++) {
+        keys.emplace_back(key, 10 * r + key);
+      }
+      std::string filename = data_file(naming, 0, r, f);
+      serializer.Flush(filename, keys, true);
+      std::string filter_name = filter_file(naming, 0, r, f);
+      filter.Create(filter_name, keys);
+      run->RegisterNewFile(f, keys.front().first, keys.back().first);
+    }
+    overflow = lsm.RegisterNewRun(run, std::nullopt);
+    ASSERT_EQ(overflow.size(), r == 2 ? 3 : 0);
+  }
+  ASSERT_TRUE(lsm.Runs().empty());
+
+  // The runs are merged by the level they overflow into
+  LSMLevel next(naming, 3, 1, kTiering, 4, manifest, buf, serializer,
+                test_filter_tuning());
+  ASSERT_TRUE(next.MergeRuns(overflow, std::nullopt).empty());
+  ASSERT_EQ(next.Runs().size(), 1);
+
+  auto v = next.Runs().front()->Scan(0, 20);
+  ASSERT_EQ(v.size(), 10);
+  for (K key = 0; key < 10; key++) {
+    K newest = std::min<K>(key, 2);
+    ASSERT_EQ(v.at(key).first, key);
+    ASSERT_EQ(v.at(key).second, 10 * newest + key);
+  }
+}
+
+/**
+ * A B-tree serializer counting the data files it writes.
+ */
+class CountingSstable : public SstableBTree {
+ public:
+  using SstableBTree::SstableBTree;
+
+  mutable std::size_t files_written{0};
+
+  std::unique_ptr<SstableBuilder> NewBuilder(
+      std::string& filename) const override {
+    this->files_written++;
+    return SstableBTree::NewBuilder(filename);
+  }
+};
+
+/**
+ * @brief Register a new run of level 0 holding a file of the four keys from
+ * @param first.
+ */
+std::vector<std::shared_ptr<LSMRun>> register_level0_run(
+    LSMLevel& level, LSMLevel& next, const DbNaming& naming,
+    Manifest& manifest, BufPool& buf, Sstable& serializer, Filter& filter,
+    K first) {
+  uint32_t r = manifest.NewRun();
+  auto run = std::make_shared<LSMRun>(naming, 0, r, 3, 4, manifest, buf,
+                                      serializer, filter);
+  std::vector<std::pair<K, V>> keys{};
+  for (K key = first; key < first + 4; key++) {
+    keys.emplace_back(key, key);
+  }
+  std::string filename = data_file(naming, 0, r, 0);
+  serializer.Flush(filename, keys, true);
+  std::string filter_name = filter_file(naming, 0, r, 0);
+  filter.Create(filter_name, keys);
+  run->RegisterNewFile(0, keys.front().first, keys.back().first);
+  return level.RegisterNewRun(run, next);
+}
+
+TEST(LSMLevel, LeveledCompactionWritesPairsOnce) {
+  DbNaming naming = create_dir("LSMLevel.LeveledCompactionWritesPairsOnce");
+  BufPool buf(BufPoolTuning{
+      .initial_elements = 4,
+      .max_elements = 16,
+  });
+  CountingSstable serializer(buf);
+  Filter filter(naming, buf, 0);
+  Manifest manifest(naming, 3, serializer, true);
+
+  // Level 0 holds 3 files and level 1 holds 9, of 4 pairs each
+  LSMLevel level0(naming, 3, 0, kLeveling, 4, manifest, buf, serializer,
+                  test_filter_tuning());
+  LSMLevel level1(naming, 3, 1, kLeveling, 4, manifest, buf, serializer,
+                  test_filter_tuning());
+
+  // Each compaction from level 0 carries 4 files into level 1
+  for (K first = 0; first < 32; first += 4) {
+    std::vector<std::shared_ptr<LSMRun>> overflow = register_level0_run(
+        level0, level1, naming, manifest, buf, serializer, filter, first);
+    ASSERT_EQ(overflow.empty(), first != 12 && first != 28);
+    if (overflow.empty()) {
+      continue;
+    }
+
+    // The run of level 1 is merged with the new files in a single pass, so
+    // each file of the new run is written once
+    serializer.files_written = 0;
+    ASSERT_TRUE(level1.MergeRuns(overflow, std::nullopt).empty());
+    ASSERT_EQ(level1.Runs().size(), 1);
+    ASSERT_EQ(serializer.files_written, level1.Runs().front()->NextFile());
+  }
+  ASSERT_TRUE(level0.Runs().empty());
+  ASSERT_EQ(level1.Runs().front()->NextFile(), 8);
+
+  auto v = level1.Runs().front()->Scan(0, 100);
+  ASSERT_EQ(v.size(), 32);
+  for (K key = 0; key < 32; key++) {
+    ASSERT_EQ(v.at(key).first, key);
+    ASSERT_EQ(v.at(key).second, key);
+  }
+}
@@ -2,13 +2,19 @@
 
 #include <gtest/gtest.h>
 
+#include <algorithm>
+#include <atomic>
 #include <cstdlib>
 #include <functional>
 #include <iostream>
+#include <map>
 #include <memory>
 #include <optional>
+#include <random>
 #include <sstream>
 #include <string>
+#include <thread>
+#include <utility>
 #include <vector>
 
 #include "kvstore.hpp"
@@ -388,4 +394,177 @@ TEST(MemTable, InsertManyAndGetMany) {
 
   const V* val4 = table->Get(4);
   ASSERT_EQ(*val4, 40);
-}
\ No newline at end of file
+}
+
+TEST(MemTable, RefillAfterClearManyTimes) {
+  auto table = std::make_unique<MemTable>(1000);
+  for (K fill = 0; fill < 5; fill++) {
+    std::vector<std::pair<K, V>> expected;
+    for (K i = 0; i < 1000; i++) {
+      K key = fill * 10000 + (i * 7919) % 1000;
+      table->Put(key, key + fill);
+      expected.emplace_back(key, key + fill);
+    }
+    std::sort(expected.begin(), expected.end());
+
+    ASSERT_EQ(table->Size(), 1000);
+    ASSERT_EQ(*table->ScanAll(), expected);
+    table->Clear();
+    ASSERT_EQ(table->Size(), 0);
+    ASSERT_EQ(table->ScanAll()->size(), 0);
+  }
+}
+
+TEST(MemTable, CopyOutlivesClear) {
+  auto table = std::make_unique<MemTable>(100);
+  for (K i = 0; i < 100; i++) {
+    table->Put(i, i * 10);
+  }
+
+  MemTable copy(*table);
+  table->Clear();
+  table->Put(5, 0);
+
+  ASSERT_EQ(copy.Size(), 100);
+  for (K i = 0; i < 100; i++) {
+    const V* val = copy.Get(i);
+    ASSERT_NE(val, nullptr);
+    ASSERT_EQ(*val, i * 10);
+  }
+}
+
+/**
+ * @brief Run random puts and deletes against a memtable of @param format and
+ * a std::map, checking that every read of the memtable matches the map.
+ */
+void matches_map(MemTableFormat format) {
+  MemTable table(4000, format);
+  std::map<K, V> expected;
+
+  std::mt19937 g(0);
+  std::uniform_int_distribution<K> keys(0, 499);
+  for (int op = 0; op < 3000; op++) {
+    K key = keys(g);
+    if (op % 5 == 4) {
+      V* old = table.Delete(key);
+      ASSERT_EQ(old != nullptr, expected.count(key) == 1);
+      if (old != nullptr) {
+        ASSERT_EQ(*old, expected.at(key));
+      }
+      expected.erase(key);
+    } else {
+      std::optional<V> old = table.Put(key, op);
+      // A vector memtable doesn't look for the old value
+      if (format != kVector) {
+        ASSERT_EQ(old.has_value(), expected.count(key) == 1);
+      }
+      expected[key] = op;
+    }
+
+    if (op == 1500) {
+      table.Clear();
+      expected.clear();
+    }
+
+    K other = keys(g);
+    V* val = table.Get(other);
+    ASSERT_EQ(val != nullptr, expected.count(other) == 1);
+    if (val != nullptr) {
+      ASSERT_EQ(*val, expected.at(other));
+    }
+    std::vector<std::pair<K, V>> scan(expected.lower_bound(other),
+                                      expected.upper_bound(other + 20));
+    ASSERT_EQ(table.Scan(other, other + 20), scan);
+  }
+  std::vector<std::pair<K, V>> all(expected.begin(), expected.end());
+  ASSERT_EQ(*table.ScanAll(), all);
+}
+
+TEST(MemTable, SkipListMatchesMap) { matches_map(kSkipList); }
+
+TEST(MemTable, VectorMatchesMap) { matches_map(kVector); }
+
+TEST(MemTable, SkipListCountsEveryWrite) {
+  MemTable skiplist(2, kSkipList);
+  skiplist.Put(1, 10);
+  skiplist.Put(1, 20);
+
+  ASSERT_EQ(skiplist.Size(), 2);
+  ASSERT_EQ(*skiplist.Get(1), 20);
+  ASSERT_THROW({ skiplist.Put(2, 20); }, MemTableFullException);
+}
+
+TEST(MemTable, SkipListConcurrentWritersAndReaders) {
+  const int writers = 4;
+  const K keys_per_writer = 2500;
+  MemTable skiplist(writers * keys_per_writer, kSkipList);
+
+  // Each key is only ever written with one value, so a reader either finds
+  // that value or nothing.
+  std::atomic<bool> done{false};
+  std::atomic<int> failures{0};
+  std::vector<std::thread> readers;
+  for (int r = 0; r < 2; r++) {
+    readers.emplace_back([&, r] {
+      std::mt19937 g(r);
+      std::uniform_int_distribution<K> keys(0, writers * keys_per_writer - 1);
+      while (!done.load()) {
+        K key = keys(g);
+        const V* val = skiplist.Get(key);
+        if (val != nullptr && *val != key * 10) {
+          failures++;
+        }
+        for (const auto& [k, v] : skiplist.Scan(key, key + 10)) {
+          if (v != k * 10) {
+            failures++;
+          }
+        }
+      }
+    });
+  }
+
+  std::vector<std::thread> threads;
+  for (int w = 0; w < writers; w++) {
+    threads.emplace_back([&, w] {
+      for (K i = 0; i < keys_per_writer; i++) {
+        K key = i * writers + w;
+        skiplist.Put(key, key * 10);
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  done.store(true);
+  for (auto& reader : readers) {
+    reader.join();
+  }
+
+  ASSERT_EQ(failures.load(), 0);
+  std::vector<std::pair<K, V>> expected;
+  for (K key = 0; key < writers * keys_per_writer; key++) {
+    expected.emplace_back(key, key * 10);
+  }
+  ASSERT_EQ(*skiplist.ScanAll(), expected);
+}
+
+TEST(MemTable, SortLastWritesOnManyThreads) {
+  std::mt19937 g(0);
+  std::uniform_int_distribution<K> keys(0, 9999);
+  std::vector<std::pair<K, V>> pairs;
+  std::map<K, V> expected;
+  for (V i = 0; i < 200000; i++) {
+    K key = keys(g);
+    pairs.emplace_back(key, i);
+    expected[key] = i;
+  }
+
+  std::vector<std::pair<K, V>> sorted = pairs;
+  sort_last_writes(sorted, 5);
+  std::vector<std::pair<K, V>> last(expected.begin(), expected.end());
+  ASSERT_EQ(sorted, last);
+
+  std::vector<std::pair<K, V>> single = pairs;
+  sort_last_writes(single, 1);
+  ASSERT_EQ(single, sorted);
+}
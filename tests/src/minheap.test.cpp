@@ -132,87 +132,81 @@ TEST(MinHeapMerge, OverlappingKeys) {
   }
 }
 
-TEST(MinHeap, InitWithKeysAndExtract) {
-  std::vector<K> initial_keys;
-  for (int i = 100; i >= 0; --i) {
-    initial_keys.push_back(static_cast<K>(i));
-  }
-  auto minheap = std::make_unique<MinHeap>(initial_keys);
-  for (int i = 0; i <= 100; i++) {
-    std::optional<std::pair<K, int>> min = minheap->Extract();
-    ASSERT_EQ(min->first, i);
-  }
-}
-
-TEST(MinHeap, InitWithNoKeys) {
-  std::vector<K> initial_keys;
-  auto minheap = std::make_unique<MinHeap>(initial_keys);
-}
-
-TEST(MinHeap, InsertAndExtract) {
-  std::vector<K> initial_keys;
-  for (int i = 100; i >= 0; i--) {
-    initial_keys.push_back(static_cast<K>(i));
-  }
-  auto minheap = std::make_unique<MinHeap>(initial_keys);
-  for (int i = 0; i <= 100; i++) {
-    std::pair<K, int> new_pair = std::make_pair(static_cast<K>(101), 1);
-    std::optional<std::pair<K, int>> min = minheap->InsertAndExtract(new_pair);
-    ASSERT_EQ(min->first, static_cast<K>(i));
+std::vector<std::pair<K, V>> drain(Cursor& cursor, K from) {
+  std::vector<std::pair<K, V>> pairs;
+  for (cursor.Seek(from); cursor.Valid(); cursor.Next()) {
+    pairs.emplace_back(cursor.Key(), cursor.Value());
   }
+  return pairs;
 }
 
-TEST(MinHeap, InsertAndExtractMany) {
-  std::vector<K> initial_keys;
-  for (int i = 10 * 1000; i >= 0; i--) {
-    initial_keys.push_back(K(i));
-  }
-  auto minheap = std::make_unique<MinHeap>(initial_keys);
-  for (int i = 0; i <= 10 * 1000; i++) {
-    std::pair<K, int> new_pair =
-        std::make_pair(static_cast<K>(10 * 1000 + 1), 1);
-    std::optional<std::pair<K, int>> min = minheap->InsertAndExtract(new_pair);
-    ASSERT_EQ(min->first, static_cast<K>(i));
-  }
+TEST(MergingCursor, LaterCursorsWin) {
+  std::vector<std::unique_ptr<Cursor>> cursors;
+  cursors.push_back(std::make_unique<VectorCursor>(
+      std::vector<std::pair<K, V>>({{0, 0}, {2, 0}, {4, 0}, {6, 0}})));
+  cursors.push_back(std::make_unique<VectorCursor>(
+      std::vector<std::pair<K, V>>({{1, 1}, {2, 1}, {6, 1}})));
+  cursors.push_back(std::make_unique<VectorCursor>(
+      std::vector<std::pair<K, V>>({{2, 2}, {5, 2}})));
+  cursors.push_back(
+      std::make_unique<VectorCursor>(std::vector<std::pair<K, V>>()));
+  MergingCursor merged(std::move(cursors));
+
+  ASSERT_FALSE(merged.Valid());
+  std::vector<std::pair<K, V>> expected(
+      {{0, 0}, {1, 1}, {2, 2}, {4, 0}, {5, 2}, {6, 1}});
+  ASSERT_EQ(drain(merged, 0), expected);
+
+  // Seeking between and onto keys, and past all of them
+  expected = {{4, 0}, {5, 2}, {6, 1}};
+  ASSERT_EQ(drain(merged, 3), expected);
+  expected = {{6, 1}};
+  ASSERT_EQ(drain(merged, 6), expected);
+  ASSERT_TRUE(drain(merged, 7).empty());
 }
 
-TEST(MinHeap, InsertAndExtractBreaksTiesWithRunIndex) {
-  std::vector<K> initial_keys;
-  initial_keys.reserve(100);
-  for (int i = 0; i < 100; i++) {
-    initial_keys.push_back(static_cast<K>(i));
+TEST(LoserTree, MatchesMinHeapMergeForAnyInputs) {
+  for (std::size_t inputs = 1; inputs <= 9; inputs++) {
+    std::vector<std::vector<std::pair<K, V>>> buffers(inputs);
+    for (std::size_t i = 0; i < inputs; i++) {
+      // Overlapping keys, and every third buffer left empty
+      for (K key = i; i % 3 != 2 && key < 40; key += i + 1) {
+        buffers.at(i).emplace_back(key, i);
+      }
+    }
+
+    LoserTree tree(inputs);
+    std::vector<std::size_t> cursors(inputs, 0);
+    for (std::size_t i = 0; i < inputs; i++) {
+      if (!buffers.at(i).empty()) {
+        tree.Set(i, buffers.at(i).front().first);
+      }
+    }
+    tree.Build();
+
+    // Every pair comes out, in key order and the latest buffer first
+    std::vector<std::pair<K, V>> popped{};
+    while (!tree.Empty()) {
+      std::size_t winner = tree.Winner();
+      ASSERT_EQ(tree.WinnerKey(), buffers.at(winner).at(cursors[winner]).first);
+      popped.push_back(buffers.at(winner).at(cursors[winner]++));
+      tree.ReplaceWinner(cursors[winner] < buffers.at(winner).size()
+                             ? std::make_optional(
+                                   buffers.at(winner).at(cursors[winner]).first)
+                             : std::nullopt);
+    }
+    for (std::size_t i = 1; i < popped.size(); i++) {
+      ASSERT_TRUE(popped[i - 1].first < popped[i].first ||
+                  (popped[i - 1].first == popped[i].first &&
+                   popped[i - 1].second > popped[i].second));
+    }
+
+    std::vector<std::pair<K, V>> expected{};
+    for (const auto& pair : popped) {
+      if (expected.empty() || expected.back().first != pair.first) {
+        expected.push_back(pair);
+      }
+    }
+    ASSERT_EQ(minheap_merge(buffers), expected);
   }
-  auto minheap = std::make_unique<MinHeap>(initial_keys);
-
-  std::pair<K, int> new_pair = std::make_pair(static_cast<K>(0), -1);
-  std::optional<std::pair<K, int>> min = minheap->InsertAndExtract(new_pair);
-  ASSERT_EQ(min->first, 0);
-  ASSERT_EQ(min->second, 0);
 }
-
-TEST(MinHeap, ExtractBreaksTiesWithRunIndex) {
-  std::vector<K> initial_keys;
-  initial_keys.reserve(100);
-  for (int i = 0; i < 100; i++) {
-    initial_keys.push_back(static_cast<K>(i));
-  }
-  auto minheap = std::make_unique<MinHeap>(initial_keys);
-
-  std::pair<K, int> older_pair = std::make_pair(static_cast<K>(1), 0);
-  std::optional<std::pair<K, int>> min = minheap->InsertAndExtract(older_pair);
-  min = minheap->Extract();
-  ASSERT_EQ(min->first, 1);
-  ASSERT_EQ(min->second, 1);
-  min = minheap->Extract();
-  ASSERT_EQ(min->first, 1);
-  ASSERT_EQ(min->second, 0);
-
-  std::pair<K, int> newer_pair = std::make_pair(static_cast<K>(3), 4);
-  min = minheap->InsertAndExtract(newer_pair);
-  min = minheap->Extract();
-  ASSERT_EQ(min->first, 3);
-  ASSERT_EQ(min->second, 4);
-  min = minheap->Extract();
-  ASSERT_EQ(min->first, 3);
-  ASSERT_EQ(min->second, 3);
-}
\ No newline at end of file
@@ -43,3 +43,11 @@ TEST(Naming, LockFileNamedCorrectly) {
   DbNaming naming = DbNaming{.dirpath = "dir", .name = "kvstore"};
   ASSERT_EQ(lock_file(naming), std::string("dir/kvstore.LOCK"));
 }
+
+TEST(Naming, WalFileParsedCorrectly) {
+  DbNaming naming = DbNaming{.dirpath = "dir", .name = "kvstore"};
+  std::string filename = wal_file(naming, 12);
+  ASSERT_EQ(filename, std::string("dir/kvstore.WAL.S12"));
+
+  ASSERT_EQ(parse_wal_file_segment(filename), 12);
+}
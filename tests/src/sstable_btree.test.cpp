@@ -151,6 +151,103 @@ TEST(SstableBTree, GetSingleElems3Layers16MB) {
   }
 }
 
+TEST(SstableBTree, MultiGetReadsEachPageOnce) {
+  auto buf = test_buf();
+  MemTable memtable(100000);
+  for (int i = 0; i < 100000; i++) {
+    memtable.Put(2 * i, i);
+  }
+
+  SstableBTree t(buf);
+  std::string f("/tmp/SstableBTree.MultiGetReadsEachPageOnce");
+  auto pairs = memtable.ScanAll();
+  t.Flush(f, *pairs, true);
+
+  // Every third key, half of them missing, and some past the ends
+  std::vector<K> keys;
+  for (K key = 1; key < 200010; key += 3) {
+    keys.push_back(key);
+  }
+
+  BufPoolStats before = buf.Stats();
+  std::vector<std::optional<V>> values = t.MultiGetFromFile(f, keys);
+  BufPoolStats after = buf.Stats();
+
+  ASSERT_EQ(values.size(), keys.size());
+  for (std::size_t i = 0; i < keys.size(); i++) {
+    ASSERT_EQ(values[i], t.GetFromFile(f, keys[i]));
+  }
+
+  // The metadata page, the root, the internal nodes, and every leaf, once
+  uint64_t leaves = (100000 + 254) / 255;
+  ASSERT_LE(after.hits + after.misses - before.hits - before.misses,
+            2 + (leaves + 254) / 255 + leaves);
+}
+
+TEST(SstableBTree, CursorSeeksAndWalksFile) {
+  auto buf = test_buf();
+  MemTable memtable(100000);
+  for (int i = 0; i < 100000; i++) {
+    memtable.Put(2 * i, i);
+  }
+
+  SstableBTree t(buf);
+  std::string f("/tmp/SstableBTree.CursorSeeksAndWalksFile");
+  auto pairs = memtable.ScanAll();
+  t.Flush(f, *pairs, true);
+
+  std::unique_ptr<Cursor> cursor = t.NewCursor(f);
+  ASSERT_FALSE(cursor->Valid());
+
+  // Seeking before, onto, between, and past the keys, and to the ends of leaves
+  for (K lower : {0, 1, 508, 509, 510, 12345, 199998, 199999}) {
+    std::vector<std::pair<K, V>> expected;
+    for (const auto& pair : *pairs) {
+      if (pair.first >= lower) {
+        expected.push_back(pair);
+      }
+    }
+
+    std::vector<std::pair<K, V>> scanned;
+    for (cursor->Seek(lower); cursor->Valid(); cursor->Next()) {
+      scanned.emplace_back(cursor->Key(), cursor->Value());
+    }
+    ASSERT_EQ(scanned, expected);
+  }
+}
+
+std::string file_bytes(const std::string& filename) {
+  std::ifstream file(filename, std::ios::binary);
+  std::stringstream contents;
+  contents << file.rdbuf();
+  return contents.str();
+}
+
+TEST(SstableBTree, BuilderMatchesFlush) {
+  auto buf = test_buf();
+  SstableBTree t(buf);
+  std::string flushed("/tmp/SstableBTree.BuilderMatchesFlush.flushed");
+  std::string built("/tmp/SstableBTree.BuilderMatchesFlush.built");
+
+  // Empty, a single leaf, just past a leaf, and two layers of internal nodes
+  for (int n : {0, 1, 255, 256, 100000}) {
+    std::vector<std::pair<K, V>> pairs;
+    for (int i = 0; i < n; i++) {
+      pairs.emplace_back(3 * i + 1, i);
+    }
+    t.Flush(flushed, pairs, true);
+
+    std::unique_ptr<SstableBuilder> builder = t.NewBuilder(built);
+    for (const auto& pair : pairs) {
+      builder->Add(pair.first, pair.second);
+    }
+    ASSERT_EQ(builder->Size(), n);
+    builder->Finish();
+
+    ASSERT_EQ(file_bytes(built), file_bytes(flushed));
+  }
+}
+
 // Further test layers of internal nodes (like 3+ layers)
 // TODO: taking max of maxes for internal layers
 
@@ -472,4 +569,62 @@ TEST(SstableBTree, GetMaximum) {
 
   uint64_t maxKey = t.GetMaximum(f);
   ASSERT_EQ(maxKey, 63);
-}
\ No newline at end of file
+}
+TEST(SstableBTree, SequentialScansDoNotFillBufferPool) {
+  auto buf = test_buf();
+  int amt = 10000;
+  MemTable memtable(amt);
+  for (int i = 0; i < amt; i++) {
+    memtable.Put(i, 2 * i);
+  }
+
+  SstableBTree t(buf);
+  std::string f("/tmp/SstableBTree.SequentialScansDoNotFillBufferPool");
+  auto keys = memtable.ScanAll();
+  t.Flush(f, *keys, true);
+
+  // Cache the pages on the path to a key
+  ASSERT_EQ(t.GetFromFile(f, 5000), std::make_optional(10000));
+  BufPoolStats before = buf.Stats();
+
+  // Reads far more pages than the buffer pool holds, without caching them
+  ASSERT_EQ(t.Drain(f).size(), amt);
+  ASSERT_EQ(t.ScanInFile(f, 0, amt, kSequentialOnce).size(), amt);
+  BufPoolStats after = buf.Stats();
+  ASSERT_GT(after.misses, before.misses);
+  ASSERT_EQ(after.evictions, before.evictions);
+
+  // So the point lookup still hits every page
+  ASSERT_EQ(t.GetFromFile(f, 5000), std::make_optional(10000));
+  ASSERT_EQ(buf.Stats().misses, after.misses);
+}
+
+TEST(SstableBTree, DeleteForgetsEveryCachedPage) {
+  auto buf = test_buf();
+  int amt = 1000;
+  std::vector<std::pair<K, V>> pairs;
+  for (int i = 0; i < amt; i++) {
+    pairs.emplace_back(i, i);
+  }
+
+  SstableBTree t(buf);
+  std::string f("/tmp/SstableBTree.DeleteForgetsEveryCachedPage");
+  t.Flush(f, pairs, true);
+
+  // Cache the leaves and the internal pages above them
+  for (int i = 0; i < amt; i++) {
+    ASSERT_EQ(t.GetFromFile(f, i), std::make_optional(i));
+  }
+
+  // A new file under the same name, with other keys below each internal
+  // page, is read from disk rather than from the old pages
+  t.Delete(f);
+  for (auto& [key, value] : pairs) {
+    key = 2 * key;
+    value = key + 1;
+  }
+  t.Flush(f, pairs, true);
+  for (int i = 0; i < amt; i++) {
+    ASSERT_EQ(t.GetFromFile(f, 2 * i), std::make_optional(2 * i + 1));
+  }
+}
@@ -380,6 +380,66 @@ TEST(SstableNaive, Drain10KEntries) {
   }
 }
 
+TEST(SstableNaive, BuilderMatchesFlush) {
+  auto buf = test_buf();
+  SstableNaive t(buf);
+  std::string flushed("/tmp/SstableNaive.BuilderMatchesFlush.flushed");
+  std::string built("/tmp/SstableNaive.BuilderMatchesFlush.built");
+
+  // A single pair, a full page of pairs, and many pages
+  for (int n : {1, 256, 257, 10000}) {
+    std::vector<std::pair<K, V>> pairs;
+    for (int i = 0; i < n; i++) {
+      pairs.emplace_back(3 * i + 1, i);
+    }
+    t.Flush(flushed, pairs, true);
+
+    std::unique_ptr<SstableBuilder> builder = t.NewBuilder(built);
+    for (const auto& pair : pairs) {
+      builder->Add(pair.first, pair.second);
+    }
+    ASSERT_EQ(builder->Size(), n);
+    builder->Finish();
+
+    ASSERT_EQ(t.GetMinimum(built), t.GetMinimum(flushed));
+    ASSERT_EQ(t.GetMaximum(built), t.GetMaximum(flushed));
+    ASSERT_EQ(t.Drain(built), pairs);
+    ASSERT_EQ(t.GetFromFile(built, 3 * (n / 2) + 1), n / 2);
+  }
+}
+
+TEST(SstableNaive, CursorSeeksAndWalksFile) {
+  auto buf = test_buf();
+  MemTable memtable(10000);
+  for (int i = 0; i < 10000; i++) {
+    memtable.Put(2 * i, i);
+  }
+
+  SstableNaive t(buf);
+  std::string f("/tmp/SstableNaive.CursorSeeksAndWalksFile");
+  auto pairs = memtable.ScanAll();
+  t.Flush(f, *pairs, true);
+
+  std::unique_ptr<Cursor> cursor = t.NewCursor(f);
+  ASSERT_FALSE(cursor->Valid());
+
+  // Seeking before, onto, between, and past the keys, and across pages
+  for (K lower : {0, 1, 510, 511, 512, 12345, 19998, 19999}) {
+    std::vector<std::pair<K, V>> expected;
+    for (const auto& pair : *pairs) {
+      if (pair.first >= lower) {
+        expected.push_back(pair);
+      }
+    }
+
+    std::vector<std::pair<K, V>> scanned;
+    for (cursor->Seek(lower); cursor->Valid(); cursor->Next()) {
+      scanned.emplace_back(cursor->Key(), cursor->Value());
+    }
+    ASSERT_EQ(scanned, expected);
+  }
+}
+
 TEST(SstableNaive, GetMinimum) {
   auto buf = test_buf();
   MemTable memtable(64);
@@ -1,11 +1,16 @@
 #include "testutil.hpp"
 
 #include <gtest/gtest.h>
+#include <sys/resource.h>
 
 #include <cassert>
+#include <csignal>
 #include <filesystem>
 #include <cmath>
+#include <functional>
+#include <set>
 #include <string>
+#include <vector>
 
 #include "buf.hpp"
 #include "naming.hpp"
@@ -22,6 +27,20 @@ BufPool test_buf() {
   return {BufPoolTuning{.initial_elements = 2, .max_elements = 16}};
 }
 
+void with_file_size_limit(rlim_t bytes, const std::function<void()>& body) {
+  auto previous_handler = std::signal(SIGXFSZ, SIG_IGN);
+  rlimit previous{};
+  getrlimit(RLIMIT_FSIZE, &previous);
+  rlimit limit = previous;
+  limit.rlim_cur = bytes;
+  setrlimit(RLIMIT_FSIZE, &limit);
+
+  body();
+
+  setrlimit(RLIMIT_FSIZE, &previous);
+  std::signal(SIGXFSZ, previous_handler);
+}
+
 void syntactic_exists(std::string file) {
   bool exists = std::filesystem::exists(file);
   if (exists) {
@@ -40,67 +59,67 @@ void syntactic_not_exists(std::string file) {
   }
 }
 
+/**
+ * @brief The ids of the runs of level @param level whose data files are on
+ * disk, oldest first.
+ */
+static std::vector<int> runs_in_level(const std::string& prefix, int level) {
+  std::string stem = prefix + "DATA.L" + std::to_string(level) + ".R";
+  std::set<int> runs;
+  std::filesystem::path dir = std::filesystem::path(prefix).parent_path();
+  for (const auto& entry : std::filesystem::directory_iterator(dir)) {
+    std::string filename = entry.path().string();
+    if (filename.rfind(stem, 0) == 0) {
+      runs.insert(std::stoi(filename.substr(stem.size())));
+    }
+  }
+  return {runs.begin(), runs.end()};
+}
+
 void structure_exists(std::string prefix, uint8_t tiers, int level, int run,
                       int intermediate) {
   (void)tiers;
-  syntactic_exists(prefix + "DATA.L" + std::to_string(level) + ".R" +
-                   std::to_string(run) + ".I" + std::to_string(intermediate));
-  syntactic_exists(prefix + "FILTER.L" + std::to_string(level) + ".R" +
-                   std::to_string(run) + ".I" + std::to_string(intermediate));
+  std::vector<int> runs = runs_in_level(prefix, level);
+  ASSERT_LT(run, runs.size());
+  std::string id = std::to_string(runs[run]);
+  syntactic_exists(prefix + "DATA.L" + std::to_string(level) + ".R" + id +
+                   ".I" + std::to_string(intermediate));
+  syntactic_exists(prefix + "FILTER.L" + std::to_string(level) + ".R" + id +
+                   ".I" + std::to_string(intermediate));
 }
 
 void structure_exists(std::string prefix, uint8_t tiers, int level, int run) {
   for (int i = 0; i < pow(tiers, level); i++) {
-    std::string sstable = prefix + "DATA.L" + std::to_string(level) + ".R" +
-                          std::to_string(run) + ".I" + std::to_string(i);
-    syntactic_exists(sstable);
-    std::string filter = prefix + "FILTER.L" + std::to_string(level) + ".R" +
-                         std::to_string(run) + ".I" + std::to_string(i);
-    syntactic_exists(filter);
+    structure_exists(prefix, tiers, level, run, i);
   }
 }
 
 void structure_exists(std::string prefix, uint8_t tiers, int level) {
   for (int run = 0; run < tiers - 1; run++) {
-    for (int i = 0; i < pow(tiers, level); i++) {
-      syntactic_exists(prefix + "DATA.L" + std::to_string(level) + ".R" +
-                       std::to_string(run) + ".I" + std::to_string(i));
-      syntactic_exists(prefix + "FILTER.L" + std::to_string(level) + ".R" +
-                       std::to_string(run) + ".I" + std::to_string(i));
-    }
+    structure_exists(prefix, tiers, level, run);
   }
 }
 
 void structure_not_exists(std::string prefix, uint8_t tiers, int level, int run,
                           int intermediate) {
   (void)tiers;
-  syntactic_not_exists(prefix + "DATA.L" + std::to_string(level) + ".R" +
-                       std::to_string(run) + ".I" +
-                       std::to_string(intermediate));
+  std::vector<int> runs = runs_in_level(prefix, level);
+  if (run >= static_cast<int>(runs.size())) {
+    return;
+  }
+  std::string id = std::to_string(runs[run]);
+  syntactic_not_exists(prefix + "DATA.L" + std::to_string(level) + ".R" + id +
+                       ".I" + std::to_string(intermediate));
   syntactic_not_exists(prefix + "FILTER.L" + std::to_string(level) + ".R" +
-                       std::to_string(run) + ".I" +
-                       std::to_string(intermediate));
+                       id + ".I" + std::to_string(intermediate));
 }
 
 void structure_not_exists(std::string prefix, uint8_t tiers, int level,
                           int run) {
-  for (int i = 0; i < pow(tiers, level); i++) {
-    std::string sstable = prefix + "DATA.L" + std::to_string(level) + ".R" +
-                          std::to_string(run) + ".I" + std::to_string(i);
-    syntactic_not_exists(sstable);
-    std::string filter = prefix + "FILTER.L" + std::to_string(level) + ".R" +
-                         std::to_string(run) + ".I" + std::to_string(i);
-    syntactic_not_exists(filter);
-  }
+  (void)tiers;
+  ASSERT_LE(runs_in_level(prefix, level).size(), run);
 }
 
 void structure_not_exists(std::string prefix, uint8_t tiers, int level) {
-  for (int run = 0; run < tiers - 1; run++) {
-    for (int i = 0; i < pow(tiers, level); i++) {
-      syntactic_not_exists(prefix + "DATA.L" + std::to_string(level) + ".R" +
-                           std::to_string(run) + ".I" + std::to_string(i));
-      syntactic_not_exists(prefix + "FILTER.L" + std::to_string(level) + ".R" +
-                           std::to_string(run) + ".I" + std::to_string(i));
-    }
-  }
-}
\ No newline at end of file
+  structure_not_exists(prefix, tiers, level, 0);
+}
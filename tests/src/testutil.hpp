@@ -1,5 +1,8 @@
 #pragma once
 
+#include <sys/resource.h>
+
+#include <functional>
 #include <string>
 
 #include "buf.hpp"
@@ -9,6 +12,15 @@ DbNaming create_dir(std::string dir_name);
 
 BufPool test_buf();
 
+/**
+ * @brief Run @param body with the files the process writes capped at
+ * @param bytes, so that writes past the cap fail with EFBIG.
+ */
+void with_file_size_limit(rlim_t bytes, const std::function<void()>& body);
+
+// Check the files of the levels of a database. Run ids are unique across the
+// levels, so `run` is the position of the run in its level, oldest first, and
+// checking that a run does not exist checks that the level has fewer runs.
 void structure_exists(std::string prefix, uint8_t tiers, int level, int run,
                       int intermediate);
 void structure_exists(std::string prefix, uint8_t tiers, int level, int run);
@@ -0,0 +1,174 @@
+#include "wal.hpp"
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "constants.hpp"
+#include "fileutil.hpp"
+#include "naming.hpp"
+#include "testutil.hpp"
+
+WalTuning test_wal_tuning() {
+  return WalTuning{
+      .sync = true,
+      .group_commit = true,
+      .group_commit_window = std::chrono::microseconds(100),
+  };
+}
+
+std::vector<std::pair<K, V>> replay_all(WriteAheadLog& wal) {
+  std::vector<std::pair<K, V>> all;
+  wal.Replay([&](const std::vector<std::pair<K, V>>& batch) {
+    all.insert(all.end(), batch.begin(), batch.end());
+  });
+  return all;
+}
+
+TEST(WriteAheadLog, CreatesSegment) {
+  auto naming = create_dir("WriteAheadLog.CreatesSegment");
+  WriteAheadLog wal(naming, test_wal_tuning());
+
+  ASSERT_TRUE(is_file_type(wal_file(naming, 0), FileType::kWal));
+  ASSERT_EQ(std::filesystem::file_size(wal_file(naming, 0)), kPageSize);
+}
+
+TEST(WriteAheadLog, ReplaysPreviousSegments) {
+  auto naming = create_dir("WriteAheadLog.ReplaysPreviousSegments");
+  {
+    WriteAheadLog wal(naming, test_wal_tuning());
+    wal.Append({{1, 10}});
+    wal.Append({{2, 20}, {3, 30}});
+    wal.NewSegment();
+    wal.Append({{1, 11}});
+  }
+
+  WriteAheadLog wal(naming, test_wal_tuning());
+  std::vector<std::pair<K, V>> expected{{1, 10}, {2, 20}, {3, 30}, {1, 11}};
+  ASSERT_EQ(replay_all(wal), expected);
+
+  // Records appended after opening are not part of the replay
+  wal.Append({{4, 40}});
+  ASSERT_EQ(replay_all(wal), expected);
+}
+
+TEST(WriteAheadLog, RemovesOldSegments) {
+  auto naming = create_dir("WriteAheadLog.RemovesOldSegments");
+  {
+    WriteAheadLog wal(naming, test_wal_tuning());
+    wal.Append({{1, 10}});
+    uint64_t segment = wal.NewSegment();
+    wal.Append({{2, 20}});
+    wal.RemoveSegmentsBefore(segment);
+
+    ASSERT_FALSE(std::filesystem::exists(wal_file(naming, 0)));
+    ASSERT_TRUE(std::filesystem::exists(wal_file(naming, segment)));
+  }
+
+  WriteAheadLog wal(naming, test_wal_tuning());
+  std::vector<std::pair<K, V>> expected{{2, 20}};
+  ASSERT_EQ(replay_all(wal), expected);
+}
+
+TEST(WriteAheadLog, StopsAtTornBatch) {
+  auto naming = create_dir("WriteAheadLog.StopsAtTornBatch");
+  {
+    WriteAheadLog wal(naming, WalTuning{
+                                  .sync = true,
+                                  .group_commit_window =
+                                      std::chrono::microseconds(0),
+                              });
+    wal.Append({{1, 10}});
+    wal.Append({{2, 20}, {3, 30}});
+  }
+
+  // Cut the last batch short, as a crash mid-write would
+  std::filesystem::path segment = wal_file(naming, 0);
+  std::filesystem::resize_file(segment,
+                               std::filesystem::file_size(segment) - 8);
+
+  WriteAheadLog wal(naming, test_wal_tuning());
+  std::vector<std::pair<K, V>> expected{{1, 10}};
+  ASSERT_EQ(replay_all(wal), expected);
+}
+
+TEST(WriteAheadLog, StopsAtCorruptBatch) {
+  auto naming = create_dir("WriteAheadLog.StopsAtCorruptBatch");
+  {
+    WriteAheadLog wal(naming, WalTuning{
+                                  .sync = false,
+                                  .group_commit_window =
+                                      std::chrono::microseconds(0),
+                              });
+    wal.Append({{1, 10}});
+    wal.Append({{2, 20}});
+  }
+
+  // Flip the value of the second batch
+  std::fstream f(wal_file(naming, 0),
+                 std::fstream::binary | std::fstream::in | std::fstream::out);
+  uint64_t corrupt = 21;
+  f.seekp(kPageSize + (5 * sizeof(uint64_t)));
+  f.write(reinterpret_cast<char*>(&corrupt), sizeof(uint64_t));
+  f.close();
+
+  WriteAheadLog wal(naming, test_wal_tuning());
+  std::vector<std::pair<K, V>> expected{{1, 10}};
+  ASSERT_EQ(replay_all(wal), expected);
+}
+
+TEST(WriteAheadLog, FailedWriteStopsTheLog) {
+  auto naming = create_dir("WriteAheadLog.FailedWriteStopsTheLog");
+  WriteAheadLog wal(naming, WalTuning{
+                                .sync = true,
+                                .group_commit_window = std::chrono::seconds(0),
+                            });
+  wal.Append({{1, 10}});
+
+  std::vector<std::pair<K, V>> batch(kPageSize, {2, 20});
+  with_file_size_limit(2 * kPageSize, [&] {
+    ASSERT_THROW(wal.Append(batch), WriteAheadLogFailedException);
+  });
+
+  // The segment is not used again, even once there is room
+  ASSERT_TRUE(wal.Failed());
+  ASSERT_THROW(wal.Append({{3, 30}}), WriteAheadLogFailedException);
+  ASSERT_THROW(wal.Sync(), WriteAheadLogFailedException);
+  ASSERT_THROW(wal.NewSegment(), WriteAheadLogFailedException);
+}
+
+TEST(WriteAheadLog, GroupCommitsAppendsFromManyThreads) {
+  auto naming = create_dir("WriteAheadLog.GroupCommitsAppendsFromManyThreads");
+  const K threads = 8;
+  const K appends = 100;
+  {
+    WriteAheadLog wal(naming, test_wal_tuning());
+    std::vector<std::thread> appenders;
+    for (K t = 0; t < threads; t++) {
+      appenders.emplace_back([&wal, t] {
+        for (K key = t * appends; key < (t + 1) * appends; key++) {
+          wal.Append({{key, key}});
+        }
+      });
+    }
+    for (auto& appender : appenders) {
+      appender.join();
+    }
+    ASSERT_FALSE(wal.Failed());
+  }
+
+  WriteAheadLog wal(naming, test_wal_tuning());
+  std::vector<std::pair<K, V>> replayed = replay_all(wal);
+  std::sort(replayed.begin(), replayed.end());
+  std::vector<std::pair<K, V>> expected;
+  for (K key = 0; key < threads * appends; key++) {
+    expected.emplace_back(key, key);
+  }
+  ASSERT_EQ(replayed, expected);
+}